@@ -0,0 +1,276 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "active.h"
+#include "sweep.h"
+
+/**
+ * tiles of a grid, tile (r, c) is cells (r * ACTIVE_TILE .., c * ACTIVE_TILE ..).
+ * previous marks the tiles that changed in the last sweep and changed those that changed so far
+ * in this one, active the tiles of the tile row being updated. rowHeat is the heat of every row
+ * and before the values of a span before its update.
+ */
+struct ActiveRegion
+{
+    size_t rows;
+    size_t cols;
+    size_t tileRows;
+    size_t tileCols;
+    double threshold;
+    unsigned char *previous;
+    unsigned char *changed;
+    unsigned char *active;
+    double *rowHeat;
+    double *before;
+};
+
+
+// ____________ functions _______________
+int tileNear(const ActiveRegion *region, size_t tileRow, size_t tileCol, int is_cyclic);
+
+int tileMarked(const ActiveRegion *region, long long tileRow, long long tileCol, int is_cyclic);
+
+void updateActiveRow(ActiveRegion *region, diff_func function, const LinearStencil *stencil,
+                     HeatGrid *grid, size_t i, int is_cyclic, int colour);
+
+void recordSpan(ActiveRegion *region, const double *row, size_t i, size_t from, size_t to);
+
+
+/**
+ * start tracking a grid, every tile is active for the first sweep
+ * @param grid grid of values
+ * @param threshold a cell changed when its update moved it by more than threshold
+ * @return new region, NULL if memory allocation went wrong
+ */
+ActiveRegion *createActiveRegion(const HeatGrid *grid, double threshold)
+{
+    ActiveRegion *region = malloc(sizeof(ActiveRegion));
+    if (!region)
+    {
+        return NULL;
+    }
+    region->rows = grid->rows;
+    region->cols = grid->cols;
+    region->tileRows = (grid->rows + ACTIVE_TILE - 1) / ACTIVE_TILE;
+    region->tileCols = (grid->cols + ACTIVE_TILE - 1) / ACTIVE_TILE;
+    region->threshold = threshold;
+    size_t tiles = region->tileRows * region->tileCols;
+    region->previous = malloc(tiles ? tiles : 1);
+    region->changed = malloc(tiles ? tiles : 1);
+    region->active = malloc(region->tileCols ? region->tileCols : 1);
+    region->rowHeat = malloc(sizeof(double) * (grid->rows ? grid->rows : 1));
+    region->before = malloc(sizeof(double) * (grid->cols ? grid->cols : 1));
+    if (!region->previous || !region->changed || !region->active || !region->rowHeat ||
+        !region->before)
+    {
+        freeActiveRegion(region);
+        return NULL;
+    }
+    // the first sweep sees every tile as changed by the sweep before it
+    memset(region->changed, 1, tiles);
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        region->rowHeat[i] = rowHeat(GRID_ROW(grid, i), grid->cols);
+    }
+    return region;
+}
+
+/**
+ * @param region the region, may be NULL
+ */
+void freeActiveRegion(ActiveRegion *region)
+{
+    if (!region)
+    {
+        return;
+    }
+    free(region->previous);
+    free(region->changed);
+    free(region->active);
+    free(region->rowHeat);
+    free(region->before);
+    free(region);
+}
+
+/**
+ * one raster or red-black sweep over the active tiles, row by row in the order of a full sweep.
+ * a tile is active when it or one of the 8 tiles around it changed in the previous sweep or
+ * earlier in this one. a cell of a skipped tile would have moved by about threshold at most,
+ * so with threshold 0 only the cells whose whole neighbourhood stayed put are skipped.
+ * @param region the region of the grid
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param order ORDER_RASTER or ORDER_RED_BLACK
+ */
+void sweepActive(ActiveRegion *region, diff_func function, const LinearStencil *stencil,
+                 HeatGrid *grid, int is_cyclic, UpdateOrder order)
+{
+    unsigned char *swap = region->previous;
+    region->previous = region->changed;
+    region->changed = swap;
+    memset(region->changed, 0, region->tileRows * region->tileCols);
+    int first = order == ORDER_RED_BLACK ? 0 : ALL_COLOURS;
+    int last = order == ORDER_RED_BLACK ? 1 : ALL_COLOURS;
+    for (int colour = first; colour <= last; colour++)
+    {
+        for (size_t tileRow = 0; tileRow < region->tileRows; tileRow++)
+        {
+            int any = 0;
+            for (size_t tileCol = 0; tileCol < region->tileCols; tileCol++)
+            {
+                region->active[tileCol] = (unsigned char) tileNear(region, tileRow, tileCol,
+                                                                   is_cyclic);
+                any |= region->active[tileCol];
+            }
+            if (!any)
+            {
+                continue;
+            }
+            size_t end = (tileRow + 1) * ACTIVE_TILE;
+            for (size_t i = tileRow * ACTIVE_TILE; i < end && i < region->rows; i++)
+            {
+                updateActiveRow(region, function, stencil, grid, i, is_cyclic, colour);
+            }
+        }
+    }
+}
+
+/**
+ * @param region the region
+ * @return the heat of the grid after the last sweep. a row that was updated whole is summed
+ *         again, the heat of any other row is moved by the changes of its updated cells.
+ */
+double activeHeat(const ActiveRegion *region)
+{
+    double sum = 0;
+    for (size_t i = 0; i < region->rows; i++)
+    {
+        sum += region->rowHeat[i];
+    }
+    return sum;
+}
+
+/**
+ * @param region the region
+ * @param tileRow row of the tile
+ * @param tileCol column of the tile
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return 1 if the tile or one of the 8 tiles around it changed, 0 otherwise
+ */
+int tileNear(const ActiveRegion *region, size_t tileRow, size_t tileCol, int is_cyclic)
+{
+    for (long long r = (long long) tileRow - 1; r <= (long long) tileRow + 1; r++)
+    {
+        for (long long c = (long long) tileCol - 1; c <= (long long) tileCol + 1; c++)
+        {
+            if (tileMarked(region, r, c, is_cyclic))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @param region the region
+ * @param tileRow row of a tile, may be one past either edge
+ * @param tileCol column of a tile, may be one past either edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return 1 if the tile changed in the last sweep or in this one, 0 otherwise or past a zero
+ *         edge. a cyclic grid wraps around.
+ */
+int tileMarked(const ActiveRegion *region, long long tileRow, long long tileCol, int is_cyclic)
+{
+    long long rows = (long long) region->tileRows, cols = (long long) region->tileCols;
+    if (tileRow < 0 || tileRow >= rows || tileCol < 0 || tileCol >= cols)
+    {
+        if (!is_cyclic)
+        {
+            return 0;
+        }
+        tileRow = (tileRow + rows) % rows;
+        tileCol = (tileCol + cols) % cols;
+    }
+    size_t index = (size_t) tileRow * region->tileCols + (size_t) tileCol;
+    return region->previous[index] || region->changed[index];
+}
+
+/**
+ * update the spans of consecutive active tiles of row i
+ * @param region the region, with the active tiles of the tile row of row i
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param i the row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ */
+void updateActiveRow(ActiveRegion *region, diff_func function, const LinearStencil *stencil,
+                     HeatGrid *grid, size_t i, int is_cyclic, int colour)
+{
+    size_t m = region->cols;
+    double *row = GRID_ROW(grid, i);
+    const double *bottom = bottomRow(grid, grid->data, i, is_cyclic);
+    const double *top = topRow(grid, grid->data, i, is_cyclic);
+    size_t tileCol = 0, updated = 0;
+    while (tileCol < region->tileCols)
+    {
+        if (!region->active[tileCol])
+        {
+            tileCol++;
+            continue;
+        }
+        size_t from = tileCol * ACTIVE_TILE;
+        while (tileCol < region->tileCols && region->active[tileCol])
+        {
+            tileCol++;
+        }
+        size_t to = tileCol * ACTIVE_TILE < m ? tileCol * ACTIVE_TILE : m;
+        memcpy(region->before + from, row + from, sizeof(double) * (to - from));
+        updateRowSpan(function, stencil, grid, i, from, to, bottom, top, is_cyclic, colour);
+        recordSpan(region, row, i, from, to);
+        updated += to - from;
+    }
+    // a whole row is summed the way a full sweep sums it
+    if (updated == m)
+    {
+        region->rowHeat[i] = rowHeat(row, m);
+    }
+}
+
+/**
+ * mark the tiles of a just updated span that changed and move the heat of the row by the change
+ * @param region the region, before holds the values of the span before the update
+ * @param row row i of the grid
+ * @param i the row
+ * @param from first column of the span
+ * @param to one past the last column of the span
+ */
+void recordSpan(ActiveRegion *region, const double *row, size_t i, size_t from, size_t to)
+{
+    unsigned char *changed = region->changed + (i / ACTIVE_TILE) * region->tileCols;
+    double heat = 0;
+    for (size_t tileFrom = from; tileFrom < to; tileFrom += ACTIVE_TILE)
+    {
+        size_t tileTo = tileFrom + ACTIVE_TILE < to ? tileFrom + ACTIVE_TILE : to;
+        double largest = 0;
+        for (size_t j = tileFrom; j < tileTo; j++)
+        {
+            double change = row[j] - region->before[j];
+            heat += change;
+            largest = fmax(largest, fabs(change));
+        }
+        if (largest > region->threshold)
+        {
+            changed[tileFrom / ACTIVE_TILE] = 1;
+        }
+    }
+    region->rowHeat[i] += heat;
+}
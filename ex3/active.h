@@ -0,0 +1,55 @@
+/**
+ * @author Idan Yamin
+ * @brief the active region of a HeatGrid: the tiles of ACTIVE_TILE x ACTIVE_TILE cells the heat
+ * moved in during the last sweep. a sweep only updates the tiles next to one that changed, so
+ * the cells heat hasn't reached yet cost nothing and the region grows with the front.
+ */
+
+#ifndef EX3_ACTIVE_H
+#define EX3_ACTIVE_H
+
+#include "grid_calculator.h"
+#include "heat_grid.h"
+#include "kernels.h"
+
+// rows and columns of a tile of the active region
+#define ACTIVE_TILE 32
+
+typedef struct ActiveRegion ActiveRegion;
+
+/**
+ * start tracking a grid, every tile is active for the first sweep
+ * @param grid grid of values
+ * @param threshold a cell changed when its update moved it by more than threshold
+ * @return new region, NULL if memory allocation went wrong
+ */
+ActiveRegion *createActiveRegion(const HeatGrid *grid, double threshold);
+
+/**
+ * @param region the region, may be NULL
+ */
+void freeActiveRegion(ActiveRegion *region);
+
+/**
+ * one raster or red-black sweep over the active tiles, row by row in the order of a full sweep.
+ * a tile is active when it or one of the 8 tiles around it changed in the previous sweep or
+ * earlier in this one. a cell of a skipped tile would have moved by about threshold at most,
+ * so with threshold 0 only the cells whose whole neighbourhood stayed put are skipped.
+ * @param region the region of the grid
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param order ORDER_RASTER or ORDER_RED_BLACK
+ */
+void sweepActive(ActiveRegion *region, diff_func function, const LinearStencil *stencil,
+                 HeatGrid *grid, int is_cyclic, UpdateOrder order);
+
+/**
+ * @param region the region
+ * @return the heat of the grid after the last sweep. a row that was updated whole is summed
+ *         again, the heat of any other row is moved by the changes of its updated cells.
+ */
+double activeHeat(const ActiveRegion *region);
+
+#endif //EX3_ACTIVE_H
@@ -0,0 +1,189 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "async_writer.h"
+
+/**
+ * a ring of buffers: the queued grids are the count buffers from head on. the writer thread
+ * keeps a grid in the ring while writing it, so the producer never copies into it.
+ */
+struct AsyncWriter
+{
+    GridWriter *writer;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t freed;
+    HeatGrid **grids;
+    double *values;
+    uint64_t *sweeps;
+    unsigned int buffers;
+    unsigned int head;
+    unsigned int count;
+    int stop;
+};
+
+
+// ____________ functions _______________
+void *writerLoop(void *arg);
+
+void freeBuffers(AsyncWriter *async, unsigned int built);
+
+
+/**
+ * start the writer thread and allocate the buffers
+ * @param writer the writer the grids go to, only the writer thread uses it until
+ *               freeAsyncWriter returns
+ * @param rows number of rows of the grids
+ * @param cols number of cols of the grids
+ * @param buffers number of grids that can wait to be written, at least 1
+ * @return new async writer, NULL if memory allocation or the thread creation went wrong
+ */
+AsyncWriter *createAsyncWriter(GridWriter *writer, size_t rows, size_t cols,
+                               unsigned int buffers)
+{
+    AsyncWriter *async = malloc(sizeof(AsyncWriter));
+    if (!async)
+    {
+        return NULL;
+    }
+    async->writer = writer;
+    async->buffers = buffers < 1 ? 1 : buffers;
+    async->head = 0;
+    async->count = 0;
+    async->stop = 0;
+    async->grids = calloc(async->buffers, sizeof(HeatGrid *));
+    async->values = malloc(async->buffers * sizeof(double));
+    async->sweeps = malloc(async->buffers * sizeof(uint64_t));
+    if (!async->grids || !async->values || !async->sweeps)
+    {
+        freeBuffers(async, 0);
+        return NULL;
+    }
+    for (unsigned int k = 0; k < async->buffers; k++)
+    {
+        async->grids[k] = buildGrid(rows, cols);
+        if (!async->grids[k])
+        {
+            freeBuffers(async, k);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->queued, NULL);
+    pthread_cond_init(&async->freed, NULL);
+    if (pthread_create(&async->thread, NULL, writerLoop, async) != 0)
+    {
+        pthread_cond_destroy(&async->freed);
+        pthread_cond_destroy(&async->queued);
+        pthread_mutex_destroy(&async->lock);
+        freeBuffers(async, async->buffers);
+        return NULL;
+    }
+    return async;
+}
+
+/**
+ * copy the grid into a free buffer and queue it, waits while every buffer is queued.
+ * the grids are written in the order they were submitted.
+ * @param async the async writer
+ * @param grid grid of heat values, of the size the writer was created with
+ * @param value heat value
+ * @param sweeps number of sweeps done so far
+ */
+void submitGrid(AsyncWriter *async, const HeatGrid *grid, double value, uint64_t sweeps)
+{
+    pthread_mutex_lock(&async->lock);
+    while (async->count == async->buffers)
+    {
+        pthread_cond_wait(&async->freed, &async->lock);
+    }
+    unsigned int slot = (async->head + async->count) % async->buffers;
+    pthread_mutex_unlock(&async->lock);
+
+    // the slot is outside the queue, the writer thread doesn't look at it
+    HeatGrid *copy = async->grids[slot];
+    memcpy(copy->data, grid->data, sizeof(double) * grid->rows * grid->stride);
+    async->values[slot] = value;
+    async->sweeps[slot] = sweeps;
+
+    pthread_mutex_lock(&async->lock);
+    async->count++;
+    pthread_cond_signal(&async->queued);
+    pthread_mutex_unlock(&async->lock);
+}
+
+/**
+ * wait until every queued grid was written, stop the thread and free the buffers
+ * @param async the async writer, may be NULL
+ */
+void freeAsyncWriter(AsyncWriter *async)
+{
+    if (!async)
+    {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_signal(&async->queued);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->thread, NULL);
+    pthread_cond_destroy(&async->freed);
+    pthread_cond_destroy(&async->queued);
+    pthread_mutex_destroy(&async->lock);
+    freeBuffers(async, async->buffers);
+}
+
+/**
+ * body of the writer thread, writes the queued grids until it is stopped and the queue is empty
+ * @param arg the AsyncWriter
+ * @return NULL
+ */
+void *writerLoop(void *arg)
+{
+    AsyncWriter *async = arg;
+    while (1)
+    {
+        pthread_mutex_lock(&async->lock);
+        while (async->count == 0 && !async->stop)
+        {
+            pthread_cond_wait(&async->queued, &async->lock);
+        }
+        if (async->count == 0)
+        {
+            pthread_mutex_unlock(&async->lock);
+            return NULL;
+        }
+        unsigned int slot = async->head;
+        pthread_mutex_unlock(&async->lock);
+
+        writeGrid(async->writer, async->grids[slot], async->values[slot], async->sweeps[slot]);
+
+        pthread_mutex_lock(&async->lock);
+        async->head = (async->head + 1) % async->buffers;
+        async->count--;
+        pthread_cond_signal(&async->freed);
+        pthread_mutex_unlock(&async->lock);
+    }
+}
+
+/**
+ * free the buffers and the async writer itself
+ * @param async the async writer
+ * @param built number of grids that were built
+ */
+void freeBuffers(AsyncWriter *async, unsigned int built)
+{
+    for (unsigned int k = 0; k < built; k++)
+    {
+        freeGrid(async->grids[k]);
+    }
+    free(async->grids);
+    free(async->values);
+    free(async->sweeps);
+    free(async);
+}
@@ -0,0 +1,44 @@
+/**
+ * @author Idan Yamin
+ * @brief writes the printed grids on a thread of its own, so the next grid can be calculated
+ * while the previous one is written. the grids are copied into a fixed number of buffers.
+ */
+
+#ifndef EX3_ASYNC_WRITER_H
+#define EX3_ASYNC_WRITER_H
+
+#include <stdint.h>
+#include "grid_writer.h"
+#include "heat_grid.h"
+
+typedef struct AsyncWriter AsyncWriter;
+
+/**
+ * start the writer thread and allocate the buffers
+ * @param writer the writer the grids go to, only the writer thread uses it until
+ *               freeAsyncWriter returns
+ * @param rows number of rows of the grids
+ * @param cols number of cols of the grids
+ * @param buffers number of grids that can wait to be written, at least 1
+ * @return new async writer, NULL if memory allocation or the thread creation went wrong
+ */
+AsyncWriter *createAsyncWriter(GridWriter *writer, size_t rows, size_t cols,
+                               unsigned int buffers);
+
+/**
+ * copy the grid into a free buffer and queue it, waits while every buffer is queued.
+ * the grids are written in the order they were submitted.
+ * @param async the async writer
+ * @param grid grid of heat values, of the size the writer was created with
+ * @param value heat value
+ * @param sweeps number of sweeps done so far
+ */
+void submitGrid(AsyncWriter *async, const HeatGrid *grid, double value, uint64_t sweeps);
+
+/**
+ * wait until every queued grid was written, stop the thread and free the buffers
+ * @param async the async writer, may be NULL
+ */
+void freeAsyncWriter(AsyncWriter *async);
+
+#endif //EX3_ASYNC_WRITER_H
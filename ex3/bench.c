@@ -0,0 +1,500 @@
+/**
+ * @author Idan Yamin
+ * @brief benchmark of the calculator: updateGrid, calcHeat and calculate on synthetic grids from
+ * 64 x 64 up to 16k x 16k with several source densities, cyclic and not, and the time a run
+ * takes to converge. prints one CSV line per measurement, the grids and the sources are the same
+ * on every run, so the results of two commits can be compared with diff.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calculator.h"
+#include "grid_calculator.h"
+#include "heat_eqn.h"
+#include "heat_grid.h"
+
+#define ERROR 1
+#define SUCCESS 0
+// smallest and largest side of the grids, the side grows 4 times at every step
+#define FIRST_SIDE 64
+#define LAST_SIDE 16384
+#define SIDE_STEP 4
+// largest side of the grids a run until convergence is timed on by default
+#define CONVERGE_SIDE 256
+// terminate of the runs until convergence by default
+#define CONVERGE_TERMINATE 1e-3
+// number of cell updates (or cell reads for calcHeat) a measurement is made of, at least
+#define CELLS_PER_RUN ((uint64_t) 1 << 27)
+// a measurement is repeated and the fastest one reported, the others being the noise
+#define REPEATS 3
+// the sources are spread by a fixed seed, every run benchmarks the same grids
+#define SOURCE_SEED 0x9E3779B97F4A7C15ULL
+// largest value of a source, the sources are between -SOURCE_VALUE and SOURCE_VALUE
+#define SOURCE_VALUE 100.0
+// bytes a sweep moves per cell (read and write one value), and calcHeat (read one value)
+#define SWEEP_BYTES 16.0
+#define HEAT_BYTES 8.0
+#define NANOSECONDS 1e9
+#define GIGABYTE 1e9
+
+// fractions of the cells of a grid that are sources
+const double DENSITIES[] = {0.0001, 0.001, 0.01};
+const char SIDE_FLAG[] = "-s";
+const char CONVERGE_FLAG[] = "-v";
+const char TERMINATE_FLAG[] = "-e";
+const char SOLVER_FLAG[] = "-m";
+const char RELAX_SOLVER[] = "relax";
+const char VCYCLE_SOLVER[] = "vcycle";
+const char SOR_SOLVER[] = "sor";
+const char USAGE_ERR[] = "Usage: bench [-s largest side] [-v largest converged side] "
+                         "[-e terminate] [-m relax|vcycle|sor]\n";
+const char MEM_ERR[] = "Memory allocation error\n";
+const char HEADER[] = "kernel,rows,cols,density,cyclic,sources,sweeps,seconds,cells_per_sec,"
+                      "gb_per_sec,heat\n";
+const char LINE[] = "%s,%zu,%zu,%g,%d,%zu,%llu,%.6f,%.4e,%.3f,%.10e\n";
+
+/**
+ * one configuration of the benchmark: a grid with its sources
+ */
+typedef struct Bench
+{
+    size_t side;
+    double density;
+    int is_cyclic;
+    source_point *sources;
+    size_t numOfSources;
+} Bench;
+
+
+// ____________ functions _______________
+int parseSide(const char *arg, size_t *side);
+
+int parseSolver(const char *arg, Solver *solver);
+
+int runBench(Bench *bench, size_t convergeSide, double terminate, Solver solver);
+
+source_point *spreadSources(size_t side, double density, size_t *numOfSources);
+
+HeatGrid *benchGrid(const Bench *bench);
+
+int benchUpdate(const Bench *bench);
+
+int benchHeat(const Bench *bench);
+
+int benchCalculate(const Bench *bench);
+
+int benchConverge(const Bench *bench, double terminate, Solver solver);
+
+double **rowGrid(const Bench *bench);
+
+void freeRowGrid(double **rows, size_t n);
+
+unsigned int sweepsPerRun(size_t side);
+
+double now(void);
+
+void printLine(const char *kernel, const Bench *bench, unsigned long long sweeps, double seconds,
+               double bytesPerCell, double heat);
+
+
+int main(int argc, char *argv[])
+{
+    size_t lastSide = LAST_SIDE, convergeSide = CONVERGE_SIDE;
+    double terminate = CONVERGE_TERMINATE;
+    Solver solver = SOLVER_RELAX;
+    for (int i = 1; i < argc; i++)
+    {
+        int failed = i + 1 >= argc;
+        if (!failed && strcmp(argv[i], SIDE_FLAG) == 0)
+        {
+            failed = parseSide(argv[++i], &lastSide);
+        }
+        else if (!failed && strcmp(argv[i], CONVERGE_FLAG) == 0)
+        {
+            failed = parseSide(argv[++i], &convergeSide);
+        }
+        else if (!failed && strcmp(argv[i], TERMINATE_FLAG) == 0)
+        {
+            char *end;
+            terminate = strtod(argv[++i], &end);
+            failed = *end != '\0' || !(terminate > 0);
+        }
+        else if (!failed && strcmp(argv[i], SOLVER_FLAG) == 0)
+        {
+            failed = parseSolver(argv[++i], &solver);
+        }
+        else
+        {
+            failed = 1;
+        }
+        if (failed)
+        {
+            fprintf(stderr, USAGE_ERR);
+            return ERROR;
+        }
+    }
+
+    printf(HEADER);
+    for (size_t side = FIRST_SIDE; side <= lastSide; side *= SIDE_STEP)
+    {
+        for (size_t k = 0; k < sizeof(DENSITIES) / sizeof(DENSITIES[0]); k++)
+        {
+            for (int is_cyclic = 0; is_cyclic <= 1; is_cyclic++)
+            {
+                Bench bench = {side, DENSITIES[k], is_cyclic, NULL, 0};
+                if (runBench(&bench, convergeSide, terminate, solver) == ERROR)
+                {
+                    fprintf(stderr, MEM_ERR);
+                    return ERROR;
+                }
+                fflush(stdout);
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @param arg a command line argument
+ * @param side put the value here
+ * @return 0 if arg is a positive integer, 1 otherwise
+ */
+int parseSide(const char *arg, size_t *side)
+{
+    char *end;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (*end != '\0' || arg[0] == '-' || value == 0 || value > SIZE_MAX)
+    {
+        return ERROR;
+    }
+    *side = (size_t) value;
+    return SUCCESS;
+}
+
+/**
+ * @param arg a command line argument
+ * @param solver put the solver it names here
+ * @return 0 if arg names a solver, 1 otherwise
+ */
+int parseSolver(const char *arg, Solver *solver)
+{
+    if (strcmp(arg, RELAX_SOLVER) == 0)
+    {
+        *solver = SOLVER_RELAX;
+    }
+    else if (strcmp(arg, VCYCLE_SOLVER) == 0)
+    {
+        *solver = SOLVER_MULTIGRID;
+    }
+    else if (strcmp(arg, SOR_SOLVER) == 0)
+    {
+        *solver = SOLVER_SOR;
+    }
+    else
+    {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * run every measurement of one configuration
+ * @param bench the configuration, its sources are spread here and freed at the end
+ * @param convergeSide largest side a run until convergence is timed on
+ * @param terminate terminate of the run until convergence
+ * @param solver solver of the run until convergence
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int runBench(Bench *bench, size_t convergeSide, double terminate, Solver solver)
+{
+    bench->sources = spreadSources(bench->side, bench->density, &bench->numOfSources);
+    if (!bench->sources)
+    {
+        return ERROR;
+    }
+    int result = SUCCESS;
+    if (benchUpdate(bench) == ERROR || benchHeat(bench) == ERROR ||
+        benchCalculate(bench) == ERROR ||
+        (bench->side <= convergeSide && benchConverge(bench, terminate, solver) == ERROR))
+    {
+        result = ERROR;
+    }
+    free(bench->sources);
+    bench->sources = NULL;
+    return result;
+}
+
+/**
+ * spread sources over a side x side grid by a fixed seed, at least one
+ * @param side rows and cols of the grid
+ * @param density fraction of the cells that are sources
+ * @param numOfSources put the number of sources here
+ * @return the sources, NULL if memory allocation went wrong
+ */
+source_point *spreadSources(size_t side, double density, size_t *numOfSources)
+{
+    size_t count = (size_t) ((double) side * (double) side * density);
+    count = count ? count : 1;
+    source_point *sources = malloc(sizeof(source_point) * count);
+    if (!sources)
+    {
+        return NULL;
+    }
+    // xorshift64, the same sequence on every machine
+    uint64_t state = SOURCE_SEED;
+    for (size_t k = 0; k < count; k++)
+    {
+        uint64_t draws[3];
+        for (int d = 0; d < 3; d++)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            draws[d] = state;
+        }
+        sources[k].x = (int) (draws[0] % side);
+        sources[k].y = (int) (draws[1] % side);
+        sources[k].value = SOURCE_VALUE * ((double) (draws[2] >> 11) / (double) (1ULL << 52) - 1);
+    }
+    *numOfSources = count;
+    return sources;
+}
+
+/**
+ * @param bench the configuration
+ * @return a grid of the configuration with its sources on it and pinned, NULL if memory
+ *         allocation went wrong
+ */
+HeatGrid *benchGrid(const Bench *bench)
+{
+    HeatGrid *grid = buildGrid(bench->side, bench->side);
+    if (!grid)
+    {
+        return NULL;
+    }
+    for (size_t k = 0; k < bench->numOfSources; k++)
+    {
+        GRID_AT(grid, bench->sources[k].x, bench->sources[k].y) = bench->sources[k].value;
+    }
+    if (pinSources(grid, bench->sources, bench->numOfSources))
+    {
+        freeGrid(grid);
+        return NULL;
+    }
+    return grid;
+}
+
+/**
+ * time updateGrid, every repeat sweeps a new grid
+ * @param bench the configuration
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int benchUpdate(const Bench *bench)
+{
+    unsigned int sweeps = sweepsPerRun(bench->side);
+    double best = -1, heat = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        HeatGrid *grid = benchGrid(bench);
+        if (!grid)
+        {
+            return ERROR;
+        }
+        double start = now();
+        for (unsigned int s = 0; s < sweeps; s++)
+        {
+            updateGrid(heat_eqn, grid, bench->is_cyclic);
+        }
+        double seconds = now() - start;
+        best = best < 0 || seconds < best ? seconds : best;
+        heat = calcHeat(grid);
+        freeGrid(grid);
+    }
+    printLine("updateGrid", bench, sweeps, best, SWEEP_BYTES, heat);
+    return SUCCESS;
+}
+
+/**
+ * time calcHeat, as many times over the grid as updateGrid sweeps it
+ * @param bench the configuration
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int benchHeat(const Bench *bench)
+{
+    HeatGrid *grid = benchGrid(bench);
+    if (!grid)
+    {
+        return ERROR;
+    }
+    unsigned int passes = sweepsPerRun(bench->side);
+    double best = -1, heat = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        double start = now();
+        for (unsigned int s = 0; s < passes; s++)
+        {
+            heat = calcHeat(grid);
+        }
+        double seconds = now() - start;
+        best = best < 0 || seconds < best ? seconds : best;
+    }
+    freeGrid(grid);
+    printLine("calcHeat", bench, passes, best, HEAT_BYTES, heat);
+    return SUCCESS;
+}
+
+/**
+ * time calculate for a fixed number of sweeps, copying the grid in and out included
+ * @param bench the configuration
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int benchCalculate(const Bench *bench)
+{
+    unsigned int sweeps = sweepsPerRun(bench->side);
+    double best = -1, heat = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        double **rows = rowGrid(bench);
+        if (!rows)
+        {
+            return ERROR;
+        }
+        double start = now();
+        double diff = calculate(heat_eqn, rows, bench->side, bench->side, bench->sources,
+                                bench->numOfSources, 0, sweeps, bench->is_cyclic);
+        double seconds = now() - start;
+        best = best < 0 || seconds < best ? seconds : best;
+        heat = 0;
+        for (size_t i = 0; i < bench->side; i++)
+        {
+            for (size_t j = 0; j < bench->side; j++)
+            {
+                heat += rows[i][j];
+            }
+        }
+        freeRowGrid(rows, bench->side);
+        if (diff == -1)
+        {
+            return ERROR;
+        }
+    }
+    printLine("calculate", bench, sweeps, best, SWEEP_BYTES, heat);
+    return SUCCESS;
+}
+
+/**
+ * time a run until the difference is below terminate, with the sweeps it took
+ * @param bench the configuration
+ * @param terminate terminate of the run
+ * @param solver solver of the run
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int benchConverge(const Bench *bench, double terminate, Solver solver)
+{
+    CalcOptions options = DEFAULT_CALC_OPTIONS;
+    options.solver = solver;
+    HeatGrid *grid = benchGrid(bench);
+    Calculator *calc = createCalculator(&options);
+    if (!grid || !calc)
+    {
+        freeGrid(grid);
+        freeCalculator(calc);
+        return ERROR;
+    }
+    double start = now();
+    double diff = calculateGrid(calc, heat_eqn, grid, terminate, 0, bench->is_cyclic);
+    double seconds = now() - start;
+    unsigned int sweeps = calculatorSweeps(calc);
+    double heat = calcHeat(grid);
+    freeCalculator(calc);
+    freeGrid(grid);
+    if (diff == -1)
+    {
+        return ERROR;
+    }
+    printLine("converge", bench, sweeps, seconds, SWEEP_BYTES, heat);
+    return SUCCESS;
+}
+
+/**
+ * @param bench the configuration
+ * @return the grid of the configuration with its sources on it as an array of rows, the way
+ *         calculate takes it, NULL if memory allocation went wrong
+ */
+double **rowGrid(const Bench *bench)
+{
+    double **rows = malloc(sizeof(double *) * bench->side);
+    if (!rows)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < bench->side; i++)
+    {
+        rows[i] = calloc(bench->side, sizeof(double));
+        if (!rows[i])
+        {
+            freeRowGrid(rows, i);
+            return NULL;
+        }
+    }
+    for (size_t k = 0; k < bench->numOfSources; k++)
+    {
+        rows[bench->sources[k].x][bench->sources[k].y] = bench->sources[k].value;
+    }
+    return rows;
+}
+
+/**
+ * @param rows array of rows
+ * @param n number of rows
+ */
+void freeRowGrid(double **rows, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        free(rows[i]);
+    }
+    free(rows);
+}
+
+/**
+ * @param side rows and cols of the grid
+ * @return number of sweeps of a measurement, about CELLS_PER_RUN cell updates and at least one
+ */
+unsigned int sweepsPerRun(size_t side)
+{
+    uint64_t cells = (uint64_t) side * side;
+    return cells >= CELLS_PER_RUN ? 1 : (unsigned int) (CELLS_PER_RUN / cells);
+}
+
+/**
+ * @return seconds of a monotonic clock
+ */
+double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / NANOSECONDS;
+}
+
+/**
+ * print one measurement as a CSV line
+ * @param kernel name of the measured function
+ * @param bench the configuration
+ * @param sweeps number of passes over the grid the measurement made
+ * @param seconds time of the measurement
+ * @param bytesPerCell bytes a pass moves per cell
+ * @param heat the heat of the grid after the measurement, the same on every run of a commit
+ */
+void printLine(const char *kernel, const Bench *bench, unsigned long long sweeps, double seconds,
+               double bytesPerCell, double heat)
+{
+    double cells = (double) bench->side * (double) bench->side * (double) sweeps;
+    double cellsPerSecond = seconds > 0 ? cells / seconds : 0;
+    printf(LINE, kernel, bench->side, bench->side, bench->density, bench->is_cyclic,
+           bench->numOfSources, sweeps, seconds, cellsPerSecond,
+           cellsPerSecond * bytesPerCell / GIGABYTE, heat);
+}
@@ -2,244 +2,1698 @@
  * @author Idan Yamin
  */
 
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "active.h"
 #include "calculator.h"
+#include "float_grid.h"
+#include "grid_calculator.h"
+#include "kernels.h"
+#include "multigrid.h"
+#include "process_group.h"
+#include "sweep.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#define PI 3.14159265358979323846
+// least number of sweeps the convergence rate of a SOR run is measured over
+#define SOR_WINDOW 16
+// bytes of the rows of a stripe a mapped grid is swept in
+#define STRIPE_BYTES ((size_t) 64 << 20)
+
+/**
+ * calculator state kept between calls, the thread pool, the band edge buffers, the heat of
+ * every row, the number of sweeps of the last call, the sweep hook and the trace.
+ * group is the process group forked for the shared grid of serial groupSerial, when it had a
+ * spare buffer if groupSpare, with room for groupPins pinned cells.
+ * relaxation is the state the last call ended with when relaxed is set, start the state the
+ * next SOR call starts from when hasStart is set.
+ */
+struct Calculator
+{
+    CalcOptions options;
+    ThreadPool *pool;
+    ProcessGroup *group;
+    unsigned long groupSerial;
+    int groupSpare;
+    size_t groupPins;
+    double *edges;
+    size_t edgesSize;
+    double *rowSums;
+    size_t rowSumsSize;
+    unsigned int sweeps;
+    sweep_hook hook;
+    void *hookArg;
+    Trace *trace;
+    int relaxed;
+    Relaxation relaxation;
+    int hasStart;
+    Relaxation start;
+};
+
+/**
+ * over-relaxation of the sweeps of a SOR call (see Relaxation). the sweeps use stencil, the
+ * registered stencil of the update function with weights moved to omega, which never goes above
+ * limit. refDiff was measured after sweep refSweep of the call, which is negative when the call
+ * continues a cut one. worth is the Gauss-Seidel sweeps of the sweeps before sweep worthSweep.
+ */
+typedef struct Sor
+{
+    StencilWeights weights;
+    LinearStencil stencil;
+    double omega;
+    double limit;
+    int settled;
+    double refDiff;
+    long long refSweep;
+    double worth;
+    long long worthSweep;
+} Sor;
+
+/**
+ * convergence bookkeeping of one calculateGrid call.
+ * the heat of the grid is only measured after the sweeps whose difference is looked at:
+ * the last two sweeps for n_iter > 0, otherwise every checkEvery-th sweep and the one before it.
+ * nested is 1 for the smoothing sweeps of a multigrid cycle, they don't call the sweep hook.
+ * relaxed is 1 for a SOR call, sor is its over-relaxation.
+ * trace is the trace of the calculator, NULL for none, for nested sweeps and for the threads of
+ * the pool but the first.
+ */
+typedef struct Progress
+{
+    double terminate;
+    unsigned int n_iter;
+    unsigned int checkEvery;
+    int nested;
+    unsigned int sweeps;
+    unsigned int heatSweep;
+    int hasHeat;
+    int hasDiff;
+    double heat;
+    double diff;
+    int relaxed;
+    Sor sor;
+    Trace *trace;
+} Progress;
+
+/**
+ * one calculateGrid call shared by the threads of the pool, or by the processes of a group.
+ * edges and rowSums are the band edge copies and the row sums, grid the grid the bands update.
+ */
+typedef struct BandJob
+{
+    Calculator *calc;
+    diff_func function;
+    HeatGrid *grid;
+    int is_cyclic;
+    unsigned int bands;
+    Progress progress;
+    double *edges;
+    double *rowSums;
+    ProcessGroup *group;
+} BandJob;
+
+/**
+ * one calculateProcesses call in the memory of its process group. grid is the grid the processes
+ * sweep, with the buffers of the shared grid and copies of its pinned cells and ghost row, which
+ * the workers only see as they were when they were forked. values holds the band edge copies,
+ * the row sums, the ghost row and the pinned cells.
+ */
+typedef struct GroupCall
+{
+    BandJob job;
+    HeatGrid grid;
+    double values[];
+} GroupCall;
 
 
 // ____________ functions _______________
-int isSource(size_t row, size_t col, const source_point *source,
-             size_t num_sources);
+double relax(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+             int is_cyclic);
+
+double calculateMultigrid(Calculator *calc, diff_func function, HeatGrid *grid,
+                          Progress *progress, int is_cyclic, const LinearStencil *stencil);
+
+double smoothGrid(Calculator *calc, diff_func function, HeatGrid *grid, unsigned int sweeps,
+                  int is_cyclic);
+
+int relaxationSupports(const StencilWeights *weights);
+
+void startRelaxation(Calculator *calc, Progress *progress, const HeatGrid *grid, int is_cyclic,
+                     const LinearStencil *stencil);
+
+double gridOmega(const HeatGrid *grid, int is_cyclic, const StencilWeights *weights);
+
+double dimensionCosine(size_t n, int is_cyclic);
+
+void setOmega(Sor *sor, double omega);
+
+void adaptRelaxation(Progress *progress);
+
+Relaxation relaxationOf(const Progress *progress);
+
+const LinearStencil *sweepStencil(const Progress *progress, diff_func function);
+
+const LinearStencil *floatStencil(const Progress *progress, diff_func function);
 
-double calcHeat(double **grid, size_t n, size_t m);
+double calculateSerial(Calculator *calc, diff_func function, HeatGrid *grid,
+                       Progress *progress, int is_cyclic);
 
-void updateGrid(diff_func function, double **grid, size_t n, size_t m,
-                const source_point *sources, size_t num_sources, int is_cyclic);
+double calculateActive(Calculator *calc, diff_func function, HeatGrid *grid,
+                       Progress *progress, int is_cyclic);
 
-double getLeft(size_t row, size_t col, double **grid, size_t m, int is_cyclic);
+double calculateFloat(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+                      int is_cyclic);
 
-double getRight(size_t row, size_t col, double **grid, size_t m, int is_cyclic);
+void sweepFloat(FloatGrid *floats, const StencilWeights *weights, int is_cyclic,
+                UpdateOrder order, double *rowSums);
 
-double getBottom(size_t row, size_t col, double **grid, size_t n, int is_cyclic);
+int floatFinished(const Calculator *calc, const Progress *progress);
 
-double getTop(size_t row, size_t col, double **grid, size_t n, int is_cyclic);
+void sweepSerial(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                 int is_cyclic, UpdateOrder order, double *rowSums);
+
+void sweepStripes(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                  int is_cyclic, UpdateOrder order, int colour, double *rowSums);
+
+void prefetchRows(const HeatGrid *grid, const double *buffer, size_t lo, size_t hi);
+
+double calculateTiled(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress);
+
+unsigned int tileSweeps(const Progress *progress, unsigned int depth);
+
+void sweepTile(diff_func function, HeatGrid *grid, UpdateOrder order, const Progress *progress,
+               unsigned int depth, double *rowSums);
+
+void updateTileRow(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                   UpdateOrder order, size_t row, unsigned int pass, double *rowSums);
+
+void updateGridColour(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                      int is_cyclic, int colour, double *rowSums);
+
+double calculateBands(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+                      int is_cyclic);
+
+double calculateProcesses(Calculator *calc, diff_func function, HeatGrid *grid,
+                          Progress *progress, int is_cyclic);
+
+void bandTask(void *arg, unsigned int index, unsigned int count);
+
+int prepareGroup(Calculator *calc, const HeatGrid *grid);
+
+int bandSync(const BandJob *job);
+
+int banded(const Calculator *calc);
+
+void startProgress(Progress *progress, double terminate, unsigned int n_iter,
+                   unsigned int checkEvery);
+
+int heatNeeded(const Progress *progress, unsigned int sweep);
+
+void recordHeat(Progress *progress, double heat);
+
+int finished(const Progress *progress);
+
+int hookDue(const Calculator *calc, const Progress *progress);
+
+void callHook(const Calculator *calc, const HeatGrid *grid, const Progress *progress);
+
+void traceProgress(const Progress *progress);
+
+double sumOfRowSums(const double *rowSums, size_t n);
+
+int reserve(double **buffer, size_t *size, size_t needed);
+
+double absDiff(double currSum, double prevSum);
 
 
 /**
 * Calculator function. Applies the given function to every point in the grid iteratively for n_iter loops, or until the cumulative difference is below terminate (if n_iter is 0).
+* Copies the row-pointer grid into a HeatGrid, runs calculateGrid on it and copies the values back.
+* Sources outside the grid are skipped, no cell of the grid is theirs.
+* returns -1 if memory allocation went wrong.
 */
 double calculate(diff_func function, double **grid, size_t n, size_t m, source_point *sources,
                  size_t num_sources, double terminate, unsigned int n_iter, int is_cyclic)
 {
-    double diff = 0;
-    // if iter > 0 than run until n_iter
-    if (n_iter > 0)
+    HeatGrid *heatGrid = buildGrid(n, m);
+    // one extra source keeps malloc(0) from looking like a failure
+    source_point *inside = malloc(sizeof(source_point) * (num_sources + 1));
+    if (!heatGrid || !inside)
+    {
+        freeGrid(heatGrid);
+        free(inside);
+        return -1;
+    }
+    size_t numInside = 0;
+    for (size_t k = 0; k < num_sources; k++)
     {
-        for (unsigned int i = 0; i < n_iter; i++)
+        if (sources[k].x >= 0 && (size_t) sources[k].x < n && sources[k].y >= 0 &&
+            (size_t) sources[k].y < m)
         {
-            double prevSum = calcHeat(grid, n, m);
-            updateGrid(function, grid, n, m, sources, num_sources, is_cyclic);
-            double currSum = calcHeat(grid, n, m);
-            diff = currSum - prevSum;
-            if (diff < 0)
-            {
-                diff *= -1;
-            }
+            inside[numInside++] = sources[k];
         }
     }
-    else
+    int failed = pinSources(heatGrid, inside, numInside);
+    free(inside);
+    if (failed)
+    {
+        freeGrid(heatGrid);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < m; j++)
+        {
+            GRID_AT(heatGrid, i, j) = grid[i][j];
+        }
+    }
+    double diff = calculateGrid(NULL, function, heatGrid, terminate, n_iter, is_cyclic);
+    for (size_t i = 0; i < n; i++)
     {
-        // run until diff < terminate
-        do
+        for (size_t j = 0; j < m; j++)
         {
-            double prevSum = calcHeat(grid, n, m);
-            updateGrid(function, grid, n, m, sources, num_sources, is_cyclic);
-            double currSum = calcHeat(grid, n, m);
-            diff = currSum - prevSum;
-            if (diff < 0)
-            {
-                diff *= -1;
-            }
-        } while (diff >= terminate);
+            grid[i][j] = GRID_AT(heatGrid, i, j);
+        }
     }
+    freeGrid(heatGrid);
     return diff;
 }
 
 /**
- * calculate the sum of the heat
- * @param grid of heat
- * @param n num of rows
- * @param m num columns
- * @return the sum of the values of the grid
+ * create a calculator, starts the thread pool when more than one thread is asked for
+ * @param options the options, NULL for the defaults
+ * @return new calculator, NULL if memory allocation went wrong
  */
-double calcHeat(double **grid, const size_t n, const size_t m)
+Calculator *createCalculator(const CalcOptions *options)
 {
-    double sum = 0;
-    for (size_t i = 0; i < n; i++)
+    Calculator *calc = malloc(sizeof(Calculator));
+    if (!calc)
     {
-        for (size_t j = 0; j < m; j++)
+        return NULL;
+    }
+    CalcOptions defaults = DEFAULT_CALC_OPTIONS;
+    calc->options = options ? *options : defaults;
+    if (calc->options.checkEvery == 0)
+    {
+        calc->options.checkEvery = 1;
+    }
+    if (calc->options.tileDepth == 0)
+    {
+        calc->options.tileDepth = 1;
+    }
+    if (calc->options.processes == 0)
+    {
+        calc->options.processes = 1;
+    }
+    calc->pool = NULL;
+    calc->group = NULL;
+    calc->groupSerial = 0;
+    calc->groupSpare = 0;
+    calc->groupPins = 0;
+    calc->edges = NULL;
+    calc->edgesSize = 0;
+    calc->rowSums = NULL;
+    calc->rowSumsSize = 0;
+    calc->sweeps = 0;
+    calc->hook = NULL;
+    calc->hookArg = NULL;
+    calc->trace = NULL;
+    calc->relaxed = 0;
+    calc->hasStart = 0;
+    if (calc->options.threads > 1)
+    {
+        calc->pool = createPool(calc->options.threads);
+        if (!calc->pool)
         {
-            sum += *(*(grid + i) + j);
+            freeCalculator(calc);
+            return NULL;
         }
     }
-    return sum;
+    return calc;
 }
 
 /**
- * @param row coordinate of grid.
- * @param col coordinate of grid.
- * @param source a pointer to an array of all sources.
- * @param num_sources the num of sources.
- * @return 1 if flag is source, 0 if flag isn't source.
+ * free a calculator and stop its threads and worker processes
+ * @param calc the calculator, may be NULL
  */
-int isSource(const size_t row, const size_t col, const source_point *source,
-             const size_t num_sources)
+void freeCalculator(Calculator *calc)
 {
-    int flag = 0;
-    for (size_t i = 0; i < num_sources; i++)
+    if (!calc)
     {
-        // if the source fits the given coordinates
-        if ((size_t)(source + i)->x == row && (size_t)(source + i)->y == col)
-        {
-            flag = 1;
-            break;
-        }
+        return;
     }
-    return flag;
+    freePool(calc->pool);
+    freeProcessGroup(calc->group);
+    free(calc->edges);
+    free(calc->rowSums);
+    free(calc);
 }
 
 /**
- * calculate the new grid
- * @param function the given function
+ * set the function called between sweeps (see sweep_hook)
+ * @param calc the calculator
+ * @param hook the function, NULL for none
+ * @param arg argument given to the function
+ */
+void setSweepHook(Calculator *calc, sweep_hook hook, void *arg)
+{
+    calc->hook = hook;
+    calc->hookArg = arg;
+}
+
+/**
+ * record the sweeps of the next calls to a trace (see trace.h): every sweep is timed, the
+ * intervals go to the trace file as they end. without a trace nothing is timed.
+ * @param calc the calculator
+ * @param trace the trace, NULL for none. it must outlive the calls
+ */
+void setTrace(Calculator *calc, Trace *trace)
+{
+    calc->trace = trace;
+}
+
+/**
+ * make the next calculateGrid call of a SOR run continue from the given state instead of
+ * starting from the omega of the grid size, the way the cut call would have gone on
+ * @param calc the calculator
+ * @param relaxation state given to the sweep hook, NULL to start over
+ */
+void setRelaxation(Calculator *calc, const Relaxation *relaxation)
+{
+    calc->hasStart = relaxation != NULL;
+    if (relaxation)
+    {
+        calc->start = *relaxation;
+    }
+}
+
+/**
+ * Calculator function. Applies the given function to every point in the grid iteratively for
+ * n_iter loops, or until the cumulative difference is below terminate (if n_iter is 0).
+ * pinned cells of the grid are never updated.
+ * @param calc the calculator, NULL to run once with the default options
+ * @param function the update function
  * @param grid grid of values
- * @param n number of rows
- * @param m number of columns
- * @param sources the sources of heat
- * @param num_sources the number of sources
+ * @param terminate terminate threshold
+ * @param n_iter number of iterations, 0 to run until the difference is below terminate
  * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the difference of the last iteration, -1 if memory allocation went wrong or a worker
+ *         process died
  */
-void updateGrid(const diff_func function, double **grid, const size_t n, const size_t m,
-                const source_point *sources, const size_t num_sources, const int is_cyclic)
+double calculateGrid(Calculator *calc, diff_func function, HeatGrid *grid, double terminate,
+                     unsigned int n_iter, int is_cyclic)
 {
-    for (size_t i = 0; i < n; i++)
+    if (!calc)
     {
-        for (size_t j = 0; j < m; j++)
+        Calculator *temporary = createCalculator(NULL);
+        if (!temporary)
         {
-            if (!isSource(i, j, sources, num_sources))
-            {
-                double left = getLeft(i, j, grid, m, is_cyclic);
-                double right = getRight(i, j, grid, m, is_cyclic);
-                double bottom = getBottom(i, j, grid, n, is_cyclic);
-                double top = getTop(i, j, grid, n, is_cyclic);
-                grid[i][j] = function(grid[i][j], right, top, left, bottom);
-            }
+            return -1;
+        }
+        double diff = calculateGrid(temporary, function, grid, terminate, n_iter, is_cyclic);
+        freeCalculator(temporary);
+        return diff;
+    }
+    if (calc->options.order == ORDER_JACOBI && prepareSpare(grid))
+    {
+        return -1;
+    }
+    if (!is_cyclic && prepareGhost(grid))
+    {
+        return -1;
+    }
+    // a tile measures the heat of its last two sweeps, one row sums array for each
+    if (reserve(&calc->rowSums, &calc->rowSumsSize, 2 * grid->rows))
+    {
+        return -1;
+    }
+    Progress progress;
+    startProgress(&progress, terminate, n_iter, calc->options.checkEvery);
+    progress.trace = calc->trace;
+    traceCall(progress.trace, grid->rows * grid->cols);
+    // the solvers only need the weights, a function that rounds its sums differently still has them
+    const LinearStencil *stencil = findLinearStencil(function);
+    Solver solver = n_iter == 0 && stencil ? calc->options.solver : SOLVER_RELAX;
+    double diff;
+    // the coarse grids of the hierarchy only know zero edges
+    int zeroEdges = is_cyclic || (grid->edges == EDGE_DIRICHLET && grid->edgeValue == 0);
+    if (solver == SOLVER_MULTIGRID && multigridSupports(&stencil->weights) && zeroEdges)
+    {
+        diff = calculateMultigrid(calc, function, grid, &progress, is_cyclic, stencil);
+    }
+    else
+    {
+        // the bands of a raster sweep read the edge rows of the sweep before, the ordering SOR
+        // converges with needs the rows above updated first
+        if (solver == SOLVER_SOR && relaxationSupports(&stencil->weights) &&
+            (calc->options.order == ORDER_RED_BLACK ||
+             (calc->options.order == ORDER_RASTER && !banded(calc))))
+        {
+            startRelaxation(calc, &progress, grid, is_cyclic, stencil);
         }
+        diff = relax(calc, function, grid, &progress, is_cyclic);
+    }
+    traceEnd(progress.trace);
+    calc->sweeps = progress.sweeps;
+    calc->relaxed = progress.relaxed;
+    if (progress.relaxed)
+    {
+        calc->relaxation = relaxationOf(&progress);
     }
+    calc->hasStart = 0;
+    return diff;
+}
+
+/**
+ * run sweeps until the progress is finished, on worker processes, on the pool, on a float copy,
+ * over the active region, in tiles or one by one. a mapped grid is always swept one by one, in
+ * stripes.
+ * @return the difference of the last iteration, -1 if memory allocation went wrong or a worker
+ *         process died
+ */
+double relax(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+             int is_cyclic)
+{
+    if (gridOnDisk(grid))
+    {
+        return calculateSerial(calc, function, grid, progress, is_cyclic);
+    }
+    // worker processes only see the buffers of a shared grid
+    if (calc->options.processes > 1 && grid->serial && grid->rows > 1 && !progress->nested)
+    {
+        return calculateProcesses(calc, function, grid, progress, is_cyclic);
+    }
+    if (calc->pool && grid->rows > 1)
+    {
+        return calculateBands(calc, function, grid, progress, is_cyclic);
+    }
+    if (calc->options.precision != PRECISION_DOUBLE && !progress->nested &&
+        floatStencil(progress, function))
+    {
+        return calculateFloat(calc, function, grid, progress, is_cyclic);
+    }
+    if (calc->options.activeThreshold >= 0 && calc->options.order != ORDER_JACOBI &&
+        !progress->nested)
+    {
+        return calculateActive(calc, function, grid, progress, is_cyclic);
+    }
+    if (calc->options.tileDepth > 1 && !is_cyclic)
+    {
+        return calculateTiled(calc, function, grid, progress);
+    }
+    return calculateSerial(calc, function, grid, progress, is_cyclic);
 }
 
 /**
- *
- * @param row in the grid
- * @param col int rhe grid
- * @param grid heat grid
- * @param m rows
- * @param is_cyclic is grid cyclic or not
- * @return the left value to the given coordinates
+ * calculateGrid until convergence by multigrid V-cycles: every cycle is MULTIGRID_PRE_SWEEPS
+ * regular sweeps, the coarse grid correction of the stencil and MULTIGRID_POST_SWEEPS regular
+ * sweeps. the run stops when the difference of the last sweep of a cycle is below terminate,
+ * the same test a plain run makes after every sweep. the sweep hook is called between cycles.
+ * @return the difference of the last iteration, -1 if memory allocation went wrong
  */
-double getLeft(const size_t row, size_t col, double **grid,
-               const size_t m, const int is_cyclic)
+double calculateMultigrid(Calculator *calc, diff_func function, HeatGrid *grid,
+                          Progress *progress, int is_cyclic, const LinearStencil *stencil)
 {
-    if (col == 0)
+    Multigrid *multigrid = createMultigrid(grid, is_cyclic, &stencil->weights);
+    if (!multigrid)
+    {
+        return -1;
+    }
+    traceMark(progress->trace, TRACE_OTHER);
+    while (1)
     {
-        if (!is_cyclic)
+        double diff = smoothGrid(calc, function, grid, MULTIGRID_PRE_SWEEPS, is_cyclic);
+        if (diff != -1)
+        {
+            multigridCorrect(multigrid, grid);
+            diff = smoothGrid(calc, function, grid, MULTIGRID_POST_SWEEPS, is_cyclic);
+        }
+        if (diff == -1)
+        {
+            freeMultigrid(multigrid);
+            return -1;
+        }
+        progress->sweeps += MULTIGRID_PRE_SWEEPS + MULTIGRID_POST_SWEEPS;
+        progress->diff = diff;
+        progress->hasDiff = 1;
+        // the heat of the smoothing sweeps is part of the cycle
+        traceMark(progress->trace, TRACE_SWEEP);
+        if (!(diff >= progress->terminate))
         {
-            return 0;
+            traceProgress(progress);
+            break;
+        }
+        if (calc->hook)
+        {
+            calc->hook(calc->hookArg, grid, progress->sweeps, diff, NULL);
         }
-        col = m - 1;
+        traceProgress(progress);
     }
-    else
+    freeMultigrid(multigrid);
+    return progress->diff;
+}
+
+/**
+ * regular sweeps inside a multigrid cycle
+ * @param calc the calculator
+ * @param function the update function
+ * @param grid grid of values
+ * @param sweeps number of sweeps
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the difference of the last sweep, -1 if memory allocation went wrong
+ */
+double smoothGrid(Calculator *calc, diff_func function, HeatGrid *grid, unsigned int sweeps,
+                  int is_cyclic)
+{
+    Progress smoothing;
+    startProgress(&smoothing, 0, sweeps, 1);
+    smoothing.nested = 1;
+    return relax(calc, function, grid, &smoothing, is_cyclic);
+}
+
+/**
+ * @param weights weights of a stencil
+ * @return 1 if its sweeps can be over-relaxed (a positive neighbour weight and 1 - center at
+ *         least 4 * neighbour), 0 otherwise
+ */
+int relaxationSupports(const StencilWeights *weights)
+{
+    return weights->neighbour > 0 && 1 - weights->center >= 4 * weights->neighbour;
+}
+
+/**
+ * make a call a SOR call, from the state given to setRelaxation or from Gauss-Seidel sweeps
+ * @param calc the calculator
+ * @param progress the progress of the call
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param stencil the registered stencil of the update function
+ */
+void startRelaxation(Calculator *calc, Progress *progress, const HeatGrid *grid, int is_cyclic,
+                     const LinearStencil *stencil)
+{
+    Sor *sor = &progress->sor;
+    progress->relaxed = 1;
+    sor->weights = stencil->weights;
+    sor->stencil.function = stencil->function;
+    sor->limit = gridOmega(grid, is_cyclic, &stencil->weights);
+    sor->settled = 0;
+    sor->refDiff = 0;
+    sor->refSweep = 0;
+    sor->worth = 0;
+    sor->worthSweep = 0;
+    double omega = 1;
+    if (calc->hasStart)
+    {
+        omega = calc->start.omega;
+        sor->settled = calc->start.settled;
+        sor->refDiff = calc->start.refDiff;
+        sor->refSweep = -(long long) calc->start.refAge;
+        sor->worth = calc->start.gaussSeidel;
+    }
+    setOmega(sor, omega);
+}
+
+/**
+ * the optimal omega when the edges are the only pinned cells: 2 / (1 + sqrt(1 - rho^2)), rho
+ * being the spectral radius of the Jacobi sweep of the stencil over the grid
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param weights weights of the stencil, see relaxationSupports
+ * @return the omega
+ */
+double gridOmega(const HeatGrid *grid, int is_cyclic, const StencilWeights *weights)
+{
+    // the slowest mode between two Neumann edges is the one of a cyclic dimension
+    int unpinned = is_cyclic || grid->edges == EDGE_NEUMANN;
+    double rho = 2 * weights->neighbour / (1 - weights->center) *
+                 (dimensionCosine(grid->rows, unpinned) + dimensionCosine(grid->cols, unpinned));
+    if (rho <= 0)
+    {
+        return 1;
+    }
+    return 2 / (1 + sqrt(1 - rho * rho));
+}
+
+/**
+ * @param n length of a dimension
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return cosine of the slowest mode along the dimension. a cyclic one has no edges, a single
+ *         source pins it like edges n cells apart.
+ */
+double dimensionCosine(size_t n, int is_cyclic)
+{
+    return cos(PI / (double) (is_cyclic ? n : n + 1));
+}
+
+/**
+ * move the weights of the sweeps to a new omega:
+ * center = 1 - omega, neighbour = omega * neighbour / (1 - center) of the registered stencil
+ * @param sor the over-relaxation
+ * @param omega the new omega
+ */
+void setOmega(Sor *sor, double omega)
+{
+    double diagonal = 1 - sor->weights.center;
+    sor->omega = omega;
+    sor->stencil.weights.center = 1 - omega;
+    sor->stencil.weights.neighbour = omega * sor->weights.neighbour / diagonal;
+}
+
+/**
+ * raise omega after a new difference when the rate it fell at since the reference is slower
+ * than the optimum of omega, omega - 1. below the optimum SOR falls at the rate r with
+ * (r + omega - 1)^2 = r * omega^2 * rho^2, which gives the Jacobi radius rho and the optimum
+ * 2 / (1 + sqrt(1 - rho^2)). omega settles once it reaches the limit or a raise is less than a
+ * tenth of 2 - omega: past the optimum the difference oscillates and its rate says nothing.
+ * @param progress the progress of a SOR call, with a new difference
+ */
+void adaptRelaxation(Progress *progress)
+{
+    Sor *sor = &progress->sor;
+    double diff = progress->diff;
+    if (diff <= 0 || sor->settled)
+    {
+        return;
+    }
+    if (sor->refDiff <= 0)
+    {
+        sor->refDiff = diff;
+        sor->refSweep = progress->sweeps;
+        return;
+    }
+    long long span = (long long) progress->sweeps - sor->refSweep;
+    if (span < SOR_WINDOW)
+    {
+        return;
+    }
+    double rate = pow(diff / sor->refDiff, 1.0 / (double) span);
+    double omega = sor->omega;
+    sor->refDiff = diff;
+    sor->refSweep = progress->sweeps;
+    if (rate >= 1 || rate <= omega - 1)
     {
-        col--;
+        return;
     }
-    return grid[row][col];
+    double rho2 = (rate + omega - 1) * (rate + omega - 1) / (rate * omega * omega);
+    double optimum = rho2 < 1 ? 2 / (1 + sqrt(1 - rho2)) : sor->limit;
+    if (optimum >= sor->limit)
+    {
+        optimum = sor->limit;
+        sor->settled = 1;
+    }
+    if (optimum - omega < (2 - omega) / 10)
+    {
+        sor->settled = 1;
+    }
+    if (optimum > omega)
+    {
+        sor->worth += (double) (progress->sweeps - sor->worthSweep) * relaxationSpeedup(omega);
+        sor->worthSweep = progress->sweeps;
+        setOmega(sor, optimum);
+    }
+}
+
+/**
+ * @param progress the progress of a SOR call
+ * @return the state of the over-relaxation, to continue the call with
+ */
+Relaxation relaxationOf(const Progress *progress)
+{
+    const Sor *sor = &progress->sor;
+    Relaxation relaxation;
+    relaxation.omega = sor->omega;
+    relaxation.settled = sor->settled;
+    relaxation.refDiff = sor->refDiff;
+    relaxation.refAge = sor->refDiff > 0 ? (unsigned int) (progress->sweeps - sor->refSweep) : 0;
+    relaxation.gaussSeidel = sor->worth + (double) (progress->sweeps - sor->worthSweep) *
+                                          relaxationSpeedup(sor->omega);
+    return relaxation;
+}
+
+/**
+ * @param progress the progress of the call
+ * @param function the update function
+ * @return the stencil the sweeps of the call update the cells with, NULL to call the function
+ */
+const LinearStencil *sweepStencil(const Progress *progress, diff_func function)
+{
+    return progress->relaxed ? &progress->sor.stencil : findStencil(function);
+}
 
+/**
+ * the float sweeps round every cell to float, the rounding of the function itself is lost in
+ * it, so they only need its weights
+ * @param progress the progress of the call
+ * @param function the update function
+ * @return the stencil the float sweeps of the call update the cells with, NULL if there are none
+ */
+const LinearStencil *floatStencil(const Progress *progress, diff_func function)
+{
+    return progress->relaxed ? &progress->sor.stencil : findLinearStencil(function);
 }
 
 /**
- *
- * @param row in the grid
- * @param col int rhe grid
- * @param grid heat grid
- * @param m rows
- * @param is_cyclic is grid cyclic or not
- * @return the right value to the given coordinates
+ * @param calc the calculator
+ * @param relaxation put the state the last calculateGrid call ended with here
+ * @return 1 if the sweeps of the last calculateGrid call were over-relaxed, 0 otherwise
  */
-double getRight(const size_t row, size_t col, double **grid, const size_t m,
-                const int is_cyclic)
+int calculatorRelaxation(const Calculator *calc, Relaxation *relaxation)
 {
-    if (col + 1 == m)
+    if (calc->relaxed)
     {
-        if (!is_cyclic)
-        {
-            return 0;
-        }
-        col = 0;
+        *relaxation = calc->relaxation;
     }
-    else
+    return calc->relaxed;
+}
+
+/**
+ * @param omega the relaxation factor of a SOR run
+ * @return about how many Gauss-Seidel sweeps a sweep at omega is worth, when omega is the
+ *         optimum of the grid: log(rate of SOR) / log(rate of Gauss-Seidel). 1 for omega 1.
+ */
+double relaxationSpeedup(double omega)
+{
+    if (omega <= 1 || omega >= 2)
     {
-        col++;
+        return 1;
     }
-    return grid[row][col];
+    // at the optimum sqrt(1 - rho^2) = 2 / omega - 1, and Gauss-Seidel falls at rho^2
+    double root = 2 / omega - 1;
+    return log(omega - 1) / log(1 - root * root);
+}
 
+/**
+ * @param calc the calculator
+ * @return number of sweeps the last calculateGrid call ran, 0 before the first one
+ */
+unsigned int calculatorSweeps(const Calculator *calc)
+{
+    return calc->sweeps;
 }
 
 /**
- *
- * @param row in the grid
- * @param col int rhe grid
- * @param grid heat grid
- * @param n columns
- * @param is_cyclic is grid cyclic or not
- * @return the bottom value to the given coordinates
+ * single threaded calculateGrid, the heat of every row is taken while the row is in cache
+ * right after its update. it goes on from the sweeps the progress already has.
  */
-double getBottom(size_t row, const size_t col, double **grid, const size_t n, const int is_cyclic)
+double calculateSerial(Calculator *calc, diff_func function, HeatGrid *grid,
+                       Progress *progress, int is_cyclic)
 {
-    if (row == 0)
+    if (heatNeeded(progress, progress->sweeps))
     {
-        if (!is_cyclic)
-        {
-            return 0;
-        }
-        row = n - 1;
+        recordHeat(progress, calcHeat(grid));
+        traceMark(progress->trace, TRACE_REDUCTION);
     }
-    else
+    while (!finished(progress))
     {
-        row--;
+        int measure = heatNeeded(progress, progress->sweeps + 1);
+        sweepSerial(function, sweepStencil(progress, function), grid, is_cyclic,
+                    calc->options.order, measure ? calc->rowSums : NULL);
+        progress->sweeps++;
+        traceMark(progress->trace, TRACE_SWEEP);
+        if (measure)
+        {
+            recordHeat(progress, sumOfRowSums(calc->rowSums, grid->rows));
+            traceMark(progress->trace, TRACE_REDUCTION);
+        }
+        callHook(calc, grid, progress);
+        traceProgress(progress);
     }
-    return grid[row][col];
+    return progress->diff;
 }
 
 /**
- *
- * @param row in the grid
- * @param col int rhe grid
- * @param grid heat grid
- * @param n columns
- * @param is_cyclic is grid cyclic or not
- * @return the top value to the given coordinates
+ * single threaded calculateGrid that only updates the active region of the grid (see
+ * CalcOptions), the heat of the other rows is carried over from the sweep before
  */
-double getTop(size_t row, size_t col, double **grid, size_t n, int is_cyclic)
+double calculateActive(Calculator *calc, diff_func function, HeatGrid *grid,
+                       Progress *progress, int is_cyclic)
 {
-    if (row + 1 == n)
+    ActiveRegion *region = createActiveRegion(grid, calc->options.activeThreshold);
+    if (!region)
+    {
+        return -1;
+    }
+    traceMark(progress->trace, TRACE_OTHER);
+    if (heatNeeded(progress, 0))
+    {
+        recordHeat(progress, activeHeat(region));
+        traceMark(progress->trace, TRACE_REDUCTION);
+    }
+    while (!finished(progress))
     {
-        if (!is_cyclic)
+        sweepActive(region, function, sweepStencil(progress, function), grid, is_cyclic,
+                    calc->options.order);
+        progress->sweeps++;
+        traceMark(progress->trace, TRACE_SWEEP);
+        if (heatNeeded(progress, progress->sweeps))
         {
-            return 0;
+            recordHeat(progress, activeHeat(region));
+            traceMark(progress->trace, TRACE_REDUCTION);
         }
-        row = 0;
+        callHook(calc, grid, progress);
+        traceProgress(progress);
     }
-    else
+    freeActiveRegion(region);
+    return progress->diff;
+}
+
+/**
+ * single threaded calculateGrid on a float copy of the grid (see Precision). the grid gets the
+ * values of the copy before the sweep hook is called and when the float sweeps stop, the sweeps
+ * left then go on in double in calculateSerial. the heat of the float sweeps is not compared
+ * with that of the double ones, which differs by the rounding of the grid.
+ */
+double calculateFloat(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+                      int is_cyclic)
+{
+    FloatGrid *floats = createFloatGrid(grid, calc->options.order == ORDER_JACOBI);
+    if (!floats)
+    {
+        return -1;
+    }
+    traceMark(progress->trace, TRACE_OTHER);
+    if (heatNeeded(progress, progress->sweeps))
+    {
+        recordHeat(progress, floatHeat(floats));
+        traceMark(progress->trace, TRACE_REDUCTION);
+    }
+    while (!finished(progress) && !floatFinished(calc, progress))
+    {
+        int measure = heatNeeded(progress, progress->sweeps + 1);
+        sweepFloat(floats, &floatStencil(progress, function)->weights, is_cyclic,
+                   calc->options.order, measure ? calc->rowSums : NULL);
+        progress->sweeps++;
+        traceMark(progress->trace, TRACE_SWEEP);
+        if (measure)
+        {
+            recordHeat(progress, sumOfRowSums(calc->rowSums, grid->rows));
+            traceMark(progress->trace, TRACE_REDUCTION);
+        }
+        if (hookDue(calc, progress))
+        {
+            storeFloatGrid(floats, grid);
+        }
+        callHook(calc, grid, progress);
+        traceProgress(progress);
+    }
+    storeFloatGrid(floats, grid);
+    freeFloatGrid(floats);
+    if (finished(progress))
+    {
+        return progress->diff;
+    }
+    progress->hasHeat = 0;
+    return calculateSerial(calc, function, grid, progress, is_cyclic);
+}
+
+/**
+ * one sweep over a float copy in the given order
+ * @param floats the copy, with a spare buffer for a Jacobi sweep
+ * @param weights weights of the stencil
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param order the update order
+ * @param rowSums if not NULL, gets the heat of every row after the sweep
+ */
+void sweepFloat(FloatGrid *floats, const StencilWeights *weights, int is_cyclic,
+                UpdateOrder order, double *rowSums)
+{
+    if (order == ORDER_RED_BLACK)
+    {
+        sweepFloatGrid(floats, weights, is_cyclic, 0, NULL);
+        sweepFloatGrid(floats, weights, is_cyclic, 1, rowSums);
+    }
+    else if (order == ORDER_JACOBI)
+    {
+        sweepFloatJacobi(floats, weights, is_cyclic, rowSums);
+    }
+    else
+    {
+        sweepFloatGrid(floats, weights, is_cyclic, ALL_COLOURS, rowSums);
+    }
+}
+
+/**
+ * whether the float sweeps of a call should stop before the progress is finished (see
+ * Precision). the difference is only looked at where finished looks at it.
+ * @param calc the calculator
+ * @param progress the progress
+ * @return 1 if the rest of the call goes on in double, 0 otherwise
+ */
+int floatFinished(const Calculator *calc, const Progress *progress)
+{
+    int mixed = calc->options.precision == PRECISION_MIXED;
+    if (progress->n_iter > 0)
+    {
+        return mixed && heatNeeded(progress, progress->sweeps + 1);
+    }
+    if (!progress->hasDiff || progress->sweeps % progress->checkEvery != 0)
+    {
+        return 0;
+    }
+    // below the rounding of the heat the float cells round to where they are instead of moving
+    if (progress->diff < FLT_EPSILON * fabs(progress->heat))
+    {
+        return 1;
+    }
+    return mixed && progress->diff < MIXED_MARGIN * progress->terminate;
+}
+
+/**
+ * one single threaded sweep over the grid in the given order, in stripes for a mapped grid
+ * @param function the given function
+ * @param stencil the stencil of a raster or red-black sweep (see updateBand)
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param order the update order
+ * @param rowSums if not NULL, gets the heat of every row after the sweep
+ */
+void sweepSerial(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                 int is_cyclic, UpdateOrder order, double *rowSums)
+{
+    if (gridOnDisk(grid) && order == ORDER_RED_BLACK)
+    {
+        sweepStripes(function, stencil, grid, is_cyclic, order, 0, NULL);
+        sweepStripes(function, stencil, grid, is_cyclic, order, 1, rowSums);
+    }
+    else if (gridOnDisk(grid))
+    {
+        sweepStripes(function, stencil, grid, is_cyclic, order, ALL_COLOURS, rowSums);
+        if (order == ORDER_JACOBI)
+        {
+            swapBuffers(grid);
+        }
+    }
+    else if (order == ORDER_RED_BLACK)
+    {
+        updateGridColour(function, stencil, grid, is_cyclic, 0, NULL);
+        updateGridColour(function, stencil, grid, is_cyclic, 1, rowSums);
+    }
+    else if (order == ORDER_JACOBI)
+    {
+        updateBandJacobi(function, grid, 0, grid->rows, is_cyclic, rowSums);
+        swapBuffers(grid);
+    }
+    else
+    {
+        updateGridColour(function, stencil, grid, is_cyclic, ALL_COLOURS, rowSums);
+    }
+}
+
+/**
+ * one pass over a mapped grid in stripes of about STRIPE_BYTES, in raster order like
+ * updateGridColour: the rows on both sides of a stripe are its halo, the last row of the stripe
+ * before it already updated. the next stripe is read from the disk while this one is updated,
+ * the pages of the stripes behind are written back and dropped by the system as it needs.
+ * @param function the given function
+ * @param stencil the stencil of a raster or red-black pass (see updateBand)
+ * @param grid grid of values, mapped
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param order the update order, a Jacobi pass goes from data to spare (see updateBandJacobi)
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, gets the heat of every row after the pass
+ */
+void sweepStripes(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                  int is_cyclic, UpdateOrder order, int colour, double *rowSums)
+{
+    size_t n = grid->rows, rowBytes = grid->stride * sizeof(double);
+    size_t stripe = rowBytes && STRIPE_BYTES > rowBytes ? STRIPE_BYTES / rowBytes : 1;
+    prefetchRows(grid, grid->data, 0, stripe < n ? stripe : n);
+    for (size_t lo = 0; lo < n; lo += stripe)
+    {
+        size_t hi = lo + stripe < n ? lo + stripe : n;
+        size_t next = hi + stripe < n ? hi + stripe : n;
+        prefetchRows(grid, grid->data, hi, next);
+        if (order == ORDER_JACOBI)
+        {
+            prefetchRows(grid, grid->spare, hi, next);
+            updateBandJacobi(function, grid, lo, hi, is_cyclic, rowSums);
+            continue;
+        }
+        const double *bandBottom = bottomRow(grid, grid->data, lo, is_cyclic);
+        const double *bandTop = topRow(grid, grid->data, hi - 1, is_cyclic);
+        updateBand(function, stencil, grid, lo, hi, bandBottom, bandTop, is_cyclic, colour,
+                   rowSums);
+    }
+}
+
+/**
+ * start reading rows lo..hi-1 of a buffer of a mapped grid from the disk without waiting for them
+ * @param grid grid of values, mapped
+ * @param buffer grid->data or grid->spare
+ * @param lo first row
+ * @param hi one past the last row
+ */
+void prefetchRows(const HeatGrid *grid, const double *buffer, size_t lo, size_t hi)
+{
+    if (lo >= hi)
+    {
+        return;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t) (buffer + lo * grid->stride);
+    uintptr_t to = (uintptr_t) (buffer + hi * grid->stride);
+    // the advice goes to whole pages, the mapping starts at one
+    from -= page > 0 ? from % (uintptr_t) page : 0;
+    posix_madvise((void *) from, to - from, POSIX_MADV_WILLNEED);
+}
+
+/**
+ * single threaded calculateGrid over a non cyclic grid in temporal tiles: a tile advances the
+ * whole grid by up to tileDepth sweeps in one wavefront pass (see sweepTile), so the rows are
+ * read from memory once per tile instead of once per sweep. a tile never goes past a sweep at
+ * which the run may stop, so the result and the difference are those of calculateSerial.
+ */
+double calculateTiled(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress)
+{
+    size_t n = grid->rows;
+    if (heatNeeded(progress, 0))
+    {
+        recordHeat(progress, calcHeat(grid));
+        traceMark(progress->trace, TRACE_REDUCTION);
+    }
+    while (!finished(progress))
+    {
+        unsigned int depth = tileSweeps(progress, calc->options.tileDepth);
+        sweepTile(function, grid, calc->options.order, progress, depth, calc->rowSums);
+        traceMark(progress->trace, TRACE_SWEEP);
+        for (unsigned int k = 0; k < depth; k++)
+        {
+            progress->sweeps++;
+            if (heatNeeded(progress, progress->sweeps))
+            {
+                recordHeat(progress, sumOfRowSums(calc->rowSums + (progress->sweeps % 2) * n, n));
+            }
+        }
+        traceMark(progress->trace, TRACE_REDUCTION);
+        callHook(calc, grid, progress);
+        traceProgress(progress);
+    }
+    return progress->diff;
+}
+
+/**
+ * @param progress the progress
+ * @param depth the tile depth of the calculator
+ * @return number of sweeps of the next tile: at most depth, and ending no later than the next
+ *         sweep after which finished() may become true
+ */
+unsigned int tileSweeps(const Progress *progress, unsigned int depth)
+{
+    unsigned int left;
+    if (progress->n_iter > 0)
+    {
+        left = progress->n_iter - progress->sweeps;
+    }
+    else
+    {
+        left = progress->checkEvery - progress->sweeps % progress->checkEvery;
+    }
+    return depth < left ? depth : left;
+}
+
+/**
+ * advance a non cyclic grid by depth sweeps in one wavefront over the rows. pass p of the tile
+ * (a sweep, or one colour of a red-black sweep) updates row s - 2p at step s: by then the rows
+ * next to it are done with pass p - 1 (and row i - 1 with pass p, which a raster sweep reads)
+ * and none of them has started pass p + 1, so every row sees exactly the values it sees in
+ * depth separate sweeps. the rows in flight, about 2 * depth passes of them, stay in cache.
+ * only the last two sweeps of a tile can need their heat (see tileSweeps), the row sums of
+ * sweep k go to rowSums + (k % 2) * rows.
+ * @param function the given function
+ * @param grid grid of values, with a spare buffer for ORDER_JACOBI
+ * @param order the update order
+ * @param progress the progress before the tile
+ * @param depth number of sweeps
+ * @param rowSums row sums of the two measured sweeps, 2 * rows of them
+ */
+void sweepTile(diff_func function, HeatGrid *grid, UpdateOrder order, const Progress *progress,
+               unsigned int depth, double *rowSums)
+{
+    size_t n = grid->rows;
+    const LinearStencil *stencil = sweepStencil(progress, function);
+    unsigned int passesPerSweep = order == ORDER_RED_BLACK ? 2 : 1;
+    unsigned int passes = depth * passesPerSweep;
+    for (size_t step = 0; step < n + 2 * (size_t) (passes - 1); step++)
+    {
+        for (unsigned int pass = 0; pass < passes && 2 * (size_t) pass <= step; pass++)
+        {
+            size_t row = step - 2 * (size_t) pass;
+            if (row >= n)
+            {
+                continue;
+            }
+            unsigned int sweep = progress->sweeps + pass / passesPerSweep + 1;
+            int lastPass = (pass + 1) % passesPerSweep == 0;
+            double *sums = NULL;
+            if (lastPass && heatNeeded(progress, sweep))
+            {
+                sums = rowSums + (sweep % 2) * n;
+            }
+            updateTileRow(function, stencil, grid, order, row, pass, sums);
+        }
+    }
+    // a Jacobi tile alternates between the buffers, pass p writes buffer (p + 1) % 2
+    if (order == ORDER_JACOBI && depth % 2 == 1)
+    {
+        swapBuffers(grid);
+    }
+}
+
+/**
+ * update one row of a non cyclic grid for one pass of a tile
+ * @param function the given function
+ * @param stencil the stencil of a raster or red-black pass (see updateBand)
+ * @param grid grid of values
+ * @param order the update order
+ * @param row the row
+ * @param pass index of the pass inside the tile
+ * @param rowSums if not NULL, rowSums[row] gets the heat of the row
+ */
+void updateTileRow(diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                   UpdateOrder order, size_t row, unsigned int pass, double *rowSums)
+{
+    if (order == ORDER_JACOBI)
+    {
+        double *buffers[2] = {grid->data, grid->spare};
+        updateBandInto(function, grid, buffers[pass % 2], buffers[(pass + 1) % 2], row, row + 1,
+                       0, rowSums);
+        return;
+    }
+    const double *bottom = bottomRow(grid, grid->data, row, 0);
+    const double *top = topRow(grid, grid->data, row, 0);
+    int colour = order == ORDER_RED_BLACK ? (int) (pass % 2) : ALL_COLOURS;
+    updateBand(function, stencil, grid, row, row + 1, bottom, top, 0, colour, rowSums);
+}
+
+/**
+ * multithreaded calculateGrid, every thread of the pool owns a band of consecutive rows.
+ * at the start of every sweep (every colour of a red-black sweep) each band copies its first and
+ * last rows, the neighbouring bands read those copies instead of the live rows, so the result
+ * only depends on the number of threads and not on their timing.
+ * a Jacobi sweep only reads the previous buffer, so it needs no copies and gives the same grid
+ * for any number of threads.
+ */
+double calculateBands(Calculator *calc, diff_func function, HeatGrid *grid, Progress *progress,
+                      int is_cyclic)
+{
+    unsigned int bands = poolSize(calc->pool);
+    if (bands > grid->rows)
+    {
+        bands = (unsigned int) grid->rows;
+    }
+    if (reserve(&calc->edges, &calc->edgesSize, 2 * (size_t) bands * grid->cols))
+    {
+        return -1;
+    }
+    BandJob job = {calc, function, grid, is_cyclic, bands, *progress, calc->edges, calc->rowSums,
+                   NULL};
+    runPool(calc->pool, bandTask, &job);
+    *progress = job.progress;
+    return progress->diff;
+}
+
+/**
+ * calculateGrid on worker processes, one band of rows each, the way calculateBands runs it on
+ * as many threads. the processes sweep the buffers of the shared grid in place, each touching
+ * only its band, and exchange the band edge copies and the row sums in the memory of the group,
+ * which the calculator keeps for the grid between calls. a worker that dies ends the call with
+ * an error and frees the group, the next call forks a new one.
+ */
+double calculateProcesses(Calculator *calc, diff_func function, HeatGrid *grid,
+                          Progress *progress, int is_cyclic)
+{
+    if (prepareGroup(calc, grid))
+    {
+        return -1;
+    }
+    unsigned int bands = groupSize(calc->group);
+    size_t n = grid->rows, m = grid->cols;
+    GroupCall *call = groupMemory(calc->group);
+    double *edges = call->values, *rowSums = edges + 2 * (size_t) bands * m;
+    double *ghost = rowSums + n;
+    call->grid = *grid;
+    if (grid->ghost)
+    {
+        call->grid.ghost = memcpy(ghost, grid->ghost, sizeof(double) * grid->stride);
+    }
+    if (grid->pinnedStart)
+    {
+        size_t *pinnedStart = (size_t *) (ghost + grid->stride);
+        memcpy(pinnedStart, grid->pinnedStart, sizeof(size_t) * (n + 1));
+        call->grid.pinnedStart = pinnedStart;
+        call->grid.pinnedCols = memcpy(pinnedStart + n + 1, grid->pinnedCols,
+                                       sizeof(size_t) * pinnedStart[n]);
+    }
+    BandJob job = {calc, function, &call->grid, is_cyclic, bands, *progress, edges, rowSums,
+                   calc->group};
+    call->job = job;
+    if (runGroup(calc->group, bandTask, &call->job))
+    {
+        freeProcessGroup(calc->group);
+        calc->group = NULL;
+        return -1;
+    }
+    // the sweeps of a Jacobi call swap the buffers
+    grid->data = call->grid.data;
+    grid->spare = call->grid.spare;
+    *progress = call->job.progress;
+    return progress->diff;
+}
+
+/**
+ * make sure the calculator has a process group for the grid. the workers only see the buffers
+ * the grid had when they were forked, so a new group is forked for another grid, once the grid
+ * got its spare buffer, and when the pinned cells outgrow the memory of the group.
+ * @param calc the calculator
+ * @param grid the grid, shared (see shareGrid)
+ * @return 0 if succeeded, 1 if the group could not be created
+ */
+int prepareGroup(Calculator *calc, const HeatGrid *grid)
+{
+    size_t pins = grid->pinnedStart ? grid->pinnedStart[grid->rows] : 0;
+    if (calc->group && calc->groupSerial == grid->serial &&
+        calc->groupSpare == (grid->spare != NULL) && pins <= calc->groupPins)
+    {
+        return 0;
+    }
+    freeProcessGroup(calc->group);
+    unsigned int bands = calc->options.processes;
+    if (bands > grid->rows)
+    {
+        bands = (unsigned int) grid->rows;
+    }
+    size_t doubles = 2 * (size_t) bands * grid->cols + grid->rows + grid->stride;
+    size_t bytes = sizeof(GroupCall) + sizeof(double) * doubles +
+                   sizeof(size_t) * (grid->rows + 1 + pins);
+    calc->group = createProcessGroup(bands, bytes);
+    if (!calc->group)
+    {
+        return 1;
+    }
+    calc->groupSerial = grid->serial;
+    calc->groupSpare = grid->spare != NULL;
+    calc->groupPins = pins;
+    return 0;
+}
+
+/**
+ * body of calculateBands run by every thread of the pool (and of calculateProcesses run by
+ * every process of the group), threads without a band only take part in the synchronization.
+ * every thread keeps its own copy of the progress and reaches the same decisions from the same
+ * row sums.
+ * @param arg the BandJob
+ * @param index index of the thread
+ * @param count number of threads
+ */
+void bandTask(void *arg, unsigned int index, unsigned int count)
+{
+    BandJob *job = arg;
+    Calculator *calc = job->calc;
+    HeatGrid *grid = job->grid;
+    Progress progress = job->progress;
+    progress.trace = index == 0 ? progress.trace : NULL;
+    size_t n = grid->rows, m = grid->cols;
+    unsigned int bands = job->bands;
+    int active = index < bands;
+    size_t lo = n * index / bands, hi = n * (index + 1) / bands;
+    double *first = job->edges + 2 * (size_t) index * m, *last = first + m;
+
+    // rows next to the band, copies owned by the neighbouring bands
+    const double *bandBottom = NULL, *bandTop = NULL;
+    if (active)
+    {
+        if (lo > 0)
+        {
+            bandBottom = job->edges + (2 * (size_t) (index - 1) + 1) * m;
+        }
+        else if (job->is_cyclic)
+        {
+            bandBottom = job->edges + (2 * (size_t) (bands - 1) + 1) * m;
+        }
+        else
+        {
+            // the first band owns row 0, the edge past it needs no copy
+            bandBottom = bottomRow(grid, grid->data, 0, 0);
+        }
+        if (hi < n)
+        {
+            bandTop = job->edges + 2 * (size_t) (index + 1) * m;
+        }
+        else if (job->is_cyclic)
+        {
+            bandTop = job->edges;
+        }
+        else
+        {
+            bandTop = topRow(grid, grid->data, n - 1, 0);
+        }
+    }
+    traceMark(progress.trace, TRACE_OTHER);
+    if (heatNeeded(&progress, 0))
+    {
+        for (size_t i = lo; active && i < hi; i++)
+        {
+            job->rowSums[i] = rowHeat(GRID_ROW(grid, i), m);
+        }
+        if (bandSync(job))
+        {
+            return;
+        }
+        recordHeat(&progress, sumOfRowSums(job->rowSums, n));
+        traceMark(progress.trace, TRACE_REDUCTION);
+    }
+
+    // a raster or Jacobi sweep is one pass over every cell, a red-black sweep one pass per colour
+    int redBlack = calc->options.order == ORDER_RED_BLACK;
+    int jacobi = calc->options.order == ORDER_JACOBI;
+    int firstColour = redBlack ? 0 : ALL_COLOURS, lastColour = redBlack ? 1 : ALL_COLOURS;
+    while (!finished(&progress))
+    {
+        int measure = heatNeeded(&progress, progress.sweeps + 1);
+        for (int colour = firstColour; colour <= lastColour; colour++)
+        {
+            double *rowSums = measure && colour == lastColour ? job->rowSums : NULL;
+            if (active && !jacobi)
+            {
+                memcpy(first, GRID_ROW(grid, lo), sizeof(double) * m);
+                memcpy(last, GRID_ROW(grid, hi - 1), sizeof(double) * m);
+            }
+            if (bandSync(job))
+            {
+                return;
+            }
+            if (active && jacobi)
+            {
+                updateBandJacobi(job->function, grid, lo, hi, job->is_cyclic, rowSums);
+            }
+            else if (active)
+            {
+                updateBand(job->function, sweepStencil(&progress, job->function), grid, lo, hi,
+                           bandBottom, bandTop, job->is_cyclic, colour, rowSums);
+            }
+            if (bandSync(job))
+            {
+                return;
+            }
+        }
+        // nobody touches the buffers until the next sync
+        if (jacobi && index == 0)
+        {
+            swapBuffers(grid);
+        }
+        progress.sweeps++;
+        traceMark(progress.trace, TRACE_SWEEP);
+        if (measure)
+        {
+            recordHeat(&progress, sumOfRowSums(job->rowSums, n));
+            traceMark(progress.trace, TRACE_REDUCTION);
+        }
+        // the others only copy their edge rows before the next sync
+        if (index == 0)
+        {
+            callHook(calc, grid, &progress);
+        }
+        traceProgress(&progress);
+    }
+    if (index == 0)
+    {
+        job->progress = progress;
+    }
+    (void) count;
+}
+
+/**
+ * wait for the other threads of the pool, or the other processes of the group, of a job
+ * @param job the job
+ * @return 0 if all of them got here, 1 if a process of the group died, the job ends then
+ */
+int bandSync(const BandJob *job)
+{
+    if (job->group)
+    {
+        return groupSync(job->group);
+    }
+    poolSync(job->calc->pool);
+    return 0;
+}
+
+/**
+ * @param calc the calculator
+ * @return 1 if its sweeps run in bands of rows, on threads or on processes, 0 otherwise
+ */
+int banded(const Calculator *calc)
+{
+    return calc->pool != NULL || calc->options.processes > 1;
+}
+
+/**
+ * @param progress the progress to start
+ * @param terminate terminate threshold
+ * @param n_iter number of iterations, 0 to run until the difference is below terminate
+ * @param checkEvery check the difference only every checkEvery sweeps when n_iter is 0
+ */
+void startProgress(Progress *progress, double terminate, unsigned int n_iter,
+                   unsigned int checkEvery)
+{
+    progress->terminate = terminate;
+    progress->n_iter = n_iter;
+    progress->checkEvery = checkEvery;
+    progress->nested = 0;
+    progress->sweeps = 0;
+    progress->heatSweep = 0;
+    progress->hasHeat = 0;
+    progress->hasDiff = 0;
+    progress->heat = 0;
+    progress->diff = 0;
+    progress->relaxed = 0;
+    progress->trace = NULL;
+}
+
+/**
+ * @param progress the progress
+ * @param sweep number of sweeps done, 0 before the first one
+ * @return 1 if the heat after that sweep is needed for a difference, 0 otherwise
+ */
+int heatNeeded(const Progress *progress, unsigned int sweep)
+{
+    if (progress->n_iter > 0)
+    {
+        return sweep + 1 >= progress->n_iter;
+    }
+    unsigned int every = progress->checkEvery;
+    return (sweep + 1) % every == 0 || (sweep > 0 && sweep % every == 0);
+}
+
+/**
+ * record the heat after the sweeps done so far, the difference is updated when the heat after
+ * the sweep before is known
+ * @param progress the progress
+ * @param heat the heat of the grid
+ */
+void recordHeat(Progress *progress, double heat)
+{
+    if (progress->hasHeat && progress->heatSweep + 1 == progress->sweeps)
+    {
+        progress->diff = absDiff(heat, progress->heat);
+        progress->hasDiff = 1;
+        if (progress->relaxed)
+        {
+            adaptRelaxation(progress);
+        }
+    }
+    progress->heat = heat;
+    progress->heatSweep = progress->sweeps;
+    progress->hasHeat = 1;
+}
+
+/**
+ * @param progress the progress
+ * @return 1 if calculateGrid should stop, 0 otherwise
+ */
+int finished(const Progress *progress)
+{
+    if (progress->n_iter > 0)
+    {
+        return progress->sweeps >= progress->n_iter;
+    }
+    // run while diff >= terminate, looked at every checkEvery sweeps. a NaN difference stops
+    // the run like it did the loop of calculate
+    return progress->sweeps > 0 && progress->sweeps % progress->checkEvery == 0 &&
+           !(progress->diff >= progress->terminate);
+}
+
+/**
+ * @param calc the calculator
+ * @param progress the progress
+ * @return 1 if the calculator has a sweep hook and the sweeps done so far are a point where the
+ *         call can be cut (see sweep_hook), 0 otherwise
+ */
+int hookDue(const Calculator *calc, const Progress *progress)
+{
+    if (!calc->hook || progress->nested || finished(progress))
+    {
+        return 0;
+    }
+    return progress->n_iter > 0 || progress->sweeps % progress->checkEvery == 0;
+}
+
+/**
+ * call the sweep hook of the calculator if there is one and the sweeps done so far are a point
+ * where the call can be cut (see sweep_hook)
+ * @param calc the calculator
+ * @param grid grid of values
+ * @param progress the progress
+ */
+void callHook(const Calculator *calc, const HeatGrid *grid, const Progress *progress)
+{
+    if (!hookDue(calc, progress))
+    {
+        return;
+    }
+    Relaxation relaxation = relaxationOf(progress);
+    calc->hook(calc->hookArg, grid, progress->sweeps, progress->hasDiff ? progress->diff : -1,
+               progress->relaxed ? &relaxation : NULL);
+}
+
+/**
+ * tell the trace of the progress how far the sweeps got
+ * @param progress the progress
+ */
+void traceProgress(const Progress *progress)
+{
+    traceSweeps(progress->trace, progress->sweeps, progress->hasDiff ? progress->diff : -1);
+}
+
+/**
+ * @param rowSums the heat of every row
+ * @param n number of rows
+ * @return the heat of the grid, the row sums added in row order like sumRows does
+ */
+double sumOfRowSums(const double *rowSums, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += rowSums[i];
+    }
+    return sum;
+}
+
+/**
+ * grow a work buffer
+ * @param buffer the buffer, reallocated when too small
+ * @param size current number of doubles in the buffer
+ * @param needed number of doubles needed
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int reserve(double **buffer, size_t *size, size_t needed)
+{
+    if (needed <= *size)
+    {
+        return 0;
+    }
+    double *grown = realloc(*buffer, sizeof(double) * needed);
+    if (!grown)
+    {
+        return 1;
+    }
+    *buffer = grown;
+    *size = needed;
+    return 0;
+}
+
+/**
+ * @param currSum heat after the sweep
+ * @param prevSum heat before the sweep
+ * @return absolute difference of the two
+ */
+double absDiff(double currSum, double prevSum)
+{
+    double diff = currSum - prevSum;
+    if (diff < 0)
+    {
+        diff *= -1;
+    }
+    return diff;
+}
+
+/**
+ * calculate the sum of the heat. every row is summed on its own and the row sums are then added
+ * in row order (see sumRows), so any split of the rows into bands and threads gives the same
+ * value. this rounds differently from one running sum over all the cells, the difference of a
+ * grid with values of very different magnitudes can differ in its last digits from it.
+ * @param grid of heat
+ * @return the sum of the values of the grid
+ */
+double calcHeat(const HeatGrid *grid)
+{
+    return sumRows(grid, 0, grid->rows);
+}
+
+/**
+ * calculate the new grid in raster order, skipping the pinned cells
+ * @param function the given function
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGrid(const diff_func function, HeatGrid *grid, const int is_cyclic)
+{
+    updateGridColour(function, findStencil(function), grid, is_cyclic, ALL_COLOURS, NULL);
+}
+
+/**
+ * calculate the new grid in red-black order: first every cell (i, j) with (i + j) even, then
+ * every cell with (i + j) odd, skipping the pinned cells. with even dimensions (or no cyclic
+ * edges) the cells of one colour only depend on the other colour.
+ * @param function the given function
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGridRedBlack(const diff_func function, HeatGrid *grid, const int is_cyclic)
+{
+    const LinearStencil *stencil = findStencil(function);
+    updateGridColour(function, stencil, grid, is_cyclic, 0, NULL);
+    updateGridColour(function, stencil, grid, is_cyclic, 1, NULL);
+}
+
+/**
+ * calculate the new grid from the old one into the spare buffer (Jacobi), then swap the buffers
+ * @param function the given function
+ * @param grid grid of values, must have a spare buffer (see prepareSpare)
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGridJacobi(const diff_func function, HeatGrid *grid, const int is_cyclic)
+{
+    updateBandJacobi(function, grid, 0, grid->rows, is_cyclic, NULL);
+    swapBuffers(grid);
+}
+
+/**
+ * one pass over the whole grid
+ * @param function the given function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, gets the heat of every row after the pass
+ */
+void updateGridColour(const diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                      const int is_cyclic, const int colour, double *rowSums)
+{
+    size_t n = grid->rows;
+    if (n == 0)
     {
-        row++;
+        return;
     }
-    return grid[row][col];
+    const double *bandBottom = bottomRow(grid, grid->data, 0, is_cyclic);
+    const double *bandTop = topRow(grid, grid->data, n - 1, is_cyclic);
+    updateBand(function, stencil, grid, 0, n, bandBottom, bandTop, is_cyclic, colour, rowSums);
 }
@@ -0,0 +1,599 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "grid_writer.h"
+#include "snapshot.h"
+
+#define TMP_SUFFIX ".tmp"
+#define ERROR 1
+#define SUCCESS 0
+
+/**
+ * the checkpoint thread writes copy while pending is set, the compute side only fills copy and
+ * state while it is clear. copy is NULL for a mapped grid, whose checkpoints the compute side
+ * writes itself. callSweeps, callStart and delta are the progress of the run before the current
+ * calculateGrid call, last is the time of the last checkpoint. directory is the directory of
+ * path, synced after the rename.
+ */
+struct Checkpointer
+{
+    char *path;
+    char *tmpPath;
+    char *directory;
+    unsigned int interval;
+    struct timespec last;
+    source_point *sources;
+    size_t numOfSources;
+    HeatGrid *copy;
+    CheckpointState state;
+    uint64_t callStart;
+    unsigned int callSweeps;
+    double delta;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int pending;
+    int stop;
+    int failed;
+};
+
+
+// ____________ functions _______________
+void *checkpointLoop(void *arg);
+
+int writeCheckpoint(const Checkpointer *checkpointer, const HeatGrid *grid);
+
+int syncDirectory(const char *directory);
+
+int writeAll(int fd, const unsigned char *bytes, size_t size);
+
+size_t sourcesSize(uint64_t numOfSources);
+
+void encodeCheckpointHeader(const CheckpointState *state, uint64_t numOfSources,
+                            unsigned char *out);
+
+int decodeCheckpointHeader(const unsigned char *in, size_t size, CheckpointState *state,
+                           uint64_t *numOfSources, size_t *headerSize);
+
+void freeCheckpointerMemory(Checkpointer *checkpointer);
+
+
+/**
+ * start the checkpoint thread. a checkpoint is first written to path with ".tmp" appended,
+ * synced, then renamed over path and the directory synced, so path always holds a whole
+ * checkpoint.
+ * @param path path of the checkpoint file
+ * @param interval least number of seconds between two checkpoints
+ * @param grid grid of the run. a grid in memory is copied by checkpointHook and written by the
+ *             thread, a mapped grid (see mapGrid) is written from its mapping by checkpointHook
+ *             itself, a copy of it would take as much memory as the grid
+ * @param sources the sources of the run, they are copied
+ * @param numOfSources number of sources
+ * @param state the mode of the run, sweeps and delta are where it starts
+ * @return new checkpointer, NULL if memory allocation or the thread creation went wrong
+ */
+Checkpointer *createCheckpointer(const char *path, unsigned int interval, const HeatGrid *grid,
+                                 const source_point *sources, size_t numOfSources,
+                                 const CheckpointState *state)
+{
+    Checkpointer *checkpointer = calloc(1, sizeof(Checkpointer));
+    if (!checkpointer)
+    {
+        return NULL;
+    }
+    size_t pathLen = strlen(path);
+    const char *slash = strrchr(path, '/');
+    // the directory of "name" is ".", of "/name" is "/"
+    size_t dirLen = !slash ? 1 : slash == path ? 1 : (size_t) (slash - path);
+    checkpointer->path = malloc(pathLen + 1);
+    checkpointer->tmpPath = malloc(pathLen + sizeof(TMP_SUFFIX));
+    checkpointer->directory = malloc(dirLen + 1);
+    // one extra source keeps malloc(0) from looking like a failure
+    checkpointer->sources = malloc(sizeof(source_point) * (numOfSources + 1));
+    checkpointer->copy = gridOnDisk(grid) ? NULL : buildGrid(grid->rows, grid->cols);
+    if (!checkpointer->path || !checkpointer->tmpPath || !checkpointer->directory ||
+        !checkpointer->sources || (!gridOnDisk(grid) && !checkpointer->copy))
+    {
+        freeCheckpointerMemory(checkpointer);
+        return NULL;
+    }
+    memcpy(checkpointer->path, path, pathLen + 1);
+    memcpy(checkpointer->tmpPath, path, pathLen);
+    memcpy(checkpointer->tmpPath + pathLen, TMP_SUFFIX, sizeof(TMP_SUFFIX));
+    memcpy(checkpointer->directory, slash ? path : ".", dirLen);
+    checkpointer->directory[dirLen] = '\0';
+    memcpy(checkpointer->sources, sources, sizeof(source_point) * numOfSources);
+    checkpointer->numOfSources = numOfSources;
+    checkpointer->interval = interval;
+    checkpointer->state = *state;
+    checkpointer->callStart = state->sweeps;
+    checkpointer->callSweeps = state->callSweeps;
+    checkpointer->delta = state->delta;
+    clock_gettime(CLOCK_MONOTONIC, &checkpointer->last);
+    pthread_mutex_init(&checkpointer->lock, NULL);
+    pthread_cond_init(&checkpointer->wake, NULL);
+    if (pthread_create(&checkpointer->thread, NULL, checkpointLoop, checkpointer) != 0)
+    {
+        pthread_cond_destroy(&checkpointer->wake);
+        pthread_mutex_destroy(&checkpointer->lock);
+        freeCheckpointerMemory(checkpointer);
+        return NULL;
+    }
+    return checkpointer;
+}
+
+/**
+ * tell the checkpointer a calculateGrid call starts
+ * @param checkpointer the checkpointer
+ * @param sweeps sweeps done since the start of the run
+ * @param callSweeps sweeps of the current n_iter call that were done before this call
+ * @param delta the last difference measured, -1 if none was
+ */
+void beginCheckpointCall(Checkpointer *checkpointer, uint64_t sweeps, unsigned int callSweeps,
+                         double delta)
+{
+    checkpointer->callStart = sweeps;
+    checkpointer->callSweeps = callSweeps;
+    checkpointer->delta = delta;
+}
+
+/**
+ * a sweep_hook: when interval seconds passed since the last checkpoint and the previous one
+ * was written, copy the grid and let the thread write it. never waits for the thread, but
+ * writes the checkpoint of a mapped grid before it returns.
+ * @param arg the Checkpointer
+ * @param grid grid of values
+ * @param sweeps number of sweeps done in this call
+ * @param diff the last difference measured in this call, -1 if none was measured yet
+ * @param relaxation state of a SOR call, NULL for any other call
+ */
+void checkpointHook(void *arg, const HeatGrid *grid, unsigned int sweeps, double diff,
+                    const Relaxation *relaxation)
+{
+    Checkpointer *checkpointer = arg;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double) (now.tv_sec - checkpointer->last.tv_sec) +
+                     (double) (now.tv_nsec - checkpointer->last.tv_nsec) / 1e9;
+    if (elapsed < checkpointer->interval)
+    {
+        return;
+    }
+    pthread_mutex_lock(&checkpointer->lock);
+    int busy = checkpointer->pending;
+    pthread_mutex_unlock(&checkpointer->lock);
+    if (busy)
+    {
+        // skip this one rather than hold up the sweeps, the next hook call tries again
+        return;
+    }
+
+    // the thread doesn't look at copy and state until pending is set
+    if (checkpointer->copy)
+    {
+        memcpy(checkpointer->copy->data, grid->data, sizeof(double) * grid->rows * grid->stride);
+    }
+    checkpointer->state.sweeps = checkpointer->callStart + sweeps;
+    checkpointer->state.callSweeps = checkpointer->callSweeps + sweeps;
+    checkpointer->state.delta = diff != -1 ? diff : checkpointer->delta;
+    memset(&checkpointer->state.relaxation, 0, sizeof(Relaxation));
+    if (relaxation)
+    {
+        checkpointer->state.relaxation = *relaxation;
+    }
+    checkpointer->last = now;
+
+    if (!checkpointer->copy)
+    {
+        int result = writeCheckpoint(checkpointer, grid);
+        pthread_mutex_lock(&checkpointer->lock);
+        checkpointer->failed |= result == ERROR;
+        pthread_mutex_unlock(&checkpointer->lock);
+        return;
+    }
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->pending = 1;
+    pthread_cond_signal(&checkpointer->wake);
+    pthread_mutex_unlock(&checkpointer->lock);
+}
+
+/**
+ * wait for the checkpoint being written, stop the thread and free the checkpointer
+ * @param checkpointer the checkpointer, may be NULL
+ * @return 0 if succeeded, 1 if a checkpoint could not be written
+ */
+int freeCheckpointer(Checkpointer *checkpointer)
+{
+    if (!checkpointer)
+    {
+        return SUCCESS;
+    }
+    pthread_mutex_lock(&checkpointer->lock);
+    checkpointer->stop = 1;
+    pthread_cond_signal(&checkpointer->wake);
+    pthread_mutex_unlock(&checkpointer->lock);
+    pthread_join(checkpointer->thread, NULL);
+    pthread_cond_destroy(&checkpointer->wake);
+    pthread_mutex_destroy(&checkpointer->lock);
+    int failed = checkpointer->failed;
+    freeCheckpointerMemory(checkpointer);
+    return failed ? ERROR : SUCCESS;
+}
+
+/**
+ * body of the checkpoint thread, writes the pending checkpoint until it is stopped and nothing
+ * is pending
+ * @param arg the Checkpointer
+ * @return NULL
+ */
+void *checkpointLoop(void *arg)
+{
+    Checkpointer *checkpointer = arg;
+    while (1)
+    {
+        pthread_mutex_lock(&checkpointer->lock);
+        while (!checkpointer->pending && !checkpointer->stop)
+        {
+            pthread_cond_wait(&checkpointer->wake, &checkpointer->lock);
+        }
+        if (!checkpointer->pending)
+        {
+            pthread_mutex_unlock(&checkpointer->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&checkpointer->lock);
+
+        int result = writeCheckpoint(checkpointer, checkpointer->copy);
+
+        pthread_mutex_lock(&checkpointer->lock);
+        if (result == ERROR)
+        {
+            checkpointer->failed = 1;
+        }
+        checkpointer->pending = 0;
+        pthread_mutex_unlock(&checkpointer->lock);
+    }
+}
+
+/**
+ * write a grid to the temporary file, sync it, rename it over the checkpoint and sync the
+ * directory
+ * @param checkpointer the checkpointer
+ * @param grid the copied grid, or the mapped grid of the run
+ * @return 0 if succeeded, 1 otherwise
+ */
+int writeCheckpoint(const Checkpointer *checkpointer, const HeatGrid *grid)
+{
+    size_t size = CHECKPOINT_HEADER_SIZE + sourcesSize(checkpointer->numOfSources);
+    unsigned char *bytes = calloc(size, 1);
+    if (!bytes)
+    {
+        return ERROR;
+    }
+    encodeCheckpointHeader(&checkpointer->state, checkpointer->numOfSources, bytes);
+    unsigned char *out = bytes + CHECKPOINT_HEADER_SIZE;
+    for (size_t i = 0; i < checkpointer->numOfSources; i++, out += CHECKPOINT_SOURCE_SIZE)
+    {
+        const source_point *source = &checkpointer->sources[i];
+        putLittle32(out, (uint32_t) source->x);
+        putLittle32(out + 4, (uint32_t) source->y);
+        encodeSnapshotValue(source->value, SNAPSHOT_FLOAT64, out + 8);
+    }
+
+    int fd = open(checkpointer->tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        free(bytes);
+        return ERROR;
+    }
+    int result = writeAll(fd, bytes, size);
+    free(bytes);
+    GridWriter *writer = createWriter(fd, WRITER_CAPACITY, OUTPUT_BINARY);
+    if (!writer)
+    {
+        result = ERROR;
+    }
+    else
+    {
+        writeGrid(writer, grid, checkpointer->state.delta, checkpointer->state.sweeps);
+        if (flushWriter(writer) == ERROR)
+        {
+            result = ERROR;
+        }
+        freeWriter(writer);
+    }
+    // the data has to be on the disk before the rename makes it the checkpoint
+    if (fsync(fd) != 0)
+    {
+        result = ERROR;
+    }
+    if (close(fd) != 0)
+    {
+        result = ERROR;
+    }
+    if (result == ERROR || rename(checkpointer->tmpPath, checkpointer->path) != 0)
+    {
+        unlink(checkpointer->tmpPath);
+        return ERROR;
+    }
+    // a crash before the directory is on the disk could still lose the rename
+    return syncDirectory(checkpointer->directory);
+}
+
+/**
+ * @param directory path of a directory
+ * @return 0 if its entries are on the disk, 1 otherwise. a file system that can't sync a
+ *         directory counts as synced
+ */
+int syncDirectory(const char *directory)
+{
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return ERROR;
+    }
+    int result = fsync(fd) != 0 && errno != EINVAL ? ERROR : SUCCESS;
+    if (close(fd) != 0)
+    {
+        result = ERROR;
+    }
+    return result;
+}
+
+/**
+ * @param fd file descriptor
+ * @param bytes bytes to write
+ * @param size number of bytes
+ * @return 0 if all of them were written, 1 otherwise
+ */
+int writeAll(int fd, const unsigned char *bytes, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0)
+        {
+            return ERROR;
+        }
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @param numOfSources number of sources
+ * @return size of the sources with the padding, 0 if it doesn't fit a size_t
+ */
+size_t sourcesSize(uint64_t numOfSources)
+{
+    if (numOfSources > (SIZE_MAX - SNAPSHOT_ALIGNMENT) / CHECKPOINT_SOURCE_SIZE)
+    {
+        return 0;
+    }
+    size_t size = (size_t) numOfSources * CHECKPOINT_SOURCE_SIZE;
+    return (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+/**
+ * @param state the mode and progress of the run
+ * @param numOfSources number of sources
+ * @param out CHECKPOINT_HEADER_SIZE bytes to write the header to
+ */
+void encodeCheckpointHeader(const CheckpointState *state, uint64_t numOfSources,
+                            unsigned char *out)
+{
+    uint64_t terminateBits, omegaBits, refBits, worthBits, edgeBits;
+    memcpy(&terminateBits, &state->terminate, sizeof(terminateBits));
+    memcpy(&edgeBits, &state->edgeValue, sizeof(edgeBits));
+    memcpy(&omegaBits, &state->relaxation.omega, sizeof(omegaBits));
+    memcpy(&refBits, &state->relaxation.refDiff, sizeof(refBits));
+    memcpy(&worthBits, &state->relaxation.gaussSeidel, sizeof(worthBits));
+    memset(out, 0, CHECKPOINT_HEADER_SIZE);
+    memcpy(out, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    putLittle32(out + 8, CHECKPOINT_VERSION);
+    putLittle32(out + 12, (uint32_t) state->order);
+    putLittle32(out + 16, state->n_iter);
+    putLittle32(out + 20, (uint32_t) state->is_cyclic);
+    putLittle32(out + 24, state->checkEvery);
+    putLittle32(out + 28, state->threads);
+    putLittle32(out + 32, state->callSweeps);
+    putLittle32(out + 36, (uint32_t) state->solver);
+    putLittle64(out + 40, terminateBits);
+    putLittle64(out + 48, numOfSources);
+    putLittle64(out + 56, omegaBits);
+    putLittle64(out + 64, refBits);
+    putLittle32(out + 72, state->relaxation.refAge);
+    putLittle32(out + 76, (uint32_t) state->relaxation.settled);
+    putLittle64(out + 80, worthBits);
+    putLittle32(out + 88, (uint32_t) state->edges);
+    putLittle64(out + 96, edgeBits);
+}
+
+/**
+ * @param in the first bytes of a checkpoint
+ * @param size number of bytes
+ * @param state put the mode of the run and callSweeps here, the fields an older version doesn't
+ *              have get the defaults of a run from an input file
+ * @param numOfSources put the number of sources here
+ * @param headerSize put the size of the header of the version here
+ * @return 0 if succeeded, 1 if the bytes aren't a valid header of a known version
+ */
+int decodeCheckpointHeader(const unsigned char *in, size_t size, CheckpointState *state,
+                           uint64_t *numOfSources, size_t *headerSize)
+{
+    if (size < CHECKPOINT_V1_HEADER_SIZE ||
+        memcmp(in, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0)
+    {
+        return ERROR;
+    }
+    uint32_t version = getLittle32(in + 8);
+    *headerSize = version == 1 ? CHECKPOINT_V1_HEADER_SIZE : CHECKPOINT_HEADER_SIZE;
+    if (version < 1 || version > CHECKPOINT_VERSION || size < *headerSize)
+    {
+        return ERROR;
+    }
+    uint32_t order = getLittle32(in + 12), solver = getLittle32(in + 36);
+    uint32_t edges = version >= 3 ? getLittle32(in + 88) : EDGE_DIRICHLET;
+    if ((order != ORDER_RASTER && order != ORDER_RED_BLACK && order != ORDER_JACOBI) ||
+        (solver != SOLVER_RELAX && solver != SOLVER_MULTIGRID && solver != SOLVER_SOR) ||
+        (edges != EDGE_DIRICHLET && edges != EDGE_NEUMANN))
+    {
+        return ERROR;
+    }
+    state->order = (UpdateOrder) order;
+    state->solver = (Solver) solver;
+    state->edges = (EdgeKind) edges;
+    state->n_iter = getLittle32(in + 16);
+    state->is_cyclic = (int) getLittle32(in + 20);
+    state->checkEvery = getLittle32(in + 24);
+    state->threads = getLittle32(in + 28);
+    state->callSweeps = getLittle32(in + 32);
+    uint64_t terminateBits = getLittle64(in + 40);
+    memcpy(&state->terminate, &terminateBits, sizeof(terminateBits));
+    *numOfSources = getLittle64(in + 48);
+    memset(&state->relaxation, 0, sizeof(Relaxation));
+    state->edgeValue = 0;
+    if (version >= 2)
+    {
+        uint64_t omegaBits = getLittle64(in + 56), refBits = getLittle64(in + 64);
+        uint64_t worthBits = getLittle64(in + 80);
+        memcpy(&state->relaxation.omega, &omegaBits, sizeof(omegaBits));
+        memcpy(&state->relaxation.refDiff, &refBits, sizeof(refBits));
+        memcpy(&state->relaxation.gaussSeidel, &worthBits, sizeof(worthBits));
+        state->relaxation.refAge = getLittle32(in + 72);
+        state->relaxation.settled = getLittle32(in + 76) != 0;
+    }
+    if (version >= 3)
+    {
+        uint64_t edgeBits = getLittle64(in + 96);
+        memcpy(&state->edgeValue, &edgeBits, sizeof(edgeBits));
+    }
+    if (state->relaxation.omega != 0 &&
+        !(state->relaxation.omega >= 1 && state->relaxation.omega < 2))
+    {
+        return ERROR;
+    }
+    if (state->checkEvery == 0 || state->threads == 0 ||
+        (state->n_iter > 0 && state->callSweeps >= state->n_iter))
+    {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * read a checkpoint, the grid gets the values, the pinned sources and the edges of the checkpoint
+ * @param path path of the checkpoint file
+ * @param directory directory of the scratch file of a mapped grid (see mapGrid), NULL for a grid
+ *                  in memory
+ * @param shared 1 to keep a grid in memory shared with worker processes (see shareGrid)
+ * @param grid put the new grid here
+ * @param sources put the new sources here
+ * @param numOfSources put the number of sources here
+ * @param state put the mode and the progress of the run here
+ * @return 0 if succeeded, 1 if the file is not a checkpoint or memory allocation went wrong
+ */
+int readCheckpoint(const char *path, const char *directory, int shared, HeatGrid **grid,
+                   source_point **sources, size_t *numOfSources, CheckpointState *state)
+{
+    SnapshotFile file;
+    if (openSnapshots(path, &file) == ERROR)
+    {
+        return ERROR;
+    }
+    uint64_t count = 0;
+    size_t headerSize = 0;
+    if (decodeCheckpointHeader(file.map, file.size, state, &count, &headerSize) == ERROR)
+    {
+        closeSnapshots(&file);
+        return ERROR;
+    }
+    size_t size = sourcesSize(count);
+    if ((size == 0 && count > 0) || size > file.size - headerSize)
+    {
+        closeSnapshots(&file);
+        return ERROR;
+    }
+    // the grid is the snapshot after the sources
+    file.offset = headerSize + size;
+    Snapshot snapshot;
+    if (nextSnapshot(&file, &snapshot) != SNAPSHOT_READ ||
+        snapshot.header.type != SNAPSHOT_FLOAT64 || snapshot.header.rows > SIZE_MAX ||
+        snapshot.header.cols > SIZE_MAX)
+    {
+        closeSnapshots(&file);
+        return ERROR;
+    }
+    state->sweeps = snapshot.header.sweeps;
+    state->delta = snapshot.header.delta;
+
+    size_t rows = (size_t) snapshot.header.rows, cols = (size_t) snapshot.header.cols;
+    HeatGrid *newGrid = directory ? mapGrid(directory, rows, cols) :
+                        shared ? shareGrid(rows, cols) : buildGrid(rows, cols);
+    source_point *newSources = malloc(sizeof(source_point) * ((size_t) count + 1));
+    if (!newGrid || !newSources)
+    {
+        freeGrid(newGrid);
+        free(newSources);
+        closeSnapshots(&file);
+        return ERROR;
+    }
+    for (size_t i = 0; i < newGrid->rows; i++)
+    {
+        for (size_t j = 0; j < newGrid->cols; j++)
+        {
+            GRID_AT(newGrid, i, j) = snapshotValue(&snapshot, i, j);
+        }
+    }
+    const unsigned char *in = file.map + headerSize;
+    int result = SUCCESS;
+    for (size_t i = 0; i < (size_t) count; i++, in += CHECKPOINT_SOURCE_SIZE)
+    {
+        newSources[i].x = (int) getLittle32(in);
+        newSources[i].y = (int) getLittle32(in + 4);
+        uint64_t valueBits = getLittle64(in + 8);
+        memcpy(&newSources[i].value, &valueBits, sizeof(valueBits));
+        if (newSources[i].x < 0 || (size_t) newSources[i].x >= newGrid->rows ||
+            newSources[i].y < 0 || (size_t) newSources[i].y >= newGrid->cols)
+        {
+            result = ERROR;
+        }
+    }
+    closeSnapshots(&file);
+    if (result == ERROR || pinSources(newGrid, newSources, (size_t) count) == ERROR ||
+        setEdges(newGrid, state->edges, state->edgeValue) == ERROR)
+    {
+        freeGrid(newGrid);
+        free(newSources);
+        return ERROR;
+    }
+    *grid = newGrid;
+    *sources = newSources;
+    *numOfSources = (size_t) count;
+    return SUCCESS;
+}
+
+/**
+ * free the memory of a checkpointer whose thread is not running
+ * @param checkpointer the checkpointer
+ */
+void freeCheckpointerMemory(Checkpointer *checkpointer)
+{
+    free(checkpointer->path);
+    free(checkpointer->tmpPath);
+    free(checkpointer->directory);
+    free(checkpointer->sources);
+    freeGrid(checkpointer->copy);
+    free(checkpointer);
+}
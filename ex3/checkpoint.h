@@ -0,0 +1,127 @@
+/**
+ * @author Idan Yamin
+ * @brief checkpoints of a run, written periodically by a thread of their own and read back to
+ * continue the run where the checkpoint was taken.
+ * a checkpoint file is a CHECKPOINT_HEADER_SIZE bytes header, the sources, and a float64
+ * snapshot of the grid (see snapshot.h) whose sweeps and difference are those of the run.
+ * header layout, all fields little-endian:
+ * bytes 0-7 CHECKPOINT_MAGIC, 8-11 version, 12-15 update order, 16-19 n_iter, 20-23 is_cyclic,
+ * 24-27 checkEvery, 28-31 threads, 32-35 sweeps done in the current calculateGrid call,
+ * 36-39 solver, 40-47 terminate (float64), 48-55 number of sources, 56-63 omega of a SOR run
+ * (float64, 0 for any other run), 64-71 its reference difference (float64), 72-75 the age of the
+ * reference, 76-79 1 if omega settled, 80-87 the Gauss-Seidel sweeps the run is worth (float64),
+ * 88-91 kind of the edges, 92-95 zero, 96-103 value of a Dirichlet edge (float64), 104-127 zero.
+ * every source is CHECKPOINT_SOURCE_SIZE bytes: x and y (int32) and the value (float64), the
+ * sources are zero padded to a multiple of SNAPSHOT_ALIGNMENT bytes.
+ * older checkpoints are still read: version 2 has no edges and resumes with zero Dirichlet
+ * edges, version 1 has a CHECKPOINT_V1_HEADER_SIZE bytes header that ends after the number of
+ * sources, with 36-39 1 for a multigrid run, and resumes without a SOR state either.
+ */
+
+#ifndef EX3_CHECKPOINT_H
+#define EX3_CHECKPOINT_H
+
+#include <stdint.h>
+#include "grid_calculator.h"
+#include "heat_grid.h"
+
+// first bytes of every checkpoint, with the terminating '\0'
+#define CHECKPOINT_MAGIC "EX3CKPT"
+#define CHECKPOINT_MAGIC_SIZE 8
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_HEADER_SIZE 128
+#define CHECKPOINT_V1_HEADER_SIZE 64
+#define CHECKPOINT_SOURCE_SIZE 16
+
+/**
+ * the mode of a run and how far it got
+ * sweeps: sweeps done since the start of the run
+ * callSweeps: sweeps done in the current calculateGrid call, with n_iter > 0 the run goes on
+ *             with a call of n_iter - callSweeps sweeps
+ * delta: the last difference measured, -1 if none was
+ * relaxation: where a SOR call got to (see setRelaxation), omega is 0 when it isn't one
+ * edges, edgeValue: what lies past the edges of a grid that isn't cyclic (see setEdges)
+ */
+typedef struct CheckpointState
+{
+    double terminate;
+    unsigned int n_iter;
+    int is_cyclic;
+    UpdateOrder order;
+    unsigned int checkEvery;
+    Solver solver;
+    unsigned int threads;
+    uint64_t sweeps;
+    unsigned int callSweeps;
+    double delta;
+    Relaxation relaxation;
+    EdgeKind edges;
+    double edgeValue;
+} CheckpointState;
+
+typedef struct Checkpointer Checkpointer;
+
+/**
+ * start the checkpoint thread. a checkpoint is first written to path with ".tmp" appended,
+ * synced, then renamed over path and the directory synced, so path always holds a whole
+ * checkpoint.
+ * @param path path of the checkpoint file
+ * @param interval least number of seconds between two checkpoints
+ * @param grid grid of the run. a grid in memory is copied by checkpointHook and written by the
+ *             thread, a mapped grid (see mapGrid) is written from its mapping by checkpointHook
+ *             itself, a copy of it would take as much memory as the grid
+ * @param sources the sources of the run, they are copied
+ * @param numOfSources number of sources
+ * @param state the mode of the run, sweeps and delta are where it starts
+ * @return new checkpointer, NULL if memory allocation or the thread creation went wrong
+ */
+Checkpointer *createCheckpointer(const char *path, unsigned int interval, const HeatGrid *grid,
+                                 const source_point *sources, size_t numOfSources,
+                                 const CheckpointState *state);
+
+/**
+ * tell the checkpointer a calculateGrid call starts
+ * @param checkpointer the checkpointer
+ * @param sweeps sweeps done since the start of the run
+ * @param callSweeps sweeps of the current n_iter call that were done before this call
+ * @param delta the last difference measured, -1 if none was
+ */
+void beginCheckpointCall(Checkpointer *checkpointer, uint64_t sweeps, unsigned int callSweeps,
+                         double delta);
+
+/**
+ * a sweep_hook: when interval seconds passed since the last checkpoint and the previous one
+ * was written, copy the grid and let the thread write it. never waits for the thread, but
+ * writes the checkpoint of a mapped grid before it returns.
+ * @param arg the Checkpointer
+ * @param grid grid of values
+ * @param sweeps number of sweeps done in this call
+ * @param diff the last difference measured in this call, -1 if none was measured yet
+ * @param relaxation state of a SOR call, NULL for any other call
+ */
+void checkpointHook(void *arg, const HeatGrid *grid, unsigned int sweeps, double diff,
+                    const Relaxation *relaxation);
+
+/**
+ * wait for the checkpoint being written, stop the thread and free the checkpointer
+ * @param checkpointer the checkpointer, may be NULL
+ * @return 0 if succeeded, 1 if a checkpoint could not be written
+ */
+int freeCheckpointer(Checkpointer *checkpointer);
+
+/**
+ * read a checkpoint, the grid gets the values, the pinned sources and the edges of the checkpoint
+ * @param path path of the checkpoint file
+ * @param directory directory of the scratch file of a mapped grid (see mapGrid), NULL for a grid
+ *                  in memory
+ * @param shared 1 to keep a grid in memory shared with worker processes (see shareGrid)
+ * @param grid put the new grid here
+ * @param sources put the new sources here
+ * @param numOfSources put the number of sources here
+ * @param state put the mode and the progress of the run here
+ * @return 0 if succeeded, 1 if the file is not a checkpoint or memory allocation went wrong
+ */
+int readCheckpoint(const char *path, const char *directory, int shared, HeatGrid **grid,
+                   source_point **sources, size_t *numOfSources, CheckpointState *state);
+
+#endif //EX3_CHECKPOINT_H
@@ -0,0 +1,464 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "float_grid.h"
+#include "sweep.h"
+
+#if defined(__GNUC__) && defined(__SSE__)
+#define FLOAT_MXCSR 1
+#include <xmmintrin.h>
+// flush to zero and denormals are zero bits of the MXCSR register
+#define FLUSH_SUBNORMALS 0x8040u
+#endif
+
+#define FLOATS_PER_LINE (GRID_ALIGNMENT / sizeof(float))
+
+/**
+ * a float row being updated together with its neighbour rows, like RowView
+ */
+typedef struct FloatRow
+{
+    float *out;
+    const float *values;
+    const float *bottom;
+    const float *top;
+    size_t cols;
+    const size_t *pinned;
+    size_t numPinned;
+    int parity;
+    const StencilWeights *weights;
+    EdgeKind edges;
+    float edgeValue;
+} FloatRow;
+
+
+// ____________ functions _______________
+void updateFloatRow(const FloatRow *row, int is_cyclic);
+
+void updateFloatRange(const FloatRow *row, size_t from, size_t to, int vector);
+
+void updateFloatEdge(const FloatRow *row, size_t j, int is_cyclic);
+
+void updateFloatSegment(const FloatRow *row, size_t from, size_t to);
+
+void updateFloatVector(const FloatRow *row, size_t from, size_t to);
+
+void floatRowView(const FloatGrid *floats, const float *buffer, size_t i, int is_cyclic,
+                  FloatRow *row);
+
+double floatRowHeat(const float *row, size_t cols);
+
+unsigned int flushSubnormals(void);
+
+void restoreSubnormals(unsigned int state);
+
+
+/**
+ * copy a grid to float, every value rounded to the nearest float
+ * @param grid the grid, it must outlive the copy and keep its pinned cells and edges
+ * @param spare 1 to give the copy a spare buffer for Jacobi sweeps, 0 otherwise
+ * @return new copy, NULL if memory allocation went wrong
+ */
+FloatGrid *createFloatGrid(const HeatGrid *grid, int spare)
+{
+    size_t rows = grid->rows, cols = grid->cols;
+    if (cols > SIZE_MAX - FLOATS_PER_LINE)
+    {
+        return NULL;
+    }
+    size_t stride = (cols + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE;
+    size_t header = (sizeof(FloatGrid) + GRID_ALIGNMENT - 1) / GRID_ALIGNMENT * GRID_ALIGNMENT;
+    size_t buffers = spare ? 2 : 1;
+    if (stride != 0 && rows + 1 > (SIZE_MAX - header) / sizeof(float) / stride / buffers)
+    {
+        return NULL;
+    }
+    // the rows are whole cache lines, so the header, every buffer and the ghost row keep the
+    // alignment
+    size_t size = rows * stride * sizeof(float), ghost = stride * sizeof(float);
+    unsigned char *block = aligned_alloc(GRID_ALIGNMENT, header + buffers * size + ghost);
+    if (!block)
+    {
+        return NULL;
+    }
+    FloatGrid *floats = (FloatGrid *) block;
+    floats->data = (float *) (block + header);
+    floats->spare = spare ? (float *) (block + header + size) : NULL;
+    floats->rows = rows;
+    floats->cols = cols;
+    floats->stride = stride;
+    floats->ghost = (float *) (block + header + buffers * size);
+    floats->source = grid;
+    for (size_t j = 0; j < stride; j++)
+    {
+        floats->ghost[j] = (float) grid->edgeValue;
+    }
+    for (size_t i = 0; i < rows; i++)
+    {
+        const double *from = GRID_ROW(grid, i);
+        float *to = FLOAT_ROW(floats, i);
+        for (size_t j = 0; j < cols; j++)
+        {
+            to[j] = (float) from[j];
+        }
+        memset(to + cols, 0, (stride - cols) * sizeof(float));
+    }
+    if (spare)
+    {
+        memcpy(floats->spare, floats->data, size);
+    }
+    return floats;
+}
+
+/**
+ * copy the free cells of the float copy back to the grid it was copied from, the pinned cells
+ * keep their double values
+ * @param floats the copy
+ * @param grid the grid it was copied from
+ */
+void storeFloatGrid(const FloatGrid *floats, HeatGrid *grid)
+{
+    for (size_t i = 0; i < floats->rows; i++)
+    {
+        const float *from = FLOAT_ROW(floats, i);
+        double *to = GRID_ROW(grid, i);
+        const size_t *pinned = pinnedRowCols(grid, i);
+        size_t numPinned = pinnedInRow(grid, i), k = 0;
+        for (size_t j = 0; j < floats->cols; j++)
+        {
+            if (k < numPinned && pinned[k] == j)
+            {
+                k++;
+                continue;
+            }
+            to[j] = from[j];
+        }
+    }
+}
+
+/**
+ * one pass over the rows in raster order in place, the way updateBand sweeps a whole grid
+ * @param floats the copy
+ * @param weights weights of the stencil, rounded to float
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, rowSums[i] gets the heat of row i right after it was updated
+ */
+void sweepFloatGrid(FloatGrid *floats, const StencilWeights *weights, const int is_cyclic,
+                    const int colour, double *rowSums)
+{
+    unsigned int state = flushSubnormals();
+    for (size_t i = 0; i < floats->rows; i++)
+    {
+        FloatRow row;
+        floatRowView(floats, floats->data, i, is_cyclic, &row);
+        row.out = FLOAT_ROW(floats, i);
+        row.parity = colour == ALL_COLOURS ? ALL_COLOURS : (int) ((i + (size_t) colour) % 2);
+        row.weights = weights;
+        updateFloatRow(&row, is_cyclic);
+        if (rowSums)
+        {
+            rowSums[i] = floatRowHeat(row.out, row.cols);
+        }
+    }
+    restoreSubnormals(state);
+}
+
+/**
+ * Jacobi sweep from data to spare, then the buffers swap
+ * @param floats the copy, with a spare buffer
+ * @param weights weights of the stencil, rounded to float
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void sweepFloatJacobi(FloatGrid *floats, const StencilWeights *weights, const int is_cyclic,
+                      double *rowSums)
+{
+    unsigned int state = flushSubnormals();
+    for (size_t i = 0; i < floats->rows; i++)
+    {
+        FloatRow row;
+        floatRowView(floats, floats->data, i, is_cyclic, &row);
+        row.out = floats->spare + i * floats->stride;
+        row.parity = ALL_COLOURS;
+        row.weights = weights;
+        updateFloatRow(&row, is_cyclic);
+        if (rowSums)
+        {
+            rowSums[i] = floatRowHeat(row.out, row.cols);
+        }
+    }
+    restoreSubnormals(state);
+    float *swap = floats->data;
+    floats->data = floats->spare;
+    floats->spare = swap;
+}
+
+/**
+ * @param floats the copy
+ * @return the sum of its values, in double and row by row like sumRows
+ */
+double floatHeat(const FloatGrid *floats)
+{
+    double sum = 0;
+    for (size_t i = 0; i < floats->rows; i++)
+    {
+        sum += floatRowHeat(FLOAT_ROW(floats, i), floats->cols);
+    }
+    return sum;
+}
+
+/**
+ * free a copy
+ * @param floats the copy, may be NULL
+ */
+void freeFloatGrid(FloatGrid *floats)
+{
+    free(floats);
+}
+
+/**
+ * update one float row the way updateRow updates a row with a stencil: the edge columns with
+ * the cells past them, the interior cells through the vectorized kernels when both neighbour
+ * rows exist (in raster order only without a center term), or else cell by cell.
+ * @param row the row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateFloatRow(const FloatRow *row, const int is_cyclic)
+{
+    size_t m = row->cols;
+    if (m == 0)
+    {
+        return;
+    }
+    int inPlaceRaster = row->out == row->values && row->parity == ALL_COLOURS;
+    int vectorized = !inPlaceRaster || (float) row->weights->center == 0;
+    updateFloatEdge(row, 0, is_cyclic);
+    if (m > 2)
+    {
+        updateFloatRange(row, 1, m - 1, vectorized && row->bottom && row->top);
+    }
+    if (m > 1)
+    {
+        updateFloatEdge(row, m - 1, is_cyclic);
+    }
+}
+
+/**
+ * update the free interior cells of columns from..to-1 of a float row, the pinned cells split it
+ * into segments
+ * @param row the row
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ * @param vector 1 for the vectorized kernels, 0 for cell by cell
+ */
+void updateFloatRange(const FloatRow *row, size_t from, const size_t to, const int vector)
+{
+    size_t k = 0;
+    while (k < row->numPinned && row->pinned[k] < from)
+    {
+        k++;
+    }
+    while (from < to)
+    {
+        size_t end = (k < row->numPinned && row->pinned[k] < to) ? row->pinned[k] : to;
+        if (vector)
+        {
+            updateFloatVector(row, from, end);
+        }
+        else
+        {
+            updateFloatSegment(row, from, end);
+        }
+        from = end + 1;
+        k++;
+    }
+}
+
+/**
+ * update the first or the last column of a float row like updateEdgeCell, unless it is pinned
+ * or of the other parity
+ * @param row the row
+ * @param j the column, 0 or cols - 1
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateFloatEdge(const FloatRow *row, const size_t j, const int is_cyclic)
+{
+    size_t last = row->cols - 1;
+    int pinned = row->numPinned > 0 && row->pinned[j == 0 ? 0 : row->numPinned - 1] == j;
+    if (pinned || (row->parity != ALL_COLOURS && (j & 1) != (size_t) row->parity))
+    {
+        return;
+    }
+    const float *values = row->values;
+    float left, right;
+    if (is_cyclic)
+    {
+        left = values[j > 0 ? j - 1 : last];
+        right = values[j < last ? j + 1 : 0];
+    }
+    else
+    {
+        float past = row->edges == EDGE_NEUMANN ? values[j] : row->edgeValue;
+        left = j > 0 ? values[j - 1] : past;
+        right = j < last ? values[j + 1] : past;
+    }
+    float top = row->top ? row->top[j] : 0, bottom = row->bottom ? row->bottom[j] : 0;
+    float center = (float) row->weights->center, neighbour = (float) row->weights->neighbour;
+    float updated = neighbour * ((left + right) + (top + bottom));
+    row->out[j] = center != 0 ? updated + center * values[j] : updated;
+}
+
+/**
+ * update of the free interior cells from..to-1 of a float row (of the row parity) cell by cell
+ * @param row the row
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ */
+void updateFloatSegment(const FloatRow *row, const size_t from, const size_t to)
+{
+    const float *values = row->values, *bottom = row->bottom, *top = row->top;
+    float center = (float) row->weights->center, neighbour = (float) row->weights->neighbour;
+    size_t j = from, step = 1;
+    if (row->parity != ALL_COLOURS)
+    {
+        j += (from & 1) != (size_t) row->parity;
+        step = 2;
+    }
+    for (; j < to; j += step)
+    {
+        float vertical = (top ? top[j] : 0) + (bottom ? bottom[j] : 0);
+        float updated = neighbour * ((values[j - 1] + values[j + 1]) + vertical);
+        row->out[j] = center != 0 ? updated + center * values[j] : updated;
+    }
+}
+
+/**
+ * stencil update of the interior cells from..to-1 of a float row with the float kernel of the
+ * kind of update the row describes, like updateFastSegment
+ * @param row the row, both neighbour rows must exist
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ */
+void updateFloatVector(const FloatRow *row, const size_t from, const size_t to)
+{
+    if (row->out != row->values)
+    {
+        stencilJacobiUpdateFloat(row->out, row->values, row->bottom, row->top, from, to,
+                                 row->weights);
+    }
+    else if (row->parity != ALL_COLOURS)
+    {
+        stencilColourUpdateFloat(row->out, row->bottom, row->top, from, to, row->parity,
+                                 row->weights);
+    }
+    else
+    {
+        float *values = row->out, weight = (float) row->weights->neighbour;
+        float vertical[VERTICAL_CHUNK];
+        for (size_t j = from; j < to; j += VERTICAL_CHUNK)
+        {
+            size_t count = to - j < VERTICAL_CHUNK ? to - j : VERTICAL_CHUNK;
+            verticalSumsFloat(vertical, row->bottom + j, row->top + j, count);
+            for (size_t k = 0; k < count; k++)
+            {
+                values[j + k] = weight * ((values[j + k - 1] + values[j + k + 1]) + vertical[k]);
+            }
+        }
+    }
+}
+
+/**
+ * fill in the values, neighbour rows, pinned cells and edges of row i of a float copy
+ * @param floats the copy
+ * @param buffer the buffer the row is read from, the rows before it already updated in place
+ * @param i the row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param row the row to fill in
+ */
+void floatRowView(const FloatGrid *floats, const float *buffer, const size_t i,
+                  const int is_cyclic, FloatRow *row)
+{
+    size_t n = floats->rows, stride = floats->stride;
+    // past the edge rows like bottomRow and topRow, the ghost row holds the Dirichlet value
+    int neumann = floats->source->edges == EDGE_NEUMANN;
+    row->values = buffer + i * stride;
+    if (i > 0)
+    {
+        row->bottom = buffer + (i - 1) * stride;
+    }
+    else if (is_cyclic)
+    {
+        row->bottom = buffer + (n - 1) * stride;
+    }
+    else
+    {
+        row->bottom = neumann ? row->values : floats->ghost;
+    }
+    if (i + 1 < n)
+    {
+        row->top = buffer + (i + 1) * stride;
+    }
+    else if (is_cyclic)
+    {
+        row->top = buffer;
+    }
+    else
+    {
+        row->top = neumann ? row->values : floats->ghost;
+    }
+    row->cols = floats->cols;
+    row->pinned = pinnedRowCols(floats->source, i);
+    row->numPinned = pinnedInRow(floats->source, i);
+    row->edges = floats->source->edges;
+    row->edgeValue = (float) floats->source->edgeValue;
+}
+
+/**
+ * @param row a float row
+ * @param cols number of values in the row
+ * @return the sum of the values of the row, added in double
+ */
+double floatRowHeat(const float *row, const size_t cols)
+{
+    double sum = 0;
+    for (size_t j = 0; j < cols; j++)
+    {
+        sum += row[j];
+    }
+    return sum;
+}
+
+/**
+ * make the float arithmetic of the calling thread flush subnormal values to zero. heat fades
+ * through them far from the sources, 2^-126 is reached some 60 cells away, and every operation
+ * on one takes a slow path of the cpu.
+ * @return the state to give restoreSubnormals
+ */
+unsigned int flushSubnormals(void)
+{
+#ifdef FLOAT_MXCSR
+    unsigned int state = _mm_getcsr();
+    _mm_setcsr(state | FLUSH_SUBNORMALS);
+    return state;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * undo flushSubnormals
+ * @param state the state flushSubnormals returned
+ */
+void restoreSubnormals(unsigned int state)
+{
+#ifdef FLOAT_MXCSR
+    _mm_setcsr(state);
+#else
+    (void) state;
+#endif
+}
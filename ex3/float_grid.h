@@ -0,0 +1,87 @@
+/**
+ * @author Idan Yamin
+ * @brief float32 copy of a HeatGrid, swept by the float stencil kernels: half the bytes per cell
+ * to read from memory and keep in cache, twice the cells per vector instruction. the heat of the
+ * rows is still summed in double.
+ */
+
+#ifndef EX3_FLOAT_GRID_H
+#define EX3_FLOAT_GRID_H
+
+#include <stddef.h>
+#include "heat_grid.h"
+#include "stencil.h"
+
+/**
+ * float copy of a grid, rows x cols values, row i starts at data + i * stride, every row padded
+ * to a whole number of cache lines. spare is the second buffer of a Jacobi sweep, NULL when it
+ * was not asked for. the pinned cells and the edges are those of source, the grid it was copied
+ * from, ghost the row of its Dirichlet edge value read past the first and last rows.
+ * the struct and the buffers live in one allocation.
+ */
+typedef struct FloatGrid
+{
+    float *data;
+    float *spare;
+    size_t rows;
+    size_t cols;
+    size_t stride;
+    float *ghost;
+    const HeatGrid *source;
+} FloatGrid;
+
+/**
+ * pointer to the first value of row i
+ */
+#define FLOAT_ROW(floats, i) ((floats)->data + (size_t)(i) * (floats)->stride)
+
+/**
+ * copy a grid to float, every value rounded to the nearest float
+ * @param grid the grid, it must outlive the copy and keep its pinned cells and edges
+ * @param spare 1 to give the copy a spare buffer for Jacobi sweeps, 0 otherwise
+ * @return new copy, NULL if memory allocation went wrong
+ */
+FloatGrid *createFloatGrid(const HeatGrid *grid, int spare);
+
+/**
+ * copy the free cells of the float copy back to the grid it was copied from, the pinned cells
+ * keep their double values
+ * @param floats the copy
+ * @param grid the grid it was copied from
+ */
+void storeFloatGrid(const FloatGrid *floats, HeatGrid *grid);
+
+/**
+ * one pass over the rows in raster order in place, the way updateBand sweeps a whole grid
+ * @param floats the copy
+ * @param weights weights of the stencil, rounded to float
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, rowSums[i] gets the heat of row i right after it was updated
+ */
+void sweepFloatGrid(FloatGrid *floats, const StencilWeights *weights, int is_cyclic, int colour,
+                    double *rowSums);
+
+/**
+ * Jacobi sweep from data to spare, then the buffers swap
+ * @param floats the copy, with a spare buffer
+ * @param weights weights of the stencil, rounded to float
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void sweepFloatJacobi(FloatGrid *floats, const StencilWeights *weights, int is_cyclic,
+                      double *rowSums);
+
+/**
+ * @param floats the copy
+ * @return the sum of its values, in double and row by row like sumRows
+ */
+double floatHeat(const FloatGrid *floats);
+
+/**
+ * free a copy
+ * @param floats the copy, may be NULL
+ */
+void freeFloatGrid(FloatGrid *floats);
+
+#endif //EX3_FLOAT_GRID_H
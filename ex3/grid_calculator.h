@@ -0,0 +1,267 @@
+/**
+ * @author Idan Yamin
+ * @brief calculator entry points working on a HeatGrid.
+ */
+
+#ifndef EX3_GRID_CALCULATOR_H
+#define EX3_GRID_CALCULATOR_H
+
+#include "calculator.h"
+#include "heat_grid.h"
+#include "trace.h"
+
+/**
+ * order of the updates inside one sweep
+ * ORDER_RASTER: row by row, in place (Gauss-Seidel)
+ * ORDER_RED_BLACK: every cell with (i + j) even, then every cell with (i + j) odd, in place
+ * ORDER_JACOBI: every cell from the previous grid into a second buffer, then the buffers swap.
+ *               the result doesn't depend on the order of the cells or on the number of threads.
+ */
+typedef enum UpdateOrder
+{
+    ORDER_RASTER,
+    ORDER_RED_BLACK,
+    ORDER_JACOBI
+} UpdateOrder;
+
+/**
+ * how a run until convergence (n_iter is 0) gets to the solution. the update function must be
+ * a registered stencil up to rounding (see findLinearStencil) with 1 - center at least
+ * 4 * neighbour, other functions and runs with n_iter > 0 only sweep.
+ * SOLVER_RELAX: sweeps of the update function
+ * SOLVER_MULTIGRID: multigrid V-cycles with the sweeps of the order as the smoother (see
+ *                   calculateMultigrid). the low frequencies of the difference from the solution
+ *                   die out in a few cycles instead of O(rows * cols) sweeps.
+ * SOLVER_SOR: successive over-relaxation of the raster and red-black sweeps (see Relaxation),
+ *             O(rows + cols) sweeps instead of O(rows * cols). a Jacobi sweep isn't relaxed.
+ */
+typedef enum Solver
+{
+    SOLVER_RELAX,
+    SOLVER_MULTIGRID,
+    SOLVER_SOR
+} Solver;
+
+/**
+ * what a single threaded sweep of a registered stencil keeps the values in (see float_grid.h).
+ * the heat of the grid is summed in double either way.
+ * PRECISION_DOUBLE: the grid itself
+ * PRECISION_FLOAT: a float copy of the grid, half the bytes per cell to move and twice the cells
+ *                  per vector instruction. the grid gets the values of the copy, rounded to
+ *                  float, at the sweep hook and at the end of the call. a difference below
+ *                  FLT_EPSILON times the heat is lost in the rounding of the cells, which stop
+ *                  moving there, so a call whose terminate is below it goes on in double from
+ *                  that point.
+ * PRECISION_MIXED: float sweeps until near the end, then double sweeps that refine the result:
+ *                  the call also goes on in double once the difference is below
+ *                  MIXED_MARGIN * terminate, or for the last two sweeps when n_iter > 0, so the
+ *                  result is a double one.
+ */
+typedef enum Precision
+{
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT,
+    PRECISION_MIXED
+} Precision;
+
+// a mixed precision run goes on in double once the difference is below terminate times this
+#define MIXED_MARGIN 16
+
+/**
+ * state of a SOR run. a sweep moves every free cell from its value v to
+ * v + omega * (g - v), g being the value that zeroes the residual of the cell. omega starts at 1
+ * (Gauss-Seidel) and is raised to the optimum the rate the difference falls at points to, up to
+ * the optimum for the size of the grid, as if the edges were the only pinned cells. the sources
+ * only bring the optimum down, so that one is an upper bound.
+ * omega: the relaxation factor of the sweeps, between 1 and 2
+ * settled: 1 once omega is no longer raised
+ * refDiff: a difference measured earlier, the rate is measured from it. 0 when there is none
+ * refAge: number of sweeps since refDiff was measured
+ * gaussSeidel: about how many Gauss-Seidel sweeps the sweeps so far are worth (see
+ *              relaxationSpeedup)
+ */
+typedef struct Relaxation
+{
+    double omega;
+    int settled;
+    double refDiff;
+    unsigned int refAge;
+    double gaussSeidel;
+} Relaxation;
+
+/**
+ * options of a calculator
+ * threads: number of threads sweeping the grid in row bands, 1 runs on the calling thread.
+ *          results are reproducible for a fixed number of threads.
+ * order: order of the updates inside one sweep
+ * checkEvery: when running until convergence (n_iter is 0), look at the difference only every
+ *             checkEvery sweeps. the run may go up to checkEvery - 1 sweeps past the first sweep
+ *             below terminate, in exchange the heat is measured on 2 of every checkEvery sweeps.
+ * tileDepth: number of sweeps a single threaded run over a non cyclic grid advances in one
+ *            wavefront pass over the rows, so a grid bigger than the cache is read from memory
+ *            once per tileDepth sweeps. the result is the same as sweep by sweep. tiles end at
+ *            the sweeps the difference is looked at, so it pays off with n_iter or checkEvery.
+ *            1 sweeps one sweep at a time.
+ * solver: how a run until convergence gets to the solution
+ * activeThreshold: when not negative, a single threaded raster or red-black run only updates
+ *                  the tiles around the cells that moved by more than activeThreshold in the
+ *                  last sweep (see active.h), so a grid heat only reached a part of costs that
+ *                  part. every call starts with the whole grid. the result may differ from the
+ *                  full sweeps by the moves that were skipped. negative updates every cell.
+ * processes: number of processes sweeping the grid in row bands, the calling process included.
+ *            more than 1 forks a worker process per band at the first call on a shared grid
+ *            (see shareGrid) and keeps them for the grid, they sweep its buffers in place and
+ *            exchange their edge rows the way the threads do, so the result is that of as many
+ *            threads. it takes the place of the threads for the sweeps of a call, a multigrid
+ *            cycle sweeps on the threads. a grid that isn't shared is swept as without it.
+ * precision: what the sweeps keep the values in. anything but PRECISION_DOUBLE takes the place
+ *            of the tiles and the active region for a single threaded run of a registered
+ *            stencil over a grid in memory. the threads, the processes and the smoothing sweeps
+ *            of a multigrid cycle stay in double.
+ */
+typedef struct CalcOptions
+{
+    unsigned int threads;
+    UpdateOrder order;
+    unsigned int checkEvery;
+    unsigned int tileDepth;
+    Solver solver;
+    double activeThreshold;
+    unsigned int processes;
+    Precision precision;
+} CalcOptions;
+
+#define DEFAULT_CALC_OPTIONS {1, ORDER_RASTER, 1, 1, SOLVER_RELAX, -1, 1, PRECISION_DOUBLE}
+
+/**
+ * calculator state kept between calls (thread pool and work buffers)
+ */
+typedef struct Calculator Calculator;
+
+/**
+ * create a calculator, starts the thread pool when more than one thread is asked for
+ * @param options the options, NULL for the defaults
+ * @return new calculator, NULL if memory allocation went wrong
+ */
+Calculator *createCalculator(const CalcOptions *options);
+
+/**
+ * free a calculator and stop its threads
+ * @param calc the calculator, may be NULL
+ */
+void freeCalculator(Calculator *calc);
+
+/**
+ * called by the calculator between sweeps, at the points where a calculateGrid call can be cut
+ * and continued by a new call on the same grid with the same result: after every sweep (every
+ * tile of a tiled run) when n_iter > 0, after every multigrid cycle, otherwise after every
+ * checkEvery-th sweep. it is never called after the last sweep of a call. it must not change
+ * the grid, a multithreaded run calls it from the calling thread while the other threads only
+ * read the grid.
+ * @param arg the argument given to setSweepHook
+ * @param grid grid of values
+ * @param sweeps number of sweeps done in this call
+ * @param diff the last difference measured in this call, -1 if none was measured yet
+ * @param relaxation state of a SOR run, to continue it with (see setRelaxation). NULL when the
+ *                   sweeps aren't over-relaxed
+ */
+typedef void (*sweep_hook)(void *arg, const HeatGrid *grid, unsigned int sweeps, double diff,
+                           const Relaxation *relaxation);
+
+/**
+ * set the function called between sweeps (see sweep_hook)
+ * @param calc the calculator
+ * @param hook the function, NULL for none
+ * @param arg argument given to the function
+ */
+void setSweepHook(Calculator *calc, sweep_hook hook, void *arg);
+
+/**
+ * record the sweeps of the next calls to a trace (see trace.h): every sweep is timed, the
+ * intervals go to the trace file as they end. without a trace nothing is timed.
+ * @param calc the calculator
+ * @param trace the trace, NULL for none. it must outlive the calls
+ */
+void setTrace(Calculator *calc, Trace *trace);
+
+/**
+ * make the next calculateGrid call of a SOR run continue from the given state instead of
+ * starting from the omega of the grid size, the way the cut call would have gone on
+ * @param calc the calculator
+ * @param relaxation state given to the sweep hook, NULL to start over
+ */
+void setRelaxation(Calculator *calc, const Relaxation *relaxation);
+
+/**
+ * Calculator function. Applies the given function to every point in the grid iteratively for
+ * n_iter loops, or until the cumulative difference is below terminate (if n_iter is 0).
+ * pinned cells of the grid (see pinSources) are never updated. the heat of the grid is summed
+ * inside the sweep, row by row, so a sweep reads the grid from memory once.
+ * @param calc the calculator, NULL to run once with the default options
+ * @param function the update function
+ * @param grid grid of values
+ * @param terminate terminate threshold
+ * @param n_iter number of iterations, 0 to run until the difference is below terminate
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the difference of the last iteration, -1 if memory allocation went wrong or a worker
+ *         process died
+ */
+double calculateGrid(Calculator *calc, diff_func function, HeatGrid *grid, double terminate,
+                     unsigned int n_iter, int is_cyclic);
+
+/**
+ * @param calc the calculator
+ * @return number of sweeps the last calculateGrid call ran, 0 before the first one
+ */
+unsigned int calculatorSweeps(const Calculator *calc);
+
+/**
+ * @param calc the calculator
+ * @param relaxation put the state the last calculateGrid call ended with here
+ * @return 1 if the sweeps of the last calculateGrid call were over-relaxed, 0 otherwise
+ */
+int calculatorRelaxation(const Calculator *calc, Relaxation *relaxation);
+
+/**
+ * @param omega the relaxation factor of a SOR run
+ * @return about how many Gauss-Seidel sweeps a sweep at omega is worth, when omega is the
+ *         optimum of the grid: log(rate of SOR) / log(rate of Gauss-Seidel). 1 for omega 1.
+ */
+double relaxationSpeedup(double omega);
+
+/**
+ * calculate the sum of the heat. every row is summed on its own and the row sums are then added
+ * in row order (see sumRows), so any split of the rows into bands and threads gives the same
+ * value. this rounds differently from one running sum over all the cells, the difference of a
+ * grid with values of very different magnitudes can differ in its last digits from it.
+ * @param grid of heat
+ * @return the sum of the values of the grid
+ */
+double calcHeat(const HeatGrid *grid);
+
+/**
+ * calculate the new grid in raster order, skipping the pinned cells
+ * @param function the given function
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGrid(diff_func function, HeatGrid *grid, int is_cyclic);
+
+/**
+ * calculate the new grid in red-black order: first every cell (i, j) with (i + j) even, then
+ * every cell with (i + j) odd, skipping the pinned cells
+ * @param function the given function
+ * @param grid grid of values
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGridRedBlack(diff_func function, HeatGrid *grid, int is_cyclic);
+
+/**
+ * calculate the new grid from the old one into the spare buffer (Jacobi), then swap the buffers
+ * @param function the given function
+ * @param grid grid of values, must have a spare buffer (see prepareSpare)
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateGridJacobi(diff_func function, HeatGrid *grid, int is_cyclic);
+
+#endif //EX3_GRID_CALCULATOR_H
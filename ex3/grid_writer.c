@@ -0,0 +1,302 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "grid_writer.h"
+
+#define ERROR 1
+#define SUCCESS 0
+// digits after the point of the heat value ("%lf") and of a cell ("%2.4lf")
+#define VALUE_DECIMALS 6
+#define CELL_DECIMALS 4
+// values below this have an exact fractional part and an integer part that fits a uint64_t
+#define FAST_LIMIT 1e15
+
+/**
+ * the buffer and the file descriptor, failed is set by the first write that went wrong and
+ * makes the writer drop the rest of the text
+ */
+struct GridWriter
+{
+    int fd;
+    OutputFormat format;
+    char *buffer;
+    size_t capacity;
+    size_t used;
+    int failed;
+};
+
+static const double POWERS_OF_TEN[] = {1, 10, 100, 1000, 1e4, 1e5, 1e6};
+
+
+// ____________ functions _______________
+void writeSnapshot(GridWriter *writer, const HeatGrid *grid, double value, uint64_t sweeps);
+
+void writeValue(GridWriter *writer, double value, int decimals, char end);
+
+size_t formatFixed(char *out, double value, int decimals);
+
+uint64_t roundScaled(double fraction, double scale);
+
+size_t formatDigits(char *out, uint64_t number, int minDigits);
+
+void reserveSpace(GridWriter *writer);
+
+
+/**
+ * create a writer
+ * @param fd file descriptor the text is written to, it stays open
+ * @param capacity size of the buffer in bytes, at least WRITER_MIN_CAPACITY is used
+ * @param format what to write
+ * @return new writer, NULL if memory allocation went wrong
+ */
+GridWriter *createWriter(int fd, size_t capacity, OutputFormat format)
+{
+    GridWriter *writer = malloc(sizeof(GridWriter));
+    if (!writer)
+    {
+        return NULL;
+    }
+    writer->capacity = capacity < WRITER_MIN_CAPACITY ? WRITER_MIN_CAPACITY : capacity;
+    writer->buffer = malloc(writer->capacity);
+    if (!writer->buffer)
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->fd = fd;
+    writer->format = format;
+    writer->used = 0;
+    writer->failed = 0;
+    return writer;
+}
+
+/**
+ * write the heat value and the grid, as text the same as printf("%lf\n", value) and then
+ * printf("%2.4lf,", cell) for every cell with a "\n" after every row, or as one snapshot.
+ * everything is written out before returning.
+ * @param writer the writer
+ * @param grid grid of heat values
+ * @param value heat value
+ * @param sweeps number of sweeps done so far, only stored in snapshots
+ */
+void writeGrid(GridWriter *writer, const HeatGrid *grid, double value, uint64_t sweeps)
+{
+    if (writer->format != OUTPUT_TEXT)
+    {
+        writeSnapshot(writer, grid, value, sweeps);
+        flushWriter(writer);
+        return;
+    }
+    writeValue(writer, value, VALUE_DECIMALS, '\n');
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        const double *row = GRID_ROW(grid, i);
+        for (size_t j = 0; j < grid->cols; j++)
+        {
+            writeValue(writer, row[j], CELL_DECIMALS, ',');
+        }
+        reserveSpace(writer);
+        writer->buffer[writer->used++] = '\n';
+    }
+    flushWriter(writer);
+}
+
+/**
+ * write out everything in the buffer
+ * @param writer the writer
+ * @return 0 if all the text so far was written, 1 if a write failed
+ */
+int flushWriter(GridWriter *writer)
+{
+    size_t done = 0;
+    while (!writer->failed && done < writer->used)
+    {
+        ssize_t written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written < 0 && errno != EINTR)
+        {
+            writer->failed = 1;
+        }
+        else if (written > 0)
+        {
+            done += (size_t) written;
+        }
+    }
+    writer->used = 0;
+    return writer->failed ? ERROR : SUCCESS;
+}
+
+/**
+ * flush and free a writer
+ * @param writer the writer, may be NULL
+ */
+void freeWriter(GridWriter *writer)
+{
+    if (!writer)
+    {
+        return;
+    }
+    flushWriter(writer);
+    free(writer->buffer);
+    free(writer);
+}
+
+/**
+ * append a snapshot of the grid, the header, the values and the zero padding
+ * @param writer the writer, with a binary format
+ * @param grid grid of heat values
+ * @param value heat value
+ * @param sweeps number of sweeps done so far
+ */
+void writeSnapshot(GridWriter *writer, const HeatGrid *grid, double value, uint64_t sweeps)
+{
+    SnapshotHeader header;
+    header.type = writer->format == OUTPUT_BINARY32 ? SNAPSHOT_FLOAT32 : SNAPSHOT_FLOAT64;
+    header.rows = grid->rows;
+    header.cols = grid->cols;
+    header.sweeps = sweeps;
+    header.delta = value;
+    reserveSpace(writer);
+    encodeSnapshotHeader(&header, (unsigned char *) writer->buffer + writer->used);
+    writer->used += SNAPSHOT_HEADER_SIZE;
+    size_t valueSize = snapshotValueSize(header.type);
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        const double *row = GRID_ROW(grid, i);
+        for (size_t j = 0; j < grid->cols; j++)
+        {
+            reserveSpace(writer);
+            encodeSnapshotValue(row[j], header.type,
+                                (unsigned char *) writer->buffer + writer->used);
+            writer->used += valueSize;
+        }
+    }
+    size_t padding = snapshotPayloadSize(&header) - grid->rows * grid->cols * valueSize;
+    reserveSpace(writer);
+    memset(writer->buffer + writer->used, 0, padding);
+    writer->used += padding;
+}
+
+/**
+ * append one formatted value and the character after it
+ * @param writer the writer
+ * @param value the value
+ * @param decimals digits after the point
+ * @param end character written after the value
+ */
+void writeValue(GridWriter *writer, double value, int decimals, char end)
+{
+    reserveSpace(writer);
+    char *out = writer->buffer + writer->used;
+    size_t length = formatFixed(out, value, decimals);
+    out[length] = end;
+    writer->used += length + 1;
+}
+
+/**
+ * flush the buffer when a formatted value might not fit in what is left of it
+ * @param writer the writer
+ */
+void reserveSpace(GridWriter *writer)
+{
+    if (writer->capacity - writer->used < WRITER_MIN_CAPACITY)
+    {
+        flushWriter(writer);
+    }
+}
+
+/**
+ * format a value like printf("%.*f", decimals, value). values up to FAST_LIMIT are formatted
+ * here, rounded the way printf rounds (to nearest, ties to even, from the exact binary value),
+ * bigger ones and nan / inf go through snprintf.
+ * @param out where to write, at least WRITER_MIN_CAPACITY bytes
+ * @param value the value
+ * @param decimals digits after the point, at most 6
+ * @return number of characters written, without a terminating '\0'
+ */
+size_t formatFixed(char *out, double value, int decimals)
+{
+    double magnitude = fabs(value);
+    if (!(magnitude < FAST_LIMIT))
+    {
+        return (size_t) snprintf(out, WRITER_MIN_CAPACITY, "%.*f", decimals, value);
+    }
+    size_t length = 0;
+    if (signbit(value))
+    {
+        out[length++] = '-';
+    }
+    // both parts are exact below FAST_LIMIT
+    double whole = floor(magnitude);
+    uint64_t integer = (uint64_t) whole;
+    uint64_t fraction = roundScaled(magnitude - whole, POWERS_OF_TEN[decimals]);
+    if (fraction == (uint64_t) POWERS_OF_TEN[decimals])
+    {
+        integer++;
+        fraction = 0;
+    }
+    length += formatDigits(out + length, integer, 1);
+    if (decimals > 0)
+    {
+        out[length++] = '.';
+        length += formatDigits(out + length, fraction, decimals);
+    }
+    return length;
+}
+
+/**
+ * @param fraction a value in [0, 1)
+ * @param scale a power of ten up to 1e6
+ * @return fraction * scale rounded to the nearest integer, ties to even, computed from the exact
+ *         product: the product is rounded once, then fma tells on which side of the halfway
+ *         points around the guess the exact product lies
+ */
+uint64_t roundScaled(double fraction, double scale)
+{
+    double guess = nearbyint(fraction * scale);
+    double above = fma(fraction, scale, -(guess + 0.5));
+    if (above > 0 || (above == 0 && fmod(guess, 2) != 0))
+    {
+        return (uint64_t) guess + 1;
+    }
+    double below = fma(fraction, scale, -(guess - 0.5));
+    if (below < 0 || (below == 0 && fmod(guess, 2) != 0))
+    {
+        return (uint64_t) guess - 1;
+    }
+    return (uint64_t) guess;
+}
+
+/**
+ * write a number in decimal
+ * @param out where to write
+ * @param number the number
+ * @param minDigits pad with leading zeros to at least this many digits
+ * @return number of digits written
+ */
+size_t formatDigits(char *out, uint64_t number, int minDigits)
+{
+    char digits[20];
+    size_t count = 0;
+    do
+    {
+        digits[count++] = (char) ('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+    while (count < (size_t) minDigits)
+    {
+        digits[count++] = '0';
+    }
+    for (size_t k = 0; k < count; k++)
+    {
+        out[k] = digits[count - 1 - k];
+    }
+    return count;
+}
@@ -0,0 +1,68 @@
+/**
+ * @author Idan Yamin
+ * @brief buffered writer of the printed grids, formats the values itself and writes them to a
+ * file descriptor in large blocks. the text is the same as printf prints, the binary formats
+ * are the snapshots of snapshot.h.
+ */
+
+#ifndef EX3_GRID_WRITER_H
+#define EX3_GRID_WRITER_H
+
+#include "heat_grid.h"
+#include "snapshot.h"
+
+// default size of the buffer of a writer, in bytes
+#define WRITER_CAPACITY (1 << 20)
+
+// smallest buffer of a writer, longer than any formatted value
+#define WRITER_MIN_CAPACITY 512
+
+/**
+ * what a writer writes
+ * OUTPUT_TEXT: the heat value and the grid as text
+ * OUTPUT_BINARY: a snapshot of float64 values
+ * OUTPUT_BINARY32: a snapshot of float32 values
+ */
+typedef enum OutputFormat
+{
+    OUTPUT_TEXT,
+    OUTPUT_BINARY,
+    OUTPUT_BINARY32
+} OutputFormat;
+
+typedef struct GridWriter GridWriter;
+
+/**
+ * create a writer
+ * @param fd file descriptor the text is written to, it stays open
+ * @param capacity size of the buffer in bytes, at least WRITER_MIN_CAPACITY is used
+ * @param format what to write
+ * @return new writer, NULL if memory allocation went wrong
+ */
+GridWriter *createWriter(int fd, size_t capacity, OutputFormat format);
+
+/**
+ * write the heat value and the grid, as text the same as printf("%lf\n", value) and then
+ * printf("%2.4lf,", cell) for every cell with a "\n" after every row, or as one snapshot.
+ * everything is written out before returning.
+ * @param writer the writer
+ * @param grid grid of heat values
+ * @param value heat value
+ * @param sweeps number of sweeps done so far, only stored in snapshots
+ */
+void writeGrid(GridWriter *writer, const HeatGrid *grid, double value, uint64_t sweeps);
+
+/**
+ * write out everything in the buffer
+ * @param writer the writer
+ * @return 0 if all the text so far was written, 1 if a write failed
+ */
+int flushWriter(GridWriter *writer);
+
+/**
+ * flush and free a writer
+ * @param writer the writer, may be NULL
+ */
+void freeWriter(GridWriter *writer);
+
+#endif //EX3_GRID_WRITER_H
@@ -0,0 +1,605 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "heat_grid.h"
+
+#define DOUBLES_PER_LINE (GRID_ALIGNMENT / sizeof(double))
+#define ERROR 1
+#define SUCCESS 0
+// name of the scratch file of a mapped grid inside its directory, for mkstemp
+#define SCRATCH_NAME "/ex3-grid-XXXXXX"
+// name of a shared memory object of a shared grid, with the process id, the serial and the buffer
+#define SHARED_NAME_FORMAT "/ex3-grid-%ld-%lu-%d"
+#define SHARED_NAME_SIZE 64
+
+// serial of the last grid of shareGrid
+static atomic_ulong lastSerial;
+
+/**
+ * @param size number of bytes
+ * @return size rounded up to a multiple of GRID_ALIGNMENT
+ */
+static size_t alignUp(size_t size)
+{
+    return (size + GRID_ALIGNMENT - 1) / GRID_ALIGNMENT * GRID_ALIGNMENT;
+}
+
+/**
+ * @param cols number of cols, at most SIZE_MAX - DOUBLES_PER_LINE
+ * @return the stride of rows of cols values, every row padded to a whole number of cache lines
+ */
+static size_t rowStride(size_t cols)
+{
+    return (cols + DOUBLES_PER_LINE - 1) / DOUBLES_PER_LINE * DOUBLES_PER_LINE;
+}
+
+/**
+ * build grid with zeros
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if memory allocation went wrong
+ */
+HeatGrid *buildGrid(size_t rows, size_t cols)
+{
+    if (cols > SIZE_MAX - DOUBLES_PER_LINE)
+    {
+        return NULL;
+    }
+    size_t stride = rowStride(cols);
+    size_t header = alignUp(sizeof(HeatGrid));
+    if (stride != 0 && rows > (SIZE_MAX - header) / sizeof(double) / stride)
+    {
+        return NULL;
+    }
+    size_t total = alignUp(header + rows * stride * sizeof(double));
+    // the header and the values share one allocation, so one free releases both
+    unsigned char *block = aligned_alloc(GRID_ALIGNMENT, total);
+    if (!block)
+    {
+        return NULL;
+    }
+    HeatGrid *newGrid = (HeatGrid *) block;
+    newGrid->data = (double *) (block + header);
+    newGrid->spare = NULL;
+    newGrid->rows = rows;
+    newGrid->cols = cols;
+    newGrid->stride = stride;
+    newGrid->pinnedStart = NULL;
+    newGrid->pinnedCols = NULL;
+    newGrid->mapped = 0;
+    newGrid->fd = -1;
+    newGrid->capacity = (total - header) / sizeof(double);
+    newGrid->edges = EDGE_DIRICHLET;
+    newGrid->edgeValue = 0;
+    newGrid->ghost = NULL;
+    newGrid->serial = 0;
+    initGridValues(newGrid);
+    return newGrid;
+}
+
+/**
+ * turn a grid into a grid with zeros of another size, in the buffers of the grid when they have
+ * room for it. the pinned cells are dropped and the edges go back to zero Dirichlet edges.
+ * @param grid the grid, NULL to build a new one. it is freed when a new one is built
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return the grid, NULL if memory allocation went wrong (the grid was freed then)
+ */
+HeatGrid *reuseGrid(HeatGrid *grid, size_t rows, size_t cols)
+{
+    size_t stride = cols > SIZE_MAX - DOUBLES_PER_LINE ? 0 : rowStride(cols);
+    if (!grid || grid->mapped || stride == 0 || rows > grid->capacity / stride)
+    {
+        freeGrid(grid);
+        return buildGrid(rows, cols);
+    }
+    free(grid->pinnedStart);
+    grid->pinnedStart = NULL;
+    grid->pinnedCols = NULL;
+    // the ghost row has the length of the old rows
+    free(grid->ghost);
+    grid->edges = EDGE_DIRICHLET;
+    grid->edgeValue = 0;
+    grid->ghost = NULL;
+    grid->rows = rows;
+    grid->cols = cols;
+    grid->stride = stride;
+    initGridValues(grid);
+    // the spare buffer agrees with data on every cell but the pinned ones, prepareSpare copies
+    if (grid->spare)
+    {
+        memset(grid->spare, 0, rows * stride * sizeof(double));
+    }
+    return grid;
+}
+
+/**
+ * build grid with zeros whose values live in a scratch file mapped to memory, so the grid may be
+ * larger than the memory and the pages of the rows not in use go back to the disk. the file is
+ * unlinked right away, it goes away with the grid.
+ * @param directory directory of the scratch file
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if the file could not be created or mapped
+ */
+HeatGrid *mapGrid(const char *directory, size_t rows, size_t cols)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    if (cols > SIZE_MAX - DOUBLES_PER_LINE || page <= 0)
+    {
+        return NULL;
+    }
+    size_t stride = rowStride(cols);
+    // with the spare buffer the file is twice the size of the values, which must fit an off_t
+    uintmax_t largest = SIZE_MAX < INT64_MAX ? SIZE_MAX : INT64_MAX;
+    largest = largest / 2 - (uintmax_t) page;
+    if (stride != 0 && rows > largest / sizeof(double) / stride)
+    {
+        return NULL;
+    }
+    size_t size = rows * stride * sizeof(double);
+    // a whole number of pages, at least one, so the spare buffer starts at a page
+    size = size == 0 ? (size_t) page : (size + (size_t) page - 1) / (size_t) page * (size_t) page;
+
+    size_t length = strlen(directory);
+    char *path = malloc(length + sizeof(SCRATCH_NAME));
+    HeatGrid *newGrid = malloc(sizeof(HeatGrid));
+    if (!path || !newGrid)
+    {
+        free(path);
+        free(newGrid);
+        return NULL;
+    }
+    memcpy(path, directory, length);
+    memcpy(path + length, SCRATCH_NAME, sizeof(SCRATCH_NAME));
+    int fd = mkstemp(path);
+    if (fd >= 0)
+    {
+        unlink(path);
+    }
+    free(path);
+    void *mapping = MAP_FAILED;
+    // the file is sparse, it reads as zeros until the grid writes to it
+    if (fd >= 0 && ftruncate(fd, (off_t) size) == 0)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapping == MAP_FAILED)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        free(newGrid);
+        return NULL;
+    }
+    // the sweeps go over the rows in order, read ahead of them and drop the pages behind
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+    newGrid->data = mapping;
+    newGrid->spare = NULL;
+    newGrid->rows = rows;
+    newGrid->cols = cols;
+    newGrid->stride = stride;
+    newGrid->pinnedStart = NULL;
+    newGrid->pinnedCols = NULL;
+    newGrid->mapped = size;
+    newGrid->fd = fd;
+    newGrid->capacity = size / sizeof(double);
+    newGrid->edges = EDGE_DIRICHLET;
+    newGrid->edgeValue = 0;
+    newGrid->ghost = NULL;
+    newGrid->serial = 0;
+    return newGrid;
+}
+
+/**
+ * map a buffer of a shared grid, a POSIX shared memory object that is unlinked right away
+ * @param serial serial of the grid
+ * @param buffer 0 for the values, 1 for the spare buffer
+ * @param size size in bytes, not 0
+ * @return the mapping, zeroed, MAP_FAILED if the object could not be created or mapped
+ */
+static void *mapShared(unsigned long serial, int buffer, size_t size)
+{
+    char name[SHARED_NAME_SIZE];
+    snprintf(name, sizeof(name), SHARED_NAME_FORMAT, (long) getpid(), serial, buffer);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return MAP_FAILED;
+    }
+    shm_unlink(name);
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return mapping;
+}
+
+/**
+ * build grid with zeros whose buffers are memory shared with the processes forked after they are
+ * mapped, so worker processes sweep the grid itself instead of copies of it
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if the memory could not be created or mapped
+ */
+HeatGrid *shareGrid(size_t rows, size_t cols)
+{
+    if (cols > SIZE_MAX - DOUBLES_PER_LINE)
+    {
+        return NULL;
+    }
+    size_t stride = rowStride(cols);
+    // the size of a shared memory object is an off_t
+    uintmax_t largest = (SIZE_MAX < INT64_MAX ? SIZE_MAX : INT64_MAX) - GRID_ALIGNMENT;
+    if (stride != 0 && rows > largest / sizeof(double) / stride)
+    {
+        return NULL;
+    }
+    size_t size = rows * stride * sizeof(double);
+    size = size == 0 ? GRID_ALIGNMENT : alignUp(size);
+    HeatGrid *newGrid = malloc(sizeof(HeatGrid));
+    if (!newGrid)
+    {
+        return NULL;
+    }
+    unsigned long serial = atomic_fetch_add(&lastSerial, 1) + 1;
+    void *mapping = mapShared(serial, 0, size);
+    if (mapping == MAP_FAILED)
+    {
+        free(newGrid);
+        return NULL;
+    }
+    newGrid->data = mapping;
+    newGrid->spare = NULL;
+    newGrid->rows = rows;
+    newGrid->cols = cols;
+    newGrid->stride = stride;
+    newGrid->pinnedStart = NULL;
+    newGrid->pinnedCols = NULL;
+    newGrid->mapped = size;
+    newGrid->fd = -1;
+    newGrid->capacity = size / sizeof(double);
+    newGrid->edges = EDGE_DIRICHLET;
+    newGrid->edgeValue = 0;
+    newGrid->ghost = NULL;
+    newGrid->serial = serial;
+    return newGrid;
+}
+
+/**
+ * @param grid the grid
+ * @return 1 if the buffers of the grid are in a file (see mapGrid), 0 if they are in memory
+ */
+int gridOnDisk(const HeatGrid *grid)
+{
+    return grid->fd >= 0;
+}
+
+/**
+ * @param grid the grid
+ * @return the value buffer that shares the allocation of the grid
+ */
+static double *inlineData(HeatGrid *grid)
+{
+    return (double *) ((unsigned char *) grid + alignUp(sizeof(HeatGrid)));
+}
+
+/**
+ * init all of the entries to zero, padding included
+ * @param grid the grid
+ */
+void initGridValues(HeatGrid *grid)
+{
+    memset(grid->data, 0, grid->rows * grid->stride * sizeof(double));
+}
+
+/**
+ * free grid
+ * @param grid the grid to free, may be NULL
+ */
+void freeGrid(HeatGrid *grid)
+{
+    if (grid)
+    {
+        free(grid->ghost);
+    }
+    if (grid && grid->mapped)
+    {
+        free(grid->pinnedStart);
+        munmap(grid->data, grid->mapped);
+        if (grid->spare)
+        {
+            munmap(grid->spare, grid->mapped);
+        }
+        if (grid->fd >= 0)
+        {
+            close(grid->fd);
+        }
+    }
+    else if (grid)
+    {
+        free(grid->pinnedStart);
+        // after an odd number of swaps data is the separate buffer
+        free(grid->data == inlineData(grid) ? grid->spare : grid->data);
+    }
+    free(grid);
+}
+
+/**
+ * compare two columns for qsort
+ * @param a first column
+ * @param b second column
+ * @return negative, zero or positive like strcmp
+ */
+static int compareCols(const void *a, const void *b)
+{
+    size_t first = *(const size_t *) a, second = *(const size_t *) b;
+    return (first > second) - (first < second);
+}
+
+/**
+ * index the cells of the given sources so the calculator never updates them,
+ * replaces any previous index. the sources must be inside the grid, the sweeps index the rows
+ * with the pinned columns.
+ * @param grid the grid
+ * @param sources the sources of heat
+ * @param numOfSources number of sources
+ * @return 0 if succeeded, 1 if a source is outside the grid or memory allocation went wrong
+ */
+int pinSources(HeatGrid *grid, const source_point *sources, size_t numOfSources)
+{
+    for (size_t i = 0; i < numOfSources; i++)
+    {
+        if (sources[i].x < 0 || (size_t) sources[i].x >= grid->rows || sources[i].y < 0 ||
+            (size_t) sources[i].y >= grid->cols)
+        {
+            return ERROR;
+        }
+    }
+    // row offsets and columns share one allocation
+    size_t *index = malloc(sizeof(size_t) * (grid->rows + 1 + numOfSources));
+    if (!index)
+    {
+        return ERROR;
+    }
+    size_t *start = index, *cols = index + grid->rows + 1;
+
+    // bucket the sources by row
+    memset(start, 0, sizeof(size_t) * (grid->rows + 1));
+    for (size_t i = 0; i < numOfSources; i++)
+    {
+        start[sources[i].x + 1]++;
+    }
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        start[i + 1] += start[i];
+    }
+    for (size_t i = 0; i < numOfSources; i++)
+    {
+        cols[start[sources[i].x]++] = (size_t) sources[i].y;
+    }
+    // start[i] now holds the end of row i, shift back while sorting and dropping duplicates
+    size_t rowBegin = 0, kept = 0;
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        size_t rowEnd = start[i];
+        qsort(cols + rowBegin, rowEnd - rowBegin, sizeof(size_t), compareCols);
+        start[i] = kept;
+        for (size_t k = rowBegin; k < rowEnd; k++)
+        {
+            if (kept == start[i] || cols[kept - 1] != cols[k])
+            {
+                cols[kept++] = cols[k];
+            }
+        }
+        rowBegin = rowEnd;
+    }
+    start[grid->rows] = kept;
+
+    free(grid->pinnedStart);
+    grid->pinnedStart = start;
+    grid->pinnedCols = cols;
+    return SUCCESS;
+}
+
+/**
+ * @param grid the grid
+ * @param row row of the grid
+ * @return number of pinned cells in the row
+ */
+size_t pinnedInRow(const HeatGrid *grid, size_t row)
+{
+    if (!grid->pinnedStart)
+    {
+        return 0;
+    }
+    return grid->pinnedStart[row + 1] - grid->pinnedStart[row];
+}
+
+/**
+ * @param grid the grid
+ * @param row row of the grid
+ * @return sorted columns of the pinned cells of the row, pinnedInRow() of them
+ */
+const size_t *pinnedRowCols(const HeatGrid *grid, size_t row)
+{
+    if (!grid->pinnedStart)
+    {
+        return NULL;
+    }
+    return grid->pinnedCols + grid->pinnedStart[row];
+}
+
+/**
+ * set what lies past the edges of the grid when it isn't swept as cyclic
+ * @param grid the grid
+ * @param edges kind of the edges
+ * @param value value of the cells past a Dirichlet edge, ignored for a Neumann edge
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int setEdges(HeatGrid *grid, EdgeKind edges, double value)
+{
+    free(grid->ghost);
+    grid->ghost = NULL;
+    grid->edges = edges;
+    grid->edgeValue = edges == EDGE_DIRICHLET ? value : 0;
+    // zero edges read the same without a ghost row, the calculator prepares it for speed
+    if (grid->edgeValue != 0)
+    {
+        return prepareGhost(grid);
+    }
+    return SUCCESS;
+}
+
+/**
+ * make sure a grid with Dirichlet edges has its ghost row, so the rows at the edges are swept
+ * like the rows inside
+ * @param grid the grid
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int prepareGhost(HeatGrid *grid)
+{
+    if (grid->ghost || grid->edges != EDGE_DIRICHLET)
+    {
+        return SUCCESS;
+    }
+    size_t size = grid->stride * sizeof(double);
+    grid->ghost = aligned_alloc(GRID_ALIGNMENT, size ? size : GRID_ALIGNMENT);
+    if (!grid->ghost)
+    {
+        return ERROR;
+    }
+    for (size_t j = 0; j < grid->stride; j++)
+    {
+        grid->ghost[j] = grid->edgeValue;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @param grid the grid
+ * @param buffer grid->data or grid->spare
+ * @param i row of the grid
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the row of buffer before row i (the bottom row of a RowView). before row 0 it is the
+ *         last row of a cyclic grid, row 0 itself for a Neumann edge and the ghost row for a
+ *         Dirichlet edge, NULL for a zero edge
+ */
+const double *bottomRow(const HeatGrid *grid, const double *buffer, size_t i, int is_cyclic)
+{
+    if (i > 0)
+    {
+        return buffer + (i - 1) * grid->stride;
+    }
+    if (is_cyclic)
+    {
+        return buffer + (grid->rows - 1) * grid->stride;
+    }
+    return grid->edges == EDGE_NEUMANN ? buffer : grid->ghost;
+}
+
+/**
+ * @param grid the grid
+ * @param buffer grid->data or grid->spare
+ * @param i row of the grid
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the row of buffer after row i (the top row of a RowView), past the last row like
+ *         bottomRow before the first
+ */
+const double *topRow(const HeatGrid *grid, const double *buffer, size_t i, int is_cyclic)
+{
+    if (i + 1 < grid->rows)
+    {
+        return buffer + (i + 1) * grid->stride;
+    }
+    if (is_cyclic)
+    {
+        return buffer;
+    }
+    return grid->edges == EDGE_NEUMANN ? buffer + i * grid->stride : grid->ghost;
+}
+
+/**
+ * make sure the grid has a spare buffer whose pinned cells hold the values of the pinned cells
+ * of data, the first call copies the whole grid into it. the spare buffer of a mapped grid is
+ * mapped from the same file, after the values, the one of a shared grid is shared as well.
+ * @param grid the grid
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int prepareSpare(HeatGrid *grid)
+{
+    size_t size = grid->rows * grid->stride * sizeof(double);
+    if (!grid->spare && grid->mapped && grid->fd < 0)
+    {
+        void *mapping = mapShared(grid->serial, 1, grid->mapped);
+        if (mapping == MAP_FAILED)
+        {
+            return ERROR;
+        }
+        grid->spare = mapping;
+        memcpy(grid->spare, grid->data, size);
+        return SUCCESS;
+    }
+    if (!grid->spare && grid->mapped)
+    {
+        void *mapping = MAP_FAILED;
+        if (ftruncate(grid->fd, (off_t) (2 * grid->mapped)) == 0)
+        {
+            mapping = mmap(NULL, grid->mapped, PROT_READ | PROT_WRITE, MAP_SHARED, grid->fd,
+                           (off_t) grid->mapped);
+        }
+        if (mapping == MAP_FAILED)
+        {
+            return ERROR;
+        }
+        posix_madvise(mapping, grid->mapped, POSIX_MADV_SEQUENTIAL);
+        grid->spare = mapping;
+        memcpy(grid->spare, grid->data, size);
+        return SUCCESS;
+    }
+    if (!grid->spare)
+    {
+        // room for every grid reuseGrid fits in data
+        size_t room = grid->capacity * sizeof(double);
+        grid->spare = aligned_alloc(GRID_ALIGNMENT, room ? alignUp(room) : GRID_ALIGNMENT);
+        if (!grid->spare)
+        {
+            return ERROR;
+        }
+        memcpy(grid->spare, grid->data, size);
+        return SUCCESS;
+    }
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        const size_t *pinned = pinnedRowCols(grid, i);
+        for (size_t k = 0; k < pinnedInRow(grid, i); k++)
+        {
+            size_t at = i * grid->stride + pinned[k];
+            grid->spare[at] = grid->data[at];
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * exchange data and spare
+ * @param grid the grid, must have a spare buffer
+ */
+void swapBuffers(HeatGrid *grid)
+{
+    double *data = grid->data;
+    grid->data = grid->spare;
+    grid->spare = data;
+}
@@ -0,0 +1,205 @@
+/**
+ * @author Idan Yamin
+ * @brief heat grid storage, a single aligned row-major buffer with a row stride.
+ */
+
+#ifndef EX3_HEAT_GRID_H
+#define EX3_HEAT_GRID_H
+
+#include <stddef.h>
+#include "calculator.h"
+
+// alignment in bytes of the grid buffer and of every row in it
+#define GRID_ALIGNMENT 64
+
+/**
+ * what lies past the edges of a grid that isn't cyclic
+ * EDGE_DIRICHLET: cells of a fixed value, zero unless set
+ * EDGE_NEUMANN: an insulated edge no heat flows through, the cell past an edge cell reads as
+ *               the edge cell itself
+ */
+typedef enum EdgeKind
+{
+    EDGE_DIRICHLET,
+    EDGE_NEUMANN
+} EdgeKind;
+
+/**
+ * heat grid, rows x cols values, row i starts at data + i * stride.
+ * the struct and the values live in one allocation.
+ * pinned cells (sources) of row i are pinnedCols[pinnedStart[i]] .. pinnedCols[pinnedStart[i + 1] - 1],
+ * sorted and unique. pinnedStart is NULL while no sources were pinned.
+ * spare is a second buffer of the same layout for double buffered updates, NULL until
+ * prepareSpare. swapBuffers exchanges it with data.
+ * a grid built by mapGrid keeps its buffers in a file instead, mapped is the size in bytes of
+ * each mapping and fd the file, 0 and -1 for a grid in memory. a grid built by shareGrid maps its
+ * buffers as memory shared with the processes forked after, mapped is set and fd is -1 for it.
+ * serial tells the grids of shareGrid apart, no two of them get the same one, 0 for the others.
+ * capacity is the number of values each buffer has room for, reuseGrid fits smaller grids in.
+ * edges is what lies past the edges when the grid isn't swept as cyclic, edgeValue the value of
+ * a Dirichlet edge. ghost is a row of edgeValue the sweeps read past the first and last rows of a
+ * Dirichlet edge, NULL reads as zeros until prepareGhost.
+ */
+typedef struct HeatGrid
+{
+    double *data;
+    double *spare;
+    size_t rows;
+    size_t cols;
+    size_t stride;
+    size_t *pinnedStart;
+    size_t *pinnedCols;
+    size_t mapped;
+    int fd;
+    size_t capacity;
+    EdgeKind edges;
+    double edgeValue;
+    double *ghost;
+    unsigned long serial;
+} HeatGrid;
+
+/**
+ * pointer to the first value of row i
+ */
+#define GRID_ROW(grid, i) ((grid)->data + (size_t)(i) * (grid)->stride)
+
+/**
+ * value at row i and column j
+ */
+#define GRID_AT(grid, i, j) (GRID_ROW(grid, i)[j])
+
+/**
+ * build grid with zeros
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if memory allocation went wrong
+ */
+HeatGrid *buildGrid(size_t rows, size_t cols);
+
+/**
+ * turn a grid into a grid with zeros of another size, in the buffers of the grid when they have
+ * room for it. the pinned cells are dropped and the edges go back to zero Dirichlet edges.
+ * @param grid the grid, NULL to build a new one. it is freed when a new one is built
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return the grid, NULL if memory allocation went wrong (the grid was freed then)
+ */
+HeatGrid *reuseGrid(HeatGrid *grid, size_t rows, size_t cols);
+
+/**
+ * build grid with zeros whose values live in a scratch file mapped to memory, so the grid may be
+ * larger than the memory and the pages of the rows not in use go back to the disk. the file is
+ * unlinked right away, it goes away with the grid.
+ * @param directory directory of the scratch file
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if the file could not be created or mapped
+ */
+HeatGrid *mapGrid(const char *directory, size_t rows, size_t cols);
+
+/**
+ * build grid with zeros whose buffers are memory shared with the processes forked after they are
+ * mapped, so worker processes sweep the grid itself instead of copies of it
+ * @param rows number of rows of new grid
+ * @param cols number of cols of new grid
+ * @return new grid, NULL if the memory could not be created or mapped
+ */
+HeatGrid *shareGrid(size_t rows, size_t cols);
+
+/**
+ * @param grid the grid
+ * @return 1 if the buffers of the grid are in a file (see mapGrid), 0 if they are in memory
+ */
+int gridOnDisk(const HeatGrid *grid);
+
+/**
+ * init all of the entries to zero
+ * @param grid the grid
+ */
+void initGridValues(HeatGrid *grid);
+
+/**
+ * index the cells of the given sources so the calculator never updates them,
+ * replaces any previous index. the sources must be inside the grid, the sweeps index the rows
+ * with the pinned columns.
+ * @param grid the grid
+ * @param sources the sources of heat
+ * @param numOfSources number of sources
+ * @return 0 if succeeded, 1 if a source is outside the grid or memory allocation went wrong
+ */
+int pinSources(HeatGrid *grid, const source_point *sources, size_t numOfSources);
+
+/**
+ * @param grid the grid
+ * @param row row of the grid
+ * @return number of pinned cells in the row
+ */
+size_t pinnedInRow(const HeatGrid *grid, size_t row);
+
+/**
+ * @param grid the grid
+ * @param row row of the grid
+ * @return sorted columns of the pinned cells of the row, pinnedInRow() of them
+ */
+const size_t *pinnedRowCols(const HeatGrid *grid, size_t row);
+
+/**
+ * set what lies past the edges of the grid when it isn't swept as cyclic
+ * @param grid the grid
+ * @param edges kind of the edges
+ * @param value value of the cells past a Dirichlet edge, ignored for a Neumann edge
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int setEdges(HeatGrid *grid, EdgeKind edges, double value);
+
+/**
+ * make sure a grid with Dirichlet edges has its ghost row, so the rows at the edges are swept
+ * like the rows inside
+ * @param grid the grid
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int prepareGhost(HeatGrid *grid);
+
+/**
+ * @param grid the grid
+ * @param buffer grid->data or grid->spare
+ * @param i row of the grid
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the row of buffer before row i (the bottom row of a RowView). before row 0 it is the
+ *         last row of a cyclic grid, row 0 itself for a Neumann edge and the ghost row for a
+ *         Dirichlet edge, NULL for a zero edge
+ */
+const double *bottomRow(const HeatGrid *grid, const double *buffer, size_t i, int is_cyclic);
+
+/**
+ * @param grid the grid
+ * @param buffer grid->data or grid->spare
+ * @param i row of the grid
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the row of buffer after row i (the top row of a RowView), past the last row like
+ *         bottomRow before the first
+ */
+const double *topRow(const HeatGrid *grid, const double *buffer, size_t i, int is_cyclic);
+
+/**
+ * make sure the grid has a spare buffer whose pinned cells hold the values of the pinned cells
+ * of data, the first call copies the whole grid into it. the spare buffer of a mapped grid is
+ * mapped from the same file, after the values, the one of a shared grid is shared as well.
+ * @param grid the grid
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int prepareSpare(HeatGrid *grid);
+
+/**
+ * exchange data and spare
+ * @param grid the grid, must have a spare buffer
+ */
+void swapBuffers(HeatGrid *grid);
+
+/**
+ * free grid
+ * @param grid the grid to free, may be NULL
+ */
+void freeGrid(HeatGrid *grid);
+
+#endif //EX3_HEAT_GRID_H
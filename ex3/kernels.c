@@ -0,0 +1,189 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include "kernels.h"
+#include "heat_eqn.h"
+
+#define ERROR 1
+#define SUCCESS 0
+
+// weight of the cell itself in damped_heat_eqn, 1 - 2/3
+#define DAMPED_CENTER (1.0 / 3)
+
+// weight of every neighbour in damped_heat_eqn, 2/3 * HEAT_WEIGHT
+#define DAMPED_NEIGHBOUR (1.0 / 6)
+
+// largest difference between a function and the weights findLinearStencil lets through, relative
+// to the sum of the magnitudes of the inputs, room for the rounding of another association
+#define LINEAR_TOLERANCE 1e-12
+
+// values of a cell and its four neighbours (x, a, b, c, d) a stencil is probed with, spread
+// over magnitudes and signs so a different association or weight changes at least one result
+#define NUM_PROBES 6
+static const double PROBES[NUM_PROBES][5] = {
+        {1, 2, 3, 4, 5},
+        {0.1, 0.7, -3.3, 1e10, 2.5e-3},
+        {-1.5, 1e-300, 3, 7, 1e16},
+        {123456789012345678901234567890.0, 1, 1e29, -1e29, 3},
+        {0.3, 1.0 / 3, 2.0 / 3, 0.1, 0.2},
+        {-7, 1e308, 1e308, -1e308, -1e308}
+};
+
+// the built-in stencils come first, registerStencil appends after them
+static LinearStencil stencils[MAX_STENCILS] = {
+        {heat_eqn,        {0, HEAT_WEIGHT}},
+        {damped_heat_eqn, {DAMPED_CENTER, DAMPED_NEIGHBOUR}}
+};
+static size_t numStencils = 2;
+// matches[k] is 1 if stencils[k].function computed its weights on every probe, linear[k] if it
+// did up to LINEAR_TOLERANCE
+static int matches[MAX_STENCILS];
+static int linear[MAX_STENCILS];
+static pthread_once_t probeOnce = PTHREAD_ONCE_INIT;
+
+
+// ____________ functions _______________
+int probeStencil(const LinearStencil *stencil, double tolerance);
+
+void probeBuiltins(void);
+
+
+/**
+ * weighted Jacobi relaxation of the heat equation with weight 2/3,
+ * x / 3 + (a + b + c + d) / 6. damps the high frequencies of the error faster than heat_eqn.
+ * @param x value of the cell
+ * @param a right neighbour
+ * @param b top neighbour
+ * @param c left neighbour
+ * @param d bottom neighbour
+ * @return the new value of the cell
+ */
+double damped_heat_eqn(const double x, const double a, const double b, const double c,
+                       const double d)
+{
+    // same association as the specialized kernels, so both paths agree bit for bit
+    return DAMPED_NEIGHBOUR * ((c + a) + (b + d)) + DAMPED_CENTER * x;
+}
+
+/**
+ * register a function as the stencil center * x + neighbour * ((c + a) + (b + d)).
+ * the function is probed on a few inputs, one that doesn't compute exactly that is never
+ * returned by findStencil, one that doesn't compute it up to rounding never by
+ * findLinearStencil. registering it again replaces the weights. not thread safe, register
+ * before any sweep runs.
+ * @param function the update function
+ * @param center weight of the cell itself
+ * @param neighbour weight of every neighbour
+ * @return 0 if succeeded, 1 if the registry is full
+ */
+int registerStencil(const diff_func function, const double center, const double neighbour)
+{
+    pthread_once(&probeOnce, probeBuiltins);
+    size_t k = 0;
+    while (k < numStencils && stencils[k].function != function)
+    {
+        k++;
+    }
+    if (k == numStencils)
+    {
+        if (numStencils == MAX_STENCILS)
+        {
+            return ERROR;
+        }
+        stencils[numStencils++].function = function;
+    }
+    stencils[k].weights.center = center;
+    stencils[k].weights.neighbour = neighbour;
+    matches[k] = probeStencil(&stencils[k], 0);
+    linear[k] = probeStencil(&stencils[k], LINEAR_TOLERANCE);
+    return SUCCESS;
+}
+
+/**
+ * @param function an update function
+ * @return the stencil of the function, NULL if it isn't registered or doesn't compute the
+ *         weights it was registered with (see probeStencil)
+ */
+const LinearStencil *findStencil(const diff_func function)
+{
+    pthread_once(&probeOnce, probeBuiltins);
+    for (size_t k = 0; k < numStencils; k++)
+    {
+        if (stencils[k].function == function)
+        {
+            return matches[k] ? &stencils[k] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @param function an update function
+ * @return the stencil of the function, NULL if it isn't registered or doesn't compute the
+ *         weights it was registered with up to LINEAR_TOLERANCE (see probeStencil)
+ */
+const LinearStencil *findLinearStencil(const diff_func function)
+{
+    pthread_once(&probeOnce, probeBuiltins);
+    for (size_t k = 0; k < numStencils; k++)
+    {
+        if (stencils[k].function == function)
+        {
+            return linear[k] ? &stencils[k] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * call the function of a stencil on the probes and compare with what the kernels compute from
+ * its weights, bit for bit or up to a tolerance. with a tolerance the probes whose inputs
+ * overflow are left out, a function that sums them in another order may overflow where the
+ * kernels don't.
+ * @param stencil the stencil
+ * @param tolerance largest difference relative to the sum of the magnitudes of the inputs, 0
+ *                  for bit for bit
+ * @return 1 if every probe matched, 0 otherwise
+ */
+int probeStencil(const LinearStencil *stencil, const double tolerance)
+{
+    double center = stencil->weights.center, neighbour = stencil->weights.neighbour;
+    for (int p = 0; p < NUM_PROBES; p++)
+    {
+        double x = PROBES[p][0], a = PROBES[p][1], b = PROBES[p][2], c = PROBES[p][3];
+        double d = PROBES[p][4];
+        double updated = neighbour * ((c + a) + (b + d));
+        double expected = center != 0 ? updated + center * x : updated;
+        double actual = stencil->function(x, a, b, c, d);
+        double scale = fabs(x) + fabs(a) + fabs(b) + fabs(c) + fabs(d);
+        if (tolerance > 0)
+        {
+            if (isfinite(scale) && !(fabs(actual - expected) <= tolerance * scale))
+            {
+                return 0;
+            }
+        }
+        // NaN on both sides counts as a match
+        else if (actual != expected && (actual == actual || expected == expected))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * probe the built-in stencils, the supplied heat_eqn may not be the exact average its weights
+ * say it is. a stencil that fails is left to the generic path.
+ */
+void probeBuiltins(void)
+{
+    for (size_t k = 0; k < numStencils; k++)
+    {
+        matches[k] = probeStencil(&stencils[k], 0);
+        linear[k] = probeStencil(&stencils[k], LINEAR_TOLERANCE);
+    }
+}
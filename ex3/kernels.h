@@ -0,0 +1,67 @@
+/**
+ * @author Idan Yamin
+ * @brief registry of update functions that are known linear 5-point stencils.
+ * a registered function that computes its weights is swept by the specialized kernels instead
+ * of being called per cell.
+ */
+
+#ifndef EX3_KERNELS_H
+#define EX3_KERNELS_H
+
+#include "calculator.h"
+#include "stencil.h"
+
+// most stencils the registry holds, the built-in ones included
+#define MAX_STENCILS 16
+
+/**
+ * an update function together with the weights it computes
+ */
+typedef struct LinearStencil
+{
+    diff_func function;
+    StencilWeights weights;
+} LinearStencil;
+
+/**
+ * weighted Jacobi relaxation of the heat equation with weight 2/3,
+ * x / 3 + (a + b + c + d) / 6. damps the high frequencies of the error faster than heat_eqn.
+ * @param x value of the cell
+ * @param a right neighbour
+ * @param b top neighbour
+ * @param c left neighbour
+ * @param d bottom neighbour
+ * @return the new value of the cell
+ */
+double damped_heat_eqn(double x, double a, double b, double c, double d);
+
+/**
+ * register a function as the stencil center * x + neighbour * ((c + a) + (b + d)).
+ * the function is probed on a few inputs, one that doesn't compute exactly that is never
+ * returned by findStencil, one that doesn't compute it up to rounding never by
+ * findLinearStencil. registering it again replaces the weights. not thread safe, register
+ * before any sweep runs.
+ * @param function the update function
+ * @param center weight of the cell itself
+ * @param neighbour weight of every neighbour
+ * @return 0 if succeeded, 1 if the registry is full
+ */
+int registerStencil(diff_func function, double center, double neighbour);
+
+/**
+ * @param function an update function
+ * @return the stencil of the function, NULL if it isn't registered or doesn't compute the
+ *         weights it was registered with
+ */
+const LinearStencil *findStencil(diff_func function);
+
+/**
+ * the stencil solvers that only need the weights of the function go by, the function may round
+ * its sums differently from the kernels
+ * @param function an update function
+ * @return the stencil of the function, NULL if it isn't registered or doesn't compute the
+ *         weights it was registered with up to rounding
+ */
+const LinearStencil *findLinearStencil(diff_func function);
+
+#endif //EX3_KERNELS_H
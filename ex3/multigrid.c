@@ -0,0 +1,658 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "multigrid.h"
+
+// index of a missing coarse cell, past a zero edge
+#define NO_CELL SIZE_MAX
+// a dimension longer than this is halved on the next level
+#define MIN_COARSENED 2
+// Gauss-Seidel sweeps on a coarse level before and after the next level
+#define LEVEL_SWEEPS 2
+// Gauss-Seidel sweeps on the coarsest level, at most 2 x 2 cells
+#define COARSEST_SWEEPS 16
+// coefficients of the 3 x 3 stencil of a coarse cell, and the one of the cell itself
+#define STENCIL_SIZE 9
+#define STENCIL_CENTER 4
+// coarse cells a cell of the finer level is interpolated from, at most
+#define COARSE_OF 4
+
+/**
+ * how a cell of the finer level is interpolated along one dimension from the next coarser
+ * level: weightLo * coarse[lo] + weightHi * coarse[hi]. a cell on top of a coarse cell has
+ * weightHi 0, a cell between two coarse cells has 1/2 for both, a NO_CELL index reads zero.
+ */
+typedef struct Interp
+{
+    size_t lo;
+    size_t hi;
+    double weightLo;
+    double weightHi;
+} Interp;
+
+/**
+ * one level of the hierarchy, with the error e and the right hand side f of A * e = f at every
+ * free cell. the operator A of a coarse level is the Galerkin product P^T * A * P of the finer
+ * operator with the interpolation P, so the edges and the pinned cells of the fine grid act the
+ * same on every level whatever the sizes. it is kept as a 3 x 3 stencil per cell, coefficient
+ * (di + 1) * 3 + (dj + 1) multiplies the cell (i + di, j + dj). r is the residual of the level
+ * and pinned marks the cells whose error is zero. rowInterp and colInterp interpolate every row
+ * and column of the finer level from this one, their transpose is the restriction.
+ * level 0 is the fine grid itself, its operator is the stencil of the calculator and it has no
+ * e, f or interpolation.
+ */
+typedef struct Level
+{
+    size_t rows;
+    size_t cols;
+    double *stencil;
+    double *e;
+    double *f;
+    double *r;
+    unsigned char *pinned;
+    Interp *rowInterp;
+    Interp *colInterp;
+} Level;
+
+/**
+ * the levels, from the fine grid down to the coarsest one. the operator of the fine grid is
+ * diagonal * e - neighbour * (left + right + bottom + top).
+ */
+struct Multigrid
+{
+    Level *levels;
+    size_t count;
+    int is_cyclic;
+    double diagonal;
+    double neighbour;
+};
+
+
+// ____________ functions _______________
+size_t coarserSize(size_t n, int is_cyclic);
+
+int buildLevel(Multigrid *multigrid, size_t index);
+
+Interp *buildInterp(size_t n, size_t coarse, int is_cyclic);
+
+void pinFine(const HeatGrid *grid, Level *fine);
+
+void galerkin(const Multigrid *multigrid, size_t index);
+
+int coarseOf(const Interp *row, const Interp *col, size_t *rows, size_t *cols, double *weights);
+
+int offsetOf(size_t from, size_t to, size_t n, int is_cyclic);
+
+size_t shifted(size_t i, int d, size_t n, int is_cyclic);
+
+const double *cellStencil(const Multigrid *multigrid, const Level *level, size_t at,
+                          double *fine);
+
+void vCycle(Multigrid *multigrid, size_t index);
+
+void smoothLevel(const Multigrid *multigrid, Level *level, unsigned int sweeps, int backward);
+
+double applyOff(const Multigrid *multigrid, const Level *level, const double *values,
+                size_t stride, size_t i, size_t j, const double *coefficients);
+
+void computeResidual(const Multigrid *multigrid, Level *level, const double *values,
+                     size_t stride, const double *f);
+
+void restrictResidual(const Level *finer, Level *level);
+
+void prolongError(const Level *level, const Level *finer, double *values, size_t stride);
+
+double interpolate(const Level *level, const Interp *row, const Interp *col);
+
+
+/**
+ * @param weights weights of a stencil
+ * @return 1 if the multigrid correction works for the stencil (a positive neighbour weight and
+ *         1 - center at least 4 * neighbour), 0 otherwise
+ */
+int multigridSupports(const StencilWeights *weights)
+{
+    return weights->neighbour > 0 && 1 - weights->center >= 4 * weights->neighbour;
+}
+
+/**
+ * build the hierarchy of coarser grids of a grid. every dimension longer than 2 is halved from
+ * level to level, so any size coarsens down to 2 x 2 at most. the correction is always zero at
+ * the pinned cells.
+ * @param grid the fine grid, with its sources pinned
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param weights weights of the stencil the grid is swept with, see multigridSupports
+ * @return new hierarchy, NULL if memory allocation went wrong
+ */
+Multigrid *createMultigrid(const HeatGrid *grid, int is_cyclic, const StencilWeights *weights)
+{
+    Multigrid *multigrid = malloc(sizeof(Multigrid));
+    if (!multigrid)
+    {
+        return NULL;
+    }
+    // every level halves a dimension, an empty grid has no coarser levels
+    size_t capacity = 1;
+    for (size_t rows = grid->rows, cols = grid->cols;
+         rows > 0 && cols > 0 && (rows > MIN_COARSENED || cols > MIN_COARSENED); capacity++)
+    {
+        rows = coarserSize(rows, is_cyclic);
+        cols = coarserSize(cols, is_cyclic);
+    }
+    multigrid->levels = calloc(capacity, sizeof(Level));
+    multigrid->count = 0;
+    multigrid->is_cyclic = is_cyclic;
+    multigrid->diagonal = 1 - weights->center;
+    multigrid->neighbour = weights->neighbour;
+    if (!multigrid->levels)
+    {
+        freeMultigrid(multigrid);
+        return NULL;
+    }
+
+    Level *fine = &multigrid->levels[0];
+    multigrid->count = 1;
+    fine->rows = grid->rows;
+    fine->cols = grid->cols;
+    size_t cells = fine->rows * fine->cols;
+    fine->r = malloc(sizeof(double) * (cells ? cells : 1));
+    fine->pinned = calloc(cells ? cells : 1, 1);
+    if (!fine->r || !fine->pinned)
+    {
+        freeMultigrid(multigrid);
+        return NULL;
+    }
+    pinFine(grid, fine);
+    while (multigrid->count < capacity)
+    {
+        multigrid->count++;
+        if (buildLevel(multigrid, multigrid->count - 1) == 1)
+        {
+            freeMultigrid(multigrid);
+            return NULL;
+        }
+    }
+    return multigrid;
+}
+
+/**
+ * @param n length of a dimension
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return length of the dimension on the next level. a zero edge sits one cell past both ends,
+ *         the coarse cells are on the odd cells. a cyclic dimension keeps the even cells.
+ */
+size_t coarserSize(size_t n, int is_cyclic)
+{
+    if (n <= MIN_COARSENED)
+    {
+        return n;
+    }
+    return is_cyclic ? (n + 1) / 2 : n / 2;
+}
+
+/**
+ * allocate a coarse level and derive its interpolation, operator and pinned cells
+ * @param multigrid the hierarchy, the levels above index are built
+ * @param index index of the level to build, at least 1
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int buildLevel(Multigrid *multigrid, size_t index)
+{
+    Level *level = &multigrid->levels[index];
+    const Level *finer = level - 1;
+    int is_cyclic = multigrid->is_cyclic;
+    level->rows = coarserSize(finer->rows, is_cyclic);
+    level->cols = coarserSize(finer->cols, is_cyclic);
+    size_t cells = level->rows * level->cols;
+    level->stencil = calloc(cells * STENCIL_SIZE, sizeof(double));
+    level->e = malloc(sizeof(double) * cells);
+    level->f = malloc(sizeof(double) * cells);
+    level->r = malloc(sizeof(double) * cells);
+    level->pinned = calloc(cells, 1);
+    level->rowInterp = buildInterp(finer->rows, level->rows, is_cyclic);
+    level->colInterp = buildInterp(finer->cols, level->cols, is_cyclic);
+    if (!level->stencil || !level->e || !level->f || !level->r || !level->pinned ||
+        !level->rowInterp || !level->colInterp)
+    {
+        return 1;
+    }
+    galerkin(multigrid, index);
+    // a cell whose interpolation only reaches pinned cells has no equation
+    for (size_t at = 0; at < cells; at++)
+    {
+        level->pinned[at] = level->stencil[at * STENCIL_SIZE + STENCIL_CENTER] <= 0;
+    }
+    return 0;
+}
+
+/**
+ * @param n length of the dimension on the finer level
+ * @param coarse length of the dimension on the coarser level, n when it isn't halved
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return interpolation of the n cells of the finer level, NULL if memory allocation went wrong
+ */
+Interp *buildInterp(size_t n, size_t coarse, int is_cyclic)
+{
+    Interp *interp = malloc(sizeof(Interp) * n);
+    if (!interp)
+    {
+        return NULL;
+    }
+    size_t offset = is_cyclic ? 0 : 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (coarse == n)
+        {
+            interp[i] = (Interp) {i, NO_CELL, 1, 0};
+        }
+        else if (i >= offset && (i - offset) % 2 == 0 && (i - offset) / 2 < coarse)
+        {
+            interp[i] = (Interp) {(i - offset) / 2, NO_CELL, 1, 0};
+        }
+        else
+        {
+            // between coarse cells lo and lo + 1, either of them may be past an edge
+            size_t lo = i >= offset + 1 ? (i - offset - 1) / 2 : NO_CELL;
+            size_t hi = (i + 1 - offset) / 2;
+            if (hi >= coarse)
+            {
+                hi = is_cyclic ? hi % coarse : NO_CELL;
+            }
+            interp[i] = (Interp) {lo, hi, 0.5, 0.5};
+        }
+    }
+    return interp;
+}
+
+/**
+ * mark the pinned cells of the fine grid
+ * @param grid the fine grid
+ * @param fine the fine level
+ */
+void pinFine(const HeatGrid *grid, Level *fine)
+{
+    for (size_t i = 0; i < grid->rows; i++)
+    {
+        const size_t *pinned = pinnedRowCols(grid, i);
+        for (size_t k = 0; k < pinnedInRow(grid, i); k++)
+        {
+            fine->pinned[i * fine->cols + pinned[k]] = 1;
+        }
+    }
+}
+
+/**
+ * the operator of a level as P^T * A * P, from the operator A of the finer level and the
+ * interpolation P of the level. the pinned cells of the finer level are left out of both P and
+ * P^T, their error is zero and they have no equation.
+ * @param multigrid the hierarchy
+ * @param index index of the level, at least 1
+ */
+void galerkin(const Multigrid *multigrid, size_t index)
+{
+    Level *level = &multigrid->levels[index];
+    const Level *finer = level - 1;
+    int is_cyclic = multigrid->is_cyclic;
+    double fine[STENCIL_SIZE];
+    size_t rows[COARSE_OF], cols[COARSE_OF], nrows[COARSE_OF], ncols[COARSE_OF];
+    double weights[COARSE_OF], nweights[COARSE_OF];
+    for (size_t i = 0; i < finer->rows; i++)
+    {
+        for (size_t j = 0; j < finer->cols; j++)
+        {
+            size_t at = i * finer->cols + j;
+            if (finer->pinned[at])
+            {
+                continue;
+            }
+            const double *coefficients = cellStencil(multigrid, finer, at, fine);
+            // P^T spreads the equation of (i, j) to its coarse cells
+            int count = coarseOf(&level->rowInterp[i], &level->colInterp[j], rows, cols,
+                                 weights);
+            for (int k = 0; k < STENCIL_SIZE; k++)
+            {
+                size_t ni = shifted(i, k / 3 - 1, finer->rows, is_cyclic);
+                size_t nj = shifted(j, k % 3 - 1, finer->cols, is_cyclic);
+                if (coefficients[k] == 0 || ni == NO_CELL || nj == NO_CELL ||
+                    finer->pinned[ni * finer->cols + nj])
+                {
+                    continue;
+                }
+                // P reads the error of (ni, nj) from its coarse cells
+                int ncount = coarseOf(&level->rowInterp[ni], &level->colInterp[nj], nrows,
+                                      ncols, nweights);
+                for (int a = 0; a < count; a++)
+                {
+                    double *target = level->stencil +
+                                     (rows[a] * level->cols + cols[a]) * STENCIL_SIZE;
+                    for (int b = 0; b < ncount; b++)
+                    {
+                        int di = offsetOf(rows[a], nrows[b], level->rows, is_cyclic);
+                        int dj = offsetOf(cols[a], ncols[b], level->cols, is_cyclic);
+                        target[(di + 1) * 3 + dj + 1] +=
+                                weights[a] * coefficients[k] * nweights[b];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * list the coarse cells a cell of the finer level is interpolated from
+ * @param row interpolation of the row of the cell
+ * @param col interpolation of the column of the cell
+ * @param rows put the rows of the coarse cells here
+ * @param cols put the columns of the coarse cells here
+ * @param weights put the weights of the coarse cells here
+ * @return number of coarse cells, at most COARSE_OF
+ */
+int coarseOf(const Interp *row, const Interp *col, size_t *rows, size_t *cols, double *weights)
+{
+    size_t rowCells[2] = {row->lo, row->hi}, colCells[2] = {col->lo, col->hi};
+    double rowWeights[2] = {row->weightLo, row->weightHi};
+    double colWeights[2] = {col->weightLo, col->weightHi};
+    int count = 0;
+    for (int a = 0; a < 2; a++)
+    {
+        for (int b = 0; b < 2; b++)
+        {
+            if (rowCells[a] != NO_CELL && colCells[b] != NO_CELL &&
+                rowWeights[a] != 0 && colWeights[b] != 0)
+            {
+                rows[count] = rowCells[a];
+                cols[count] = colCells[b];
+                weights[count] = rowWeights[a] * colWeights[b];
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @param from index of a cell along a dimension of a coarse level
+ * @param to index of a cell at most one cell away from it
+ * @param n length of the dimension
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return to - from, across the edge of a cyclic dimension
+ */
+int offsetOf(size_t from, size_t to, size_t n, int is_cyclic)
+{
+    if (to == from)
+    {
+        return 0;
+    }
+    return shifted(from, 1, n, is_cyclic) == to ? 1 : -1;
+}
+
+/**
+ * @param i index of a cell along a dimension
+ * @param d -1, 0 or 1
+ * @param n length of the dimension
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return index of the cell d cells away, NO_CELL past the edge of a non cyclic dimension
+ */
+size_t shifted(size_t i, int d, size_t n, int is_cyclic)
+{
+    if (d < 0 && i == 0)
+    {
+        return is_cyclic ? n - 1 : NO_CELL;
+    }
+    if (d > 0 && i + 1 == n)
+    {
+        return is_cyclic ? 0 : NO_CELL;
+    }
+    return i + d;
+}
+
+/**
+ * @param multigrid the hierarchy
+ * @param level a level of the hierarchy
+ * @param at index of a cell of the level
+ * @param fine room for the stencil of a cell of the fine grid, which isn't stored
+ * @return the 3 x 3 stencil of the operator at the cell
+ */
+const double *cellStencil(const Multigrid *multigrid, const Level *level, size_t at,
+                          double *fine)
+{
+    if (level->stencil)
+    {
+        return level->stencil + at * STENCIL_SIZE;
+    }
+    for (int k = 0; k < STENCIL_SIZE; k++)
+    {
+        fine[k] = k % 2 ? -multigrid->neighbour : 0;
+    }
+    fine[STENCIL_CENTER] = multigrid->diagonal;
+    return fine;
+}
+
+/**
+ * add the coarse grid correction to the free cells of the grid: the residual of the grid is
+ * restricted by full weighting, the error equation is solved approximately by a V-cycle of
+ * Gauss-Seidel sweeps on the coarser grids, and the error is interpolated back bilinearly.
+ * @param multigrid the hierarchy built for the grid
+ * @param grid the fine grid
+ */
+void multigridCorrect(Multigrid *multigrid, HeatGrid *grid)
+{
+    if (multigrid->count < 2)
+    {
+        return;
+    }
+    Level *fine = &multigrid->levels[0];
+    computeResidual(multigrid, fine, grid->data, grid->stride, NULL);
+    restrictResidual(fine, fine + 1);
+    vCycle(multigrid, 1);
+    prolongError(fine + 1, fine, grid->data, grid->stride);
+}
+
+/**
+ * solve the error equation of a coarse level approximately, starting from a zero error. the
+ * sweeps after the next level run backwards, so the cycle is symmetric.
+ * @param multigrid the hierarchy
+ * @param index index of the level, at least 1
+ */
+void vCycle(Multigrid *multigrid, size_t index)
+{
+    Level *level = &multigrid->levels[index];
+    memset(level->e, 0, sizeof(double) * level->rows * level->cols);
+    if (index + 1 == multigrid->count)
+    {
+        smoothLevel(multigrid, level, COARSEST_SWEEPS, 0);
+        return;
+    }
+    smoothLevel(multigrid, level, LEVEL_SWEEPS, 0);
+    computeResidual(multigrid, level, level->e, level->cols, level->f);
+    restrictResidual(level, level + 1);
+    vCycle(multigrid, index + 1);
+    prolongError(level + 1, level, level->e, level->cols);
+    smoothLevel(multigrid, level, LEVEL_SWEEPS, 1);
+}
+
+/**
+ * Gauss-Seidel sweeps over the free cells of a coarse level, in raster order
+ * @param multigrid the hierarchy
+ * @param level the level
+ * @param sweeps number of sweeps
+ * @param backward 1 to sweep from the last cell to the first one
+ */
+void smoothLevel(const Multigrid *multigrid, Level *level, unsigned int sweeps, int backward)
+{
+    size_t cells = level->rows * level->cols;
+    for (unsigned int sweep = 0; sweep < sweeps; sweep++)
+    {
+        for (size_t k = 0; k < cells; k++)
+        {
+            size_t at = backward ? cells - 1 - k : k;
+            if (!level->pinned[at])
+            {
+                const double *coefficients = level->stencil + at * STENCIL_SIZE;
+                double off = applyOff(multigrid, level, level->e, level->cols, at / level->cols,
+                                      at % level->cols, coefficients);
+                level->e[at] = (level->f[at] - off) / coefficients[STENCIL_CENTER];
+            }
+        }
+    }
+}
+
+/**
+ * @param multigrid the hierarchy
+ * @param level the level
+ * @param values values of the level, row i starts at values + i * stride
+ * @param stride distance between the rows
+ * @param i row
+ * @param j column
+ * @param coefficients the stencil of the cell
+ * @return the stencil applied to the neighbours of the cell, without the cell itself
+ */
+double applyOff(const Multigrid *multigrid, const Level *level, const double *values,
+                size_t stride, size_t i, size_t j, const double *coefficients)
+{
+    double sum = 0;
+    for (int k = 0; k < STENCIL_SIZE; k++)
+    {
+        if (k == STENCIL_CENTER || coefficients[k] == 0)
+        {
+            continue;
+        }
+        size_t ni = shifted(i, k / 3 - 1, level->rows, multigrid->is_cyclic);
+        size_t nj = shifted(j, k % 3 - 1, level->cols, multigrid->is_cyclic);
+        if (ni != NO_CELL && nj != NO_CELL)
+        {
+            sum += coefficients[k] * values[ni * stride + nj];
+        }
+    }
+    return sum;
+}
+
+/**
+ * level->r = f - A * values at every free cell, 0 at the pinned ones
+ * @param multigrid the hierarchy
+ * @param level the level
+ * @param values values of the level, row i starts at values + i * stride
+ * @param stride distance between the rows
+ * @param f the right hand side, NULL for zero
+ */
+void computeResidual(const Multigrid *multigrid, Level *level, const double *values,
+                     size_t stride, const double *f)
+{
+    double fine[STENCIL_SIZE];
+    for (size_t i = 0; i < level->rows; i++)
+    {
+        for (size_t j = 0; j < level->cols; j++)
+        {
+            size_t at = i * level->cols + j;
+            if (level->pinned[at])
+            {
+                level->r[at] = 0;
+                continue;
+            }
+            const double *coefficients = cellStencil(multigrid, level, at, fine);
+            double applied = coefficients[STENCIL_CENTER] * values[i * stride + j] +
+                             applyOff(multigrid, level, values, stride, i, j, coefficients);
+            level->r[at] = (f ? f[at] : 0) - applied;
+        }
+    }
+}
+
+/**
+ * restrict the residual of the finer level to the right hand side of a level, by the transpose
+ * of the interpolation
+ * @param finer the finer level
+ * @param level the level
+ */
+void restrictResidual(const Level *finer, Level *level)
+{
+    size_t rows[COARSE_OF], cols[COARSE_OF];
+    double weights[COARSE_OF];
+    memset(level->f, 0, sizeof(double) * level->rows * level->cols);
+    for (size_t i = 0; i < finer->rows; i++)
+    {
+        for (size_t j = 0; j < finer->cols; j++)
+        {
+            double r = finer->r[i * finer->cols + j];
+            if (r == 0)
+            {
+                continue;
+            }
+            int count = coarseOf(&level->rowInterp[i], &level->colInterp[j], rows, cols,
+                                 weights);
+            for (int k = 0; k < count; k++)
+            {
+                level->f[rows[k] * level->cols + cols[k]] += weights[k] * r;
+            }
+        }
+    }
+}
+
+/**
+ * add the interpolated error of a level to the free cells of the finer level
+ * @param level the level
+ * @param finer the finer level
+ * @param values values of the finer level, row i starts at values + i * stride
+ * @param stride distance between the rows
+ */
+void prolongError(const Level *level, const Level *finer, double *values, size_t stride)
+{
+    for (size_t i = 0; i < finer->rows; i++)
+    {
+        for (size_t j = 0; j < finer->cols; j++)
+        {
+            if (!finer->pinned[i * finer->cols + j])
+            {
+                values[i * stride + j] +=
+                        interpolate(level, &level->rowInterp[i], &level->colInterp[j]);
+            }
+        }
+    }
+}
+
+/**
+ * @param level the level
+ * @param row interpolation of the row
+ * @param col interpolation of the column
+ * @return the error of the level interpolated at the cell
+ */
+double interpolate(const Level *level, const Interp *row, const Interp *col)
+{
+    size_t rows[COARSE_OF], cols[COARSE_OF];
+    double weights[COARSE_OF];
+    int count = coarseOf(row, col, rows, cols, weights);
+    double sum = 0;
+    for (int k = 0; k < count; k++)
+    {
+        sum += weights[k] * level->e[rows[k] * level->cols + cols[k]];
+    }
+    return sum;
+}
+
+/**
+ * free a hierarchy
+ * @param multigrid the hierarchy, may be NULL
+ */
+void freeMultigrid(Multigrid *multigrid)
+{
+    if (!multigrid)
+    {
+        return;
+    }
+    for (size_t k = 0; multigrid->levels && k < multigrid->count; k++)
+    {
+        Level *level = &multigrid->levels[k];
+        free(level->stencil);
+        free(level->e);
+        free(level->f);
+        free(level->r);
+        free(level->pinned);
+        free(level->rowInterp);
+        free(level->colInterp);
+    }
+    free(multigrid->levels);
+    free(multigrid);
+}
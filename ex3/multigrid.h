@@ -0,0 +1,54 @@
+/**
+ * @author Idan Yamin
+ * @brief coarse grid correction of a geometric multigrid V-cycle for the grids of a linear
+ * stencil. the fine grid is smoothed by the calculator with the regular sweeps, this module
+ * restricts the residual to a hierarchy of coarser grids, runs the V-cycle on the error there
+ * and adds the interpolated correction back to the free cells of the fine grid.
+ */
+
+#ifndef EX3_MULTIGRID_H
+#define EX3_MULTIGRID_H
+
+#include "heat_grid.h"
+#include "stencil.h"
+
+// sweeps of the calculator before and after every coarse grid correction
+#define MULTIGRID_PRE_SWEEPS 2
+#define MULTIGRID_POST_SWEEPS 2
+
+typedef struct Multigrid Multigrid;
+
+/**
+ * @param weights weights of a stencil
+ * @return 1 if the multigrid correction works for the stencil (a positive neighbour weight and
+ *         1 - center at least 4 * neighbour), 0 otherwise
+ */
+int multigridSupports(const StencilWeights *weights);
+
+/**
+ * build the hierarchy of coarser grids of a grid. every dimension longer than 2 is halved from
+ * level to level, so any size coarsens down to 2 x 2 at most. the correction is always zero at
+ * the pinned cells.
+ * @param grid the fine grid, with its sources pinned
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param weights weights of the stencil the grid is swept with, see multigridSupports
+ * @return new hierarchy, NULL if memory allocation went wrong
+ */
+Multigrid *createMultigrid(const HeatGrid *grid, int is_cyclic, const StencilWeights *weights);
+
+/**
+ * add the coarse grid correction to the free cells of the grid: the residual of the grid is
+ * restricted by full weighting, the error equation is solved approximately by a V-cycle of
+ * Gauss-Seidel sweeps on the coarser grids, and the error is interpolated back bilinearly.
+ * @param multigrid the hierarchy built for the grid
+ * @param grid the fine grid
+ */
+void multigridCorrect(Multigrid *multigrid, HeatGrid *grid);
+
+/**
+ * free a hierarchy
+ * @param multigrid the hierarchy, may be NULL
+ */
+void freeMultigrid(Multigrid *multigrid);
+
+#endif //EX3_MULTIGRID_H
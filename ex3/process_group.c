@@ -0,0 +1,491 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "process_group.h"
+
+#define ERROR 1
+#define SUCCESS 0
+// name of the shared memory object, with the process id and a counter
+#define SHM_NAME_FORMAT "/ex3-%ld-%u"
+#define SHM_NAME_SIZE 64
+// nanoseconds the calling process waits before it looks for dead workers
+#define WORKER_CHECK_NS 100000000L
+#define NS_PER_SECOND 1000000000L
+
+/**
+ * head of the shared memory, before the memory of the processes. waiting processes are at the
+ * barrier of pass passes, runs counts the tasks runGroup started, the last one being task with
+ * arg. stop tells the workers to exit, broken that a process died, nobody waits for it then.
+ * a process sleeps on its own wake semaphore until the control changes, a post never waits for
+ * the process it wakes, which a condition variable may do when that process died waiting.
+ */
+typedef struct GroupControl
+{
+    pthread_mutex_t lock;
+    unsigned int waiting;
+    unsigned long passes;
+    unsigned long runs;
+    pool_task task;
+    void *arg;
+    int stop;
+    int broken;
+    sem_t wake[];
+} GroupControl;
+
+/**
+ * the group, one mapping of size bytes that starts with the control. workers are the process ids
+ * of the workers, 0 once waited for. every process has its own copy of the struct, index is the
+ * index of the process it belongs to.
+ */
+struct ProcessGroup
+{
+    unsigned int count;
+    unsigned int index;
+    pid_t *workers;
+    void *mapping;
+    size_t size;
+    GroupControl *control;
+    void *memory;
+};
+
+
+// ____________ functions _______________
+void *mapShared(size_t size);
+
+int initControl(GroupControl *control, unsigned int processes);
+
+int lockControl(const ProcessGroup *group);
+
+void wakeAll(const ProcessGroup *group);
+
+int changed(const ProcessGroup *group, unsigned long passes, unsigned long runs);
+
+void waitControl(ProcessGroup *group);
+
+int workerDied(ProcessGroup *group);
+
+void serveGroup(ProcessGroup *group);
+
+void closeInherited(void);
+
+void stopWorkers(ProcessGroup *group, unsigned int started);
+
+
+/**
+ * map a shared memory object for a group of processes and fork a worker process for every index
+ * but 0, the workers wait for the tasks of runGroup until the group is freed. the object is
+ * unlinked right away, it goes away with the last process that maps it. a worker must not
+ * allocate memory or use locks of the calling process, other threads of which don't exist in it.
+ * @param processes number of processes, the calling process counts as one of them, at least 1
+ * @param bytes size of the memory the processes share
+ * @return new group, NULL if the memory could not be created or mapped or a worker not forked
+ */
+ProcessGroup *createProcessGroup(unsigned int processes, size_t bytes)
+{
+    if (processes == 0)
+    {
+        return NULL;
+    }
+    ProcessGroup *group = malloc(sizeof(ProcessGroup));
+    pid_t *workers = malloc(sizeof(pid_t) * (processes - 1 ? processes - 1 : 1));
+    if (!group || !workers)
+    {
+        free(group);
+        free(workers);
+        return NULL;
+    }
+    size_t head = sizeof(GroupControl) + sizeof(sem_t) * processes;
+    head = (head + GROUP_ALIGNMENT - 1) / GROUP_ALIGNMENT;
+    head *= GROUP_ALIGNMENT;
+    group->count = processes;
+    group->index = 0;
+    group->workers = workers;
+    group->size = head + bytes;
+    group->mapping = mapShared(group->size);
+    if (!group->mapping)
+    {
+        free(workers);
+        free(group);
+        return NULL;
+    }
+    group->control = group->mapping;
+    group->memory = (char *) group->mapping + head;
+    if (initControl(group->control, processes) == ERROR)
+    {
+        munmap(group->mapping, group->size);
+        free(workers);
+        free(group);
+        return NULL;
+    }
+
+    pid_t parent = getpid();
+    for (unsigned int i = 0; i < processes - 1; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            // groupSync counts every process, so a group with missing workers can't run
+            stopWorkers(group, i);
+            return NULL;
+        }
+        if (pid == 0)
+        {
+            // a worker left without the calling process would wait for tasks forever
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != parent)
+            {
+                _exit(EXIT_FAILURE);
+            }
+            // the descriptors of the calling process, a daemon's sockets among them, stay
+            // with it, the group lives in mappings that outlast them
+            closeInherited();
+            group->index = i + 1;
+            serveGroup(group);
+        }
+        workers[i] = pid;
+    }
+    return group;
+}
+
+/**
+ * @param group the group
+ * @return the shared memory of the group, GROUP_ALIGNMENT aligned and zeroed when created
+ */
+void *groupMemory(const ProcessGroup *group)
+{
+    return group->memory;
+}
+
+/**
+ * @param group the group
+ * @return number of processes of the group
+ */
+unsigned int groupSize(const ProcessGroup *group)
+{
+    return group->count;
+}
+
+/**
+ * run the task on every process of the group, index 0 on the calling process, and wait for all
+ * of them to finish it
+ * @param group the group
+ * @param task the task
+ * @param arg argument given to the task, must point into the memory of the group
+ * @return 0 if every process ran the task to the end, 1 if a worker died. the group is broken
+ *         then, it runs no more tasks
+ */
+int runGroup(ProcessGroup *group, pool_task task, void *arg)
+{
+    GroupControl *control = group->control;
+    if (lockControl(group) == ERROR)
+    {
+        return ERROR;
+    }
+    int broken = control->broken;
+    if (!broken)
+    {
+        control->task = task;
+        control->arg = arg;
+        control->runs++;
+        wakeAll(group);
+    }
+    pthread_mutex_unlock(&control->lock);
+    if (broken)
+    {
+        return ERROR;
+    }
+    task(arg, 0, group->count);
+    // the workers are done with the task once they all got here
+    return groupSync(group);
+}
+
+/**
+ * wait until every process of the group reaches this point, call only from inside a task. the
+ * calling process looks for dead workers while it waits, so a worker that dies breaks the group
+ * instead of leaving the others waiting for it.
+ * @param group the group
+ * @return 0 if every process got here, 1 if the group is broken, the task should return then
+ */
+int groupSync(ProcessGroup *group)
+{
+    GroupControl *control = group->control;
+    if (lockControl(group) == ERROR)
+    {
+        return ERROR;
+    }
+    unsigned long pass = control->passes, runs = control->runs;
+    if (!control->broken && ++control->waiting == group->count)
+    {
+        control->waiting = 0;
+        control->passes++;
+        wakeAll(group);
+    }
+    pthread_mutex_unlock(&control->lock);
+    while (!changed(group, pass, runs))
+    {
+        waitControl(group);
+    }
+    return control->broken ? ERROR : SUCCESS;
+}
+
+/**
+ * stop the workers, unmap the shared memory and free the group
+ * @param group the group, may be NULL
+ */
+void freeProcessGroup(ProcessGroup *group)
+{
+    if (group)
+    {
+        stopWorkers(group, group->count - 1);
+    }
+}
+
+/**
+ * init the control of a group, a lock that survives the death of its owner and the wake
+ * semaphores of the processes
+ * @param control the control, zeroed
+ * @param processes number of processes
+ * @return 0 if succeeded, 1 otherwise
+ */
+int initControl(GroupControl *control, unsigned int processes)
+{
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    int failed = pthread_mutex_init(&control->lock, &attributes) != 0;
+    pthread_mutexattr_destroy(&attributes);
+    for (unsigned int i = 0; !failed && i < processes; i++)
+    {
+        if (sem_init(&control->wake[i], 1, 0) != 0)
+        {
+            while (i-- > 0)
+            {
+                sem_destroy(&control->wake[i]);
+            }
+            pthread_mutex_destroy(&control->lock);
+            failed = 1;
+        }
+    }
+    return failed ? ERROR : SUCCESS;
+}
+
+/**
+ * lock the control of a group. a process that died holding the lock breaks the group.
+ * @param group the group
+ * @return 0 if locked, 1 otherwise
+ */
+int lockControl(const ProcessGroup *group)
+{
+    GroupControl *control = group->control;
+    int result = pthread_mutex_lock(&control->lock);
+    if (result == EOWNERDEAD)
+    {
+        pthread_mutex_consistent(&control->lock);
+        control->broken = 1;
+        wakeAll(group);
+        return SUCCESS;
+    }
+    return result == 0 ? SUCCESS : ERROR;
+}
+
+/**
+ * wake every other process of a group to look at the control, with its lock held
+ * @param group the group
+ */
+void wakeAll(const ProcessGroup *group)
+{
+    for (unsigned int i = 0; i < group->count; i++)
+    {
+        if (i != group->index)
+        {
+            sem_post(&group->control->wake[i]);
+        }
+    }
+}
+
+/**
+ * @param group the group
+ * @param passes passes of the barrier the process waits at
+ * @param runs tasks started when the process began to wait
+ * @return 1 if the barrier or the tasks moved on, or the group is stopped or broken
+ */
+int changed(const ProcessGroup *group, unsigned long passes, unsigned long runs)
+{
+    GroupControl *control = group->control;
+    if (lockControl(group) == ERROR)
+    {
+        return 1;
+    }
+    int result = control->stop || control->broken || control->passes != passes ||
+                 control->runs != runs;
+    pthread_mutex_unlock(&control->lock);
+    return result;
+}
+
+/**
+ * sleep until another process wakes this one. the calling process wakes up every
+ * WORKER_CHECK_NS and breaks the group when a worker died.
+ * @param group the group
+ */
+void waitControl(ProcessGroup *group)
+{
+    sem_t *wake = &group->control->wake[group->index];
+    if (group->index != 0)
+    {
+        sem_wait(wake);
+        return;
+    }
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += WORKER_CHECK_NS;
+    if (until.tv_nsec >= NS_PER_SECOND)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= NS_PER_SECOND;
+    }
+    if (sem_timedwait(wake, &until) != 0 && errno == ETIMEDOUT && workerDied(group) &&
+        lockControl(group) == SUCCESS)
+    {
+        group->control->broken = 1;
+        wakeAll(group);
+        pthread_mutex_unlock(&group->control->lock);
+    }
+}
+
+/**
+ * @param group the group, of the calling process
+ * @return 1 if a worker exited, it is waited for, 0 otherwise
+ */
+int workerDied(ProcessGroup *group)
+{
+    int died = 0;
+    for (unsigned int i = 0; i < group->count - 1; i++)
+    {
+        int status;
+        if (group->workers[i] > 0 && waitpid(group->workers[i], &status, WNOHANG) > 0)
+        {
+            group->workers[i] = 0;
+            died = 1;
+        }
+    }
+    return died;
+}
+
+/**
+ * body of a worker, run the tasks of runGroup until the group is stopped or broken, then exit
+ * @param group the group, of the worker
+ */
+void serveGroup(ProcessGroup *group)
+{
+    GroupControl *control = group->control;
+    unsigned long runs = 0;
+    while (lockControl(group) == SUCCESS)
+    {
+        unsigned long passes = control->passes;
+        int done = control->stop || control->broken;
+        int ready = control->runs != runs;
+        runs = control->runs;
+        pool_task task = control->task;
+        void *arg = control->arg;
+        pthread_mutex_unlock(&control->lock);
+        if (done)
+        {
+            break;
+        }
+        if (!ready)
+        {
+            while (!changed(group, passes, runs))
+            {
+                waitControl(group);
+            }
+            continue;
+        }
+        task(arg, group->index, group->count);
+        groupSync(group);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * tell the workers to exit, wait for them and free the group
+ * @param group the group, of the calling process
+ * @param started number of workers forked
+ */
+void stopWorkers(ProcessGroup *group, unsigned int started)
+{
+    GroupControl *control = group->control;
+    if (lockControl(group) == SUCCESS)
+    {
+        control->stop = 1;
+        wakeAll(group);
+        pthread_mutex_unlock(&control->lock);
+    }
+    for (unsigned int i = 0; i < started; i++)
+    {
+        while (group->workers[i] > 0 && waitpid(group->workers[i], NULL, 0) < 0 &&
+               errno == EINTR)
+        {
+        }
+    }
+    for (unsigned int i = 0; i < group->count; i++)
+    {
+        sem_destroy(&control->wake[i]);
+    }
+    pthread_mutex_destroy(&control->lock);
+    munmap(group->mapping, group->size);
+    free(group->workers);
+    free(group);
+}
+
+/**
+ * create a POSIX shared memory object of the given size, map it and unlink it
+ * @param size size in bytes
+ * @return the mapping, NULL if the object could not be created or mapped
+ */
+void *mapShared(size_t size)
+{
+    static unsigned int counter = 0;
+    char name[SHM_NAME_SIZE];
+    snprintf(name, sizeof(name), SHM_NAME_FORMAT, (long) getpid(), counter++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    shm_unlink(name);
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, (off_t) size) == 0)
+    {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+/**
+ * close every descriptor of a new worker but the standard ones, so a socket or a file the calling
+ * process closes is closed for good
+ */
+void closeInherited(void)
+{
+    long last = sysconf(_SC_OPEN_MAX);
+    for (long fd = STDERR_FILENO + 1; fd < last; fd++)
+    {
+        close((int) fd);
+    }
+}
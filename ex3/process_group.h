@@ -0,0 +1,69 @@
+/**
+ * @author Idan Yamin
+ * @brief persistent worker processes that all run the same task together, the processes
+ * counterpart of thread_pool.h. the processes share one POSIX shared memory object and whatever
+ * the calling process mapped shared before the group, everything else they see is a copy of the
+ * calling process taken when the group is created.
+ */
+
+#ifndef EX3_PROCESS_GROUP_H
+#define EX3_PROCESS_GROUP_H
+
+#include <stddef.h>
+#include "thread_pool.h"
+
+// alignment in bytes of the shared memory of a group
+#define GROUP_ALIGNMENT 64
+
+typedef struct ProcessGroup ProcessGroup;
+
+/**
+ * map a shared memory object for a group of processes and fork a worker process for every index
+ * but 0, the workers wait for the tasks of runGroup until the group is freed. the object is
+ * unlinked right away, it goes away with the last process that maps it. a worker must not
+ * allocate memory or use locks of the calling process, other threads of which don't exist in it.
+ * @param processes number of processes, the calling process counts as one of them, at least 1
+ * @param bytes size of the memory the processes share
+ * @return new group, NULL if the memory could not be created or mapped or a worker not forked
+ */
+ProcessGroup *createProcessGroup(unsigned int processes, size_t bytes);
+
+/**
+ * @param group the group
+ * @return the shared memory of the group, GROUP_ALIGNMENT aligned and zeroed when created
+ */
+void *groupMemory(const ProcessGroup *group);
+
+/**
+ * @param group the group
+ * @return number of processes of the group
+ */
+unsigned int groupSize(const ProcessGroup *group);
+
+/**
+ * run the task on every process of the group, index 0 on the calling process, and wait for all
+ * of them to finish it
+ * @param group the group
+ * @param task the task
+ * @param arg argument given to the task, must point into the memory of the group
+ * @return 0 if every process ran the task to the end, 1 if a worker died. the group is broken
+ *         then, it runs no more tasks
+ */
+int runGroup(ProcessGroup *group, pool_task task, void *arg);
+
+/**
+ * wait until every process of the group reaches this point, call only from inside a task. the
+ * calling process looks for dead workers while it waits, so a worker that dies breaks the group
+ * instead of leaving the others waiting for it.
+ * @param group the group
+ * @return 0 if every process got here, 1 if the group is broken, the task should return then
+ */
+int groupSync(ProcessGroup *group);
+
+/**
+ * stop the workers, unmap the shared memory and free the group
+ * @param group the group, may be NULL
+ */
+void freeProcessGroup(ProcessGroup *group);
+
+#endif //EX3_PROCESS_GROUP_H
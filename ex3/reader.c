@@ -4,39 +4,242 @@
  * @brief to be in the same format as in the pdf description, meaning after ',' there must be a whitespace.
  */
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "async_writer.h"
 #include "calculator.h"
+#include "checkpoint.h"
+#include "grid_calculator.h"
+#include "grid_writer.h"
 #include "heat_eqn.h"
+#include "kernels.h"
+#include "scanner.h"
+#include "thread_pool.h"
 
 #define LINE_LEN 1000
+// sources the source array starts with, it doubles when full
+#define FIRST_SOURCES 64
+// default number of seconds between two checkpoints
+#define CHECKPOINT_INTERVAL 60
+// longest command word of a daemon, with the terminating '\0'
+#define COMMAND_LEN 16
+// clients of a daemon socket waiting to be served
+#define DAEMON_BACKLOG 8
+// seconds a socket client may keep the daemon waiting for a command or on a reply
+#define CLIENT_TIMEOUT 30
+// inputs the input list starts with, it doubles when full
+#define FIRST_INPUTS 64
 #define ERROR 1
 #define SUCCESS 0
 
 const char NUM_SEPERATOR[] = ",";
 const char COMMAND_SEPERATOR[] = "----";
+const char THREADS_FLAG[] = "-t";
+const char ORDER_FLAG[] = "-o";
+const char CHECK_FLAG[] = "-k";
+const char TILE_FLAG[] = "-d";
+const char FORMAT_FLAG[] = "-f";
+const char PIPELINE_FLAG[] = "-p";
+const char CHECKPOINT_FLAG[] = "-c";
+const char INTERVAL_FLAG[] = "-e";
+const char RESUME_FLAG[] = "-r";
+const char BATCH_FLAG[] = "-b";
+// the output file of a batch input is its name with this suffix, in the output directory
+const char OUTPUT_SUFFIX[] = ".out";
+const char SOLVER_FLAG[] = "-m";
+const char ACTIVE_FLAG[] = "-a";
+const char PROCESSES_FLAG[] = "-w";
+const char DISK_FLAG[] = "-x";
+const char TRACE_FLAG[] = "-i";
+const char TRACE_INTERVAL_FLAG[] = "-l";
+const char PRECISION_FLAG[] = "-q";
+const char SERVE_FLAG[] = "-s";
+// the path of -s that serves the commands of stdin instead of a socket
+const char SERVE_STDIN[] = "-";
+// a trace file with this suffix is written as JSON, any other as CSV
+const char JSON_SUFFIX[] = ".json";
+const char RASTER_ORDER[] = "raster";
+const char RED_BLACK_ORDER[] = "red-black";
+const char JACOBI_ORDER[] = "jacobi";
+const char RELAX_SOLVER[] = "relax";
+const char VCYCLE_SOLVER[] = "vcycle";
+const char SOR_SOLVER[] = "sor";
+const char DOUBLE_PRECISION[] = "double";
+const char FLOAT_PRECISION[] = "float";
+const char MIXED_PRECISION[] = "mixed";
+const char NEUMANN_EDGES[] = "neumann";
+const char DIRICHLET_EDGES[] = "dirichlet";
+const char ADD_COMMAND[] = "add";
+const char UPDATE_COMMAND[] = "update";
+const char REMOVE_COMMAND[] = "remove";
+const char PRINT_COMMAND[] = "print";
+const char QUIT_COMMAND[] = "quit";
+const char TEXT_FORMAT[] = "text";
+const char BINARY_FORMAT[] = "binary";
+const char BINARY32_FORMAT[] = "binary32";
 // messages
 const char FORMAT_ERROR[] = "Bad format\n";
 const char MEM_ERR[] = "Memory allocation error\n";
 const char OUT_OF_RANGE[] = "Sources out of range\n";
 const char FILE_OPENING_ERR[] = "File opening error\n";
+const char WRITE_ERR[] = "Output writing error\n";
+const char GRID_FILE_ERR[] = "Grid file error\n";
+const char TRACE_ERR[] = "Trace writing error\n";
+const char BATCH_READ_ERR[] = "Batch inputs reading error\n";
+const char BATCH_NAME_ERR[] = "Batch inputs named %s write the same output\n";
+const char SCENARIO_ERR[] = "Scenario %s failed\n";
+const char CHECKPOINT_READ_ERR[] = "Checkpoint reading error\n";
+const char CHECKPOINT_WRITE_ERR[] = "Checkpoint writing error\n";
+const char SOR_REPORT[] = "SOR omega %.4f, about %.0f sweeps saved\n";
+const char SOLVER_IGNORED[] = "heat_eqn is not a linear stencil, the solver is ignored\n";
+const char PRECISION_IGNORED[] = "Float sweeps need one thread and heat_eqn a linear stencil, "
+                                 "the precision is ignored\n";
+const char SOCKET_ERR[] = "Socket error\n";
+// replies of a daemon
+const char SOLVED_REPLY[] = "ok %lf %" PRIu64 "\n";
+const char BAD_COMMAND_REPLY[] = "error bad command\n";
+const char OUT_OF_RANGE_REPLY[] = "error out of range\n";
+const char SOURCE_EXISTS_REPLY[] = "error source exists\n";
+const char NO_SOURCE_REPLY[] = "error no source\n";
+const char MEM_REPLY[] = "error memory\n";
+const char USAGE_ERR[] = "Usage: ex3 <input file> [-t threads] [-w processes] [-o raster|red-black|jacobi] [-k sweeps]\n"
+                         "           [-d depth] [-m relax|vcycle|sor] [-a threshold] [-f text|binary|binary32]\n"
+                         "           [-p buffers] [-c checkpoint] [-e seconds] [-x directory] [-i trace]\n"
+                         "           [-l sweeps] [-q double|float|mixed] [-s socket|-]\n"
+                         "       ex3 -r <checkpoint> [options]\n"
+                         "       ex3 -b <input directory|list> <output directory> [options]\n";
 
 /**
- * init all of the entries to zero
- * @param grid the grid
- * @param row number of rows
- * @param col number of cols
+ * command line options, threads is 0 when not given.
+ * batchPath: directory of input files, or file with an input path on every line, to solve in
+ *            one process instead of inputPath, NULL for none. the inputs are solved at the same
+ *            time by threads workers (the number of processors when not given), each sweeping
+ *            alone, the results go to outputPath. the flags of a single run that don't make
+ *            sense for many of them (-w, -p, -c, -x, -i, -s) can't be given with it.
+ * outputPath: directory the output of every batch input goes to, named after the input. a batch
+ *             with two inputs of the same name is not run.
+ * processes: number of worker processes sweeping the grid instead of threads (see
+ *            CalcOptions), 0 when not given. more than 1 keeps the grid in shared memory (see
+ *            shareGrid).
+ * resumePath: checkpoint to continue instead of reading an input file, NULL for none. the run
+ *             keeps the order, checkEvery and solver of the checkpoint, the -o, -k and -m
+ *             flags are ignored.
+ * checkpointPath: file to write checkpoints to, NULL for none.
+ * checkpointEvery: least number of seconds between two checkpoints.
+ * checkEvery: look at the difference every checkEvery sweeps when running until convergence.
+ * tileDepth: number of sweeps advanced per pass over the grid (see CalcOptions).
+ * solver: how a run until convergence gets to the solution (see Solver).
+ * activeThreshold: only update the tiles around the cells that moved by more than it, negative
+ *                  for every cell (see CalcOptions).
+ * format: text output, or binary snapshots (see snapshot.h) of float64 or float32 values.
+ * pipeline: number of grid copies a writer thread prints from while the calculation goes on,
+ *           0 to print on the main thread. it can't be given with diskPath.
+ * diskPath: directory of a scratch file the grid of the input or the checkpoint is kept in (see
+ *           mapGrid), NULL to keep it in memory. such a grid is swept by one thread in stripes,
+ *           the threads, processes, tiles and active region are not used for it. it is printed
+ *           from the mapping on the main thread, so no copy of it is ever kept in memory.
+ * tracePath: file the sweeps are traced to (see trace.h), as JSON when it ends with .json and
+ *            as CSV otherwise, NULL for none.
+ * traceInterval: number of sweeps of a line of the trace.
+ * precision: what the sweeps keep the values in (see Precision), a resumed run takes it from the
+ *            command line.
+ * servePath: UNIX socket to serve edits of the sources on once the grid is solved, "-" for
+ *            stdin, NULL to print the results and exit (see runDaemon). a daemon keeps no
+ *            checkpoints and prints on its own thread, -c and -p are ignored.
+ */
+typedef struct RunOptions
+{
+    const char *inputPath;
+    const char *resumePath;
+    const char *batchPath;
+    const char *outputPath;
+    const char *checkpointPath;
+    unsigned int checkpointEvery;
+    unsigned int threads;
+    unsigned int processes;
+    UpdateOrder order;
+    unsigned int checkEvery;
+    unsigned int tileDepth;
+    Solver solver;
+    double activeThreshold;
+    OutputFormat format;
+    unsigned int pipeline;
+    const char *diskPath;
+    const char *tracePath;
+    unsigned int traceInterval;
+    Precision precision;
+    const char *servePath;
+} RunOptions;
+
+/**
+ * a batch run shared by the workers of the pool, next is the index of the next input to solve.
+ * failed is set when an input could not be solved.
+ */
+typedef struct Batch
+{
+    const RunOptions *options;
+    char **inputs;
+    size_t numOfInputs;
+    size_t next;
+    int failed;
+    pthread_mutex_t lock;
+} Batch;
+
+/**
+ * a daemon run (see runDaemon): the grid, its sources and the calculator kept from one command
+ * to the next. value and sweeps are the difference and the number of sweeps of the last solve.
+ * quit is set by the quit command.
+ */
+typedef struct Daemon
+{
+    const RunOptions *options;
+    Calculator *calc;
+    HeatGrid *grid;
+    const CheckpointState *run;
+    source_point *sources;
+    size_t numOfSources;
+    double value;
+    uint64_t sweeps;
+    int quit;
+} Daemon;
+
+/**
+ * @param arg a command line argument
+ * @param value put the value here
+ * @return 0 if arg is a positive integer, 1 otherwise
+ */
+int parsePositive(const char *arg, unsigned int *value);
+
+/**
+ * @param arg a command line argument
+ * @param value put the value here
+ * @return 0 if arg is a number at least 0, 1 otherwise
  */
-void initGridValues(double **grid, size_t row, size_t col);
+int parseThreshold(const char *arg, double *value);
 
 /**
- * build grid with zeros
- * @param row number of rows of new grid
- * @param col number of cols of new grid
- * @return new grid
+ * parse the command line: the input file (or -r and a checkpoint, or -b, the inputs and the
+ * output directory), then optional flags
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options put the options here
+ * @return 0 if succeeded, 1 otherwise
  */
-double **buildGrid(size_t row, size_t col);
+int parseArguments(int argc, char *argv[], RunOptions *options);
 
 /**
  * put sources on the grid
@@ -45,364 +248,1726 @@ double **buildGrid(size_t row, size_t col);
  * @param numOfPoints number of sources
  * @return 1 if points out of range, 0 if succeeded.
  */
-int putSources(double **grid, size_t m, size_t n, source_point *sources, size_t numOfPoints);
+int putSources(HeatGrid *grid, source_point *sources, size_t numOfPoints);
 
 /**
  * get row and col from user
  * @param row update the row
  * @param col update the col
+ * @param scanner the input
  * @return 1 if there was an error, 0 if succeed.
  */
-int getRowAndCol(size_t *row, size_t *col, FILE *file);
+int getRowAndCol(size_t *row, size_t *col, Scanner *scanner);
 
 /**
  * update sources and numOfSources
  * @param sources make sure to send NULL
  * @param numOfSources num of sources
- * @param file the file of the input
+ * @param scanner the input
  * @return 1 of there was an error, 0 if succeeded.
  */
-int buildSources(source_point **sources, size_t *numOfSources, FILE *file);
+int buildSources(source_point **sources, size_t *numOfSources, Scanner *scanner);
 
 /**
- * free grid
- * @param grid the grid to free
- * @param n rows
- * @param m columns
+ * read one source, like fscanf("%d, %d, %lf")
+ * @param scanner the input
+ * @param source put the source here
+ * @return number of fields read, EOF at the end of the input
  */
-void freeGrid(double **grid, size_t n);
+int scanSource(Scanner *scanner, source_point *source);
 
 /**
  * get final section of parameters
  * @param termination put the termination value here
  * @param iterNum  put the iterNum here
  * @param isCyclic  put the isCyclic here
- * @param file the input file
+ * @param threads put the optional number of threads here, 0 when the file has none
+ * @param edges put the optional edges here, "neumann" or "dirichlet" and a value, zero
+ *              Dirichlet edges when the file has none. anything else after the flags is ignored
+ * @param edgeValue put the value of Dirichlet edges here
+ * @param scanner the input
  * @return 0 if succeeded, 1 otherwise
  */
-int getFinalParameters(double *termination, unsigned int *iterNum, int *isCyclic, FILE *file);
+int getFinalParameters(double *termination, unsigned int *iterNum, int *isCyclic,
+                       unsigned int *threads, EdgeKind *edges, double *edgeValue,
+                       Scanner *scanner);
+
+/**
+ * read the input file: the grid with the sources on it, and the mode of the run
+ * @param options the command line options
+ * @param grid put the new grid here, a grid already there is reused (see reuseGrid) and NULL
+ *             is put on an error
+ * @param sources put the new sources here
+ * @param numOfSources put the number of sources here
+ * @param run put the mode of the run here, with no sweeps done
+ * @return 0 if succeeded, 1 otherwise, after printing the error
+ */
+int readInput(const RunOptions *options, HeatGrid **grid, source_point **sources,
+              size_t *numOfSources, CheckpointState *run);
+
+/**
+ * print results, then the omega of a SOR run and about how many sweeps it saved on stderr
+ * @param calc the calculator
+ * @param writer the writer of the printed grids
+ * @param pipeline number of grid copies for a writer thread, 0 to write on this thread
+ * @param checkpointer the checkpointer of the run, NULL for none
+ * @param grid of heat values
+ * @param run the mode of the run and the sweeps it starts after
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int printResults(Calculator *calc, GridWriter *writer, unsigned int pipeline,
+                 Checkpointer *checkpointer, HeatGrid *grid, const CheckpointState *run);
 
 /**
- * print results
+ * one calculateGrid call of the run
+ * @param calc the calculator
+ * @param checkpointer the checkpointer of the run, NULL for none
  * @param grid of heat values
- * @param n number of rows
- * @param m number columns
- * @param sources of heat
- * @param num_sources
- * @param terminate terminate threshold
- * @param n_iter number of iter per print
- * @param is_cyclic cyclic or not
+ * @param run the mode of the run
+ * @param sweeps sweeps done since the start of the run, updated
+ * @param callSweeps sweeps of this n_iter call that were already done
+ * @param delta the last difference measured, -1 if none was
+ * @return the difference of the last iteration, -1 if memory allocation went wrong
+ */
+double calculateCall(Calculator *calc, Checkpointer *checkpointer, HeatGrid *grid,
+                     const CheckpointState *run, uint64_t *sweeps, unsigned int callSweeps,
+                     double delta);
+
+/**
+ * print one grid, through the writer thread when there is one
+ * @param writer the writer of the printed grids
+ * @param async the writer thread, NULL to write on this thread
+ * @param grid of heat values
+ * @param value heat value
+ * @param sweeps number of sweeps done so far
+ */
+void printGrid(GridWriter *writer, AsyncWriter *async, const HeatGrid *grid, double value,
+               uint64_t sweeps);
+
+/**
+ * solve every input of a batch and write the outputs
+ * @param options the command line options, with a batch
+ * @return 0 if every input was solved, 1 otherwise, after printing the errors
+ */
+int runBatch(const RunOptions *options);
+
+/**
+ * list the inputs of a batch: the files of a directory, sorted by name, or the lines of a list
+ * @param path the directory or the list
+ * @param numOfInputs put the number of inputs here
+ * @return the paths of the inputs, NULL if the inputs could not be read
+ */
+char **listInputs(const char *path, size_t *numOfInputs);
+
+/**
+ * @param inputs array of paths
+ * @param numOfInputs number of paths
+ */
+void freeInputs(char **inputs, size_t numOfInputs);
+
+/**
+ * compare two inputs for qsort
+ * @param a first input
+ * @param b second input
+ * @return negative, zero or positive like strcmp
+ */
+int compareInputs(const void *a, const void *b);
+
+/**
+ * @param input path of an input
+ * @return the name of the input, the part of the path after the last slash, its output is
+ *         named after it
+ */
+const char *inputName(const char *input);
+
+/**
+ * find two inputs of a batch with the same name, whose outputs would be the same file
+ * @param inputs the paths of the inputs
+ * @param numOfInputs number of inputs
+ * @param name put the name here, NULL when every input has a name of its own
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int findSharedName(char *const *inputs, size_t numOfInputs, const char **name);
+
+/**
+ * body of a batch worker: take the next input until none is left, with one calculator and one
+ * grid reused for all of them
+ * @param arg the Batch
+ * @param index index of the worker
+ * @param count number of workers
+ */
+void batchTask(void *arg, unsigned int index, unsigned int count);
+
+/**
+ * solve one input of a batch into its output file
+ * @param options the command line options
+ * @param calc the calculator of the worker
+ * @param grid the grid of the worker, reused for the input when it has room for it, may be NULL
+ * @param input path of the input
+ * @return 0 if succeeded, 1 otherwise
+ */
+int solveScenario(const RunOptions *options, Calculator *calc, HeatGrid **grid,
+                  const char *input);
+
+/**
+ * @param options the command line options
+ * @param threads number of threads of the calculator
+ * @return the calculator options of the run
+ */
+CalcOptions runCalcOptions(const RunOptions *options, unsigned int threads);
+
+/**
+ * tell on stderr about the options of the calculator heat_eqn can't be solved with, the run
+ * goes on without them
+ * @param calcOptions the calculator options of the run
+ */
+void reportIgnored(const CalcOptions *calcOptions);
+
+/**
+ * solve the grid, then keep it and its sources and serve edits of the sources, one command per
+ * line, from stdin or from the clients of a UNIX socket one after the other:
+ * "add x, y, value", "update x, y, value" and "remove x, y" change the sources and solve the
+ * grid again from the solution it had, "print" writes the grid in the output format, "quit"
+ * stops the daemon. a solve replies "ok" with its difference and number of sweeps, a command
+ * that can't be carried out "error" and the reason. a socket client that sends nothing, or reads
+ * nothing, for CLIENT_TIMEOUT seconds is let go for the next one.
+ * @param options the command line options, with a servePath
+ * @param calc the calculator
+ * @param grid of heat values, with the sources on it
+ * @param sources the sources, updated by the commands
+ * @param numOfSources number of sources, updated by the commands
+ * @param run the mode of the run
+ * @return 0 if the daemon quit or its input ended, 1 otherwise, after printing the error
+ */
+int runDaemon(const RunOptions *options, Calculator *calc, HeatGrid *grid,
+              source_point **sources, size_t *numOfSources, const CheckpointState *run);
+
+/**
+ * run calculateGrid calls the way printResults does, from the grid as it is, until the
+ * difference is below terminate
+ * @param daemon the daemon, value and sweeps get the solve
+ * @param callSweeps sweeps of the first n_iter call that were already done
+ * @param delta the last difference measured, -1 if none was
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int solveDaemon(Daemon *daemon, unsigned int callSweeps, double delta);
+
+/**
+ * serve the clients of a UNIX socket until one of them sends quit
+ * @param daemon the daemon
+ * @param path path of the socket, a socket already there is replaced
+ * @return 0 if succeeded, 1 otherwise, after printing the error
+ */
+int serveSocket(Daemon *daemon, const char *path);
+
+/**
+ * serve the commands of one input until it ends or quit
+ * @param daemon the daemon
+ * @param input the commands
+ * @param out file descriptor the replies are written to, it stays open
+ * @return 0 if succeeded, 1 if memory allocation went wrong
  */
-void printResults(double **grid, size_t n, size_t m, source_point *sources, size_t num_sources,
-                  double terminate, unsigned int n_iter, int is_cyclic);
+int serveCommands(Daemon *daemon, FILE *input, int out);
+
+/**
+ * carry out one command line
+ * @param daemon the daemon
+ * @param line the command
+ * @param out file descriptor the reply is written to
+ * @param writer the writer of the printed grid, on out
+ * @return 0 if succeeded, 1 if a solve went wrong
+ */
+int runCommand(Daemon *daemon, const char *line, int out, GridWriter *writer);
+
+/**
+ * add, update or remove a source and pin the sources of the grid again. the edited sources are
+ * built apart and only take the place of the old ones once they are pinned, so a failed edit
+ * leaves the sources and the pinned cells as they were.
+ * @param daemon the daemon
+ * @param command ADD_COMMAND, UPDATE_COMMAND or REMOVE_COMMAND
+ * @param source the source, the value is ignored for a removal
+ * @return NULL if the sources changed, or else the error reply
+ */
+const char *editSources(Daemon *daemon, const char *command, source_point source);
 
 int main(int argc, char *argv[])
 {
     // parameters
-    char line[LINE_LEN];
-    FILE *file = NULL;
-    size_t rowNum = 0, colNum = 0, numOfSources = 0;
-    unsigned int iterNum = 0;
-    double **grid = NULL, termination = 0;
-    int error = 0, isCyclic = 0;
+    size_t numOfSources = 0;
+    HeatGrid *grid = NULL;
+    int error = 0;
     source_point *sources = NULL;
+    RunOptions options;
+    CheckpointState run;
 
 
     //  not the right amount of arguments
-    if (argc != 2)
+    if (argc < 2)
     {
         fprintf(stderr, FILE_OPENING_ERR);
         return ERROR;
     }
-    strcpy(line, argv[1]);
-    file = fopen(line, "r");
-    if (file == NULL)
+    if (parseArguments(argc, argv, &options) == ERROR)
     {
-        fprintf(stderr, FILE_OPENING_ERR);
-        fclose(file);
+        fprintf(stderr, USAGE_ERR);
         return ERROR;
     }
-
-    // get rows and columns
-    error = getRowAndCol(&rowNum, &colNum, file);
-    if (error)
+    if (options.batchPath)
     {
-        fprintf(stderr, FORMAT_ERROR);
-        fclose(file);
-        return ERROR;
+        return runBatch(&options);
     }
 
-    // building a grid in the right size
-    grid = buildGrid(rowNum, colNum);
-    if (grid == NULL)
+    // the grid, the sources and the mode of the run come from the input or from a checkpoint
+    if (options.resumePath)
     {
-        fprintf(stderr, MEM_ERR);
-        fclose(file);
-        return ERROR;
+        if (readCheckpoint(options.resumePath, options.diskPath, options.processes > 1, &grid,
+                           &sources, &numOfSources, &run) == ERROR)
+        {
+            fprintf(stderr, CHECKPOINT_READ_ERR);
+            return ERROR;
+        }
     }
-
-    // build sources, free grid in case of error
-    if (buildSources(&sources, &numOfSources, file) == ERROR)
+    else if (readInput(&options, &grid, &sources, &numOfSources, &run) == ERROR)
     {
-        freeGrid(grid, rowNum);
-        fprintf(stderr, FORMAT_ERROR);
-        fclose(file);
         return ERROR;
     }
 
-    // get termination iterNum and isCyclic
-    if (getFinalParameters(&termination, &iterNum, &isCyclic, file) == ERROR)
+    // the command line overrides the number of threads in the file or the checkpoint, worker
+    // processes sweep like as many threads and are kept as such
+    if (options.processes > 0)
     {
-        free(sources);
-        freeGrid(grid, rowNum);
-        fprintf(stderr, FORMAT_ERROR);
-        fclose(file);
-        return ERROR;
+        run.threads = options.processes;
+    }
+    else if (options.threads > 0)
+    {
+        run.threads = options.threads;
+    }
+    CalcOptions calcOptions = runCalcOptions(&options, options.processes > 0 ? 1 : run.threads);
+    calcOptions.processes = options.processes > 0 ? options.processes : 1;
+    calcOptions.order = run.order;
+    calcOptions.checkEvery = run.checkEvery;
+    calcOptions.solver = run.solver;
+    reportIgnored(&calcOptions);
+    Calculator *calc = createCalculator(&calcOptions);
+    // a SOR run goes on with the omega it had
+    if (calc && run.relaxation.omega != 0)
+    {
+        setRelaxation(calc, &run.relaxation);
+    }
+    GridWriter *writer = createWriter(STDOUT_FILENO, WRITER_CAPACITY, options.format);
+    Checkpointer *checkpointer = NULL;
+    if (calc && options.checkpointPath)
+    {
+        checkpointer = createCheckpointer(options.checkpointPath, options.checkpointEvery, grid,
+                                          sources, numOfSources, &run);
+        if (checkpointer)
+        {
+            setSweepHook(calc, checkpointHook, checkpointer);
+        }
+    }
+    Trace *trace = NULL;
+    if (calc && options.tracePath)
+    {
+        const char *path = options.tracePath;
+        size_t length = strlen(path), suffix = strlen(JSON_SUFFIX);
+        int json = length >= suffix && strcmp(path + length - suffix, JSON_SUFFIX) == 0;
+        trace = createTrace(path, json ? TRACE_JSON : TRACE_CSV, options.traceInterval);
+        setTrace(calc, trace);
     }
 
-    //put sources on board
-    if (putSources(grid, rowNum, colNum, sources, numOfSources) == ERROR)
+    // print results, or keep the grid and serve edits of its sources
+    if (!calc || !writer || (options.checkpointPath && !checkpointer))
     {
-        free(sources);
-        freeGrid(grid, rowNum);
-        fprintf(stderr, OUT_OF_RANGE);
-        fclose(file);
-        return ERROR;
+        fprintf(stderr, MEM_ERR);
+        error = ERROR;
+    }
+    // createTrace opens the file, an -i path that can't be written is what fails there
+    else if (options.tracePath && !trace)
+    {
+        fprintf(stderr, TRACE_ERR);
+        error = ERROR;
+    }
+    else if (options.servePath)
+    {
+        error = runDaemon(&options, calc, grid, &sources, &numOfSources, &run);
+    }
+    else if (printResults(calc, writer, options.pipeline, checkpointer, grid, &run) == ERROR)
+    {
+        fprintf(stderr, MEM_ERR);
+        error = ERROR;
+    }
+    else if (flushWriter(writer) == ERROR)
+    {
+        fprintf(stderr, WRITE_ERR);
+        error = ERROR;
+    }
+    // waits for the checkpoint being written
+    if (freeCheckpointer(checkpointer) == ERROR)
+    {
+        fprintf(stderr, CHECKPOINT_WRITE_ERR);
+        error = ERROR;
     }
 
-    // print results
-    printResults(grid, rowNum, colNum, sources, numOfSources, termination, iterNum, isCyclic);
+    if (freeTrace(trace) == ERROR)
+    {
+        fprintf(stderr, TRACE_ERR);
+        error = ERROR;
+    }
 
     // free all sources
-    freeGrid(grid, rowNum);
+    freeWriter(writer);
+    freeCalculator(calc);
+    freeGrid(grid);
     free(sources);
 
-    // close file
-    fclose(file);
-    return SUCCESS;
+    return error ? ERROR : SUCCESS;
 }
 
 /**
- * print grid
- * @param grid grid of heat values
- * @param n number of rows
- * @param m number of columns
- * @param value heat value
+ * read the input file: the grid with the sources on it, and the mode of the run
+ * @param options the command line options
+ * @param grid put the new grid here, a grid already there is reused (see reuseGrid) and NULL
+ *             is put on an error
+ * @param sources put the new sources here
+ * @param numOfSources put the number of sources here
+ * @param run put the mode of the run here, with no sweeps done
+ * @return 0 if succeeded, 1 otherwise, after printing the error
  */
-void printGrid(double *const *grid, size_t n, size_t m, double value)
+int readInput(const RunOptions *options, HeatGrid **grid, source_point **sources,
+              size_t *numOfSources, CheckpointState *run)
 {
-    printf("%lf\n", value);
-    for (size_t i = 0; i < n; i++)
-    {
-        for (size_t j = 0; j < m; j++)
-        {
-            printf("%2.4lf,", grid[i][j]);
-        }
-        printf("\n");
-    }
-}
-
-/**
- * print results
- * @param grid of heat values
- * @param n number of rows
- * @param m number columns
- * @param sources of heat
- * @param num_sources
- * @param terminate terminate threshold
- * @param n_iter number of iter per print
- * @param is_cyclic cyclic or not
- */
-void printResults(double **grid, size_t n, size_t m, source_point *sources, size_t num_sources,
-                  double terminate, unsigned int n_iter, int is_cyclic)
-{
-    double value = calculate(heat_eqn, grid, n, m, sources, num_sources, terminate, n_iter,
-                             is_cyclic);
-    while (value > terminate)
-    {
-        printGrid(grid, n, m, value);
-        value = calculate(heat_eqn, grid, n, m, sources, num_sources, terminate, n_iter,
-                          is_cyclic);
-    }
-    printGrid(grid, n, m, value);
-}
+    Scanner scanner;
+    size_t rowNum = 0, colNum = 0;
+    unsigned int iterNum = 0, fileThreads = 0;
+    double termination = 0, edgeValue = 0;
+    int isCyclic = 0;
+    EdgeKind edges = EDGE_DIRICHLET;
 
-/**
- * get final section of parameters
- * @param termination put the termination value here
- * @param iterNum  put the iterNum here
- * @param isCyclic  put the isCyclic here
- * @param file the input file
- * @return 0 if succeeded, 1 otherwise
- */
-int getFinalParameters(double *termination, unsigned int *iterNum, int *isCyclic, FILE *file)
-{
-    char line[LINE_LEN];
-    int errFlag = fscanf(file, "%s", line);
-    if (errFlag != 1 || strcmp(line, COMMAND_SEPERATOR + 1) != 0)
+    if (openScanner(options->inputPath, &scanner) == ERROR)
     {
+        fprintf(stderr, FILE_OPENING_ERR);
         return ERROR;
     }
-    if (fscanf(file, "%lf", termination) != 1)
+
+    // get rows and columns
+    if (getRowAndCol(&rowNum, &colNum, &scanner) == ERROR)
     {
+        fprintf(stderr, FORMAT_ERROR);
+        closeScanner(&scanner);
         return ERROR;
     }
-    int signedIter = 0;
-    if (fscanf(file, "%d", &signedIter) != 1)
+
+    // building a grid in the right size, on the disk, in memory shared with the worker processes
+    // or in memory, in the given grid if any
+    if (options->diskPath)
     {
-        return ERROR;
+        *grid = mapGrid(options->diskPath, rowNum, colNum);
     }
-    if (signedIter < 0)
+    else if (options->processes > 1)
     {
-        *iterNum = 0;
+        *grid = shareGrid(rowNum, colNum);
     }
     else
     {
-        *iterNum =(unsigned int) signedIter;
+        *grid = reuseGrid(*grid, rowNum, colNum);
     }
-    if (fscanf(file, "%d", isCyclic) != 1)
+    if (*grid == NULL)
     {
+        fprintf(stderr, options->diskPath ? GRID_FILE_ERR : MEM_ERR);
+        closeScanner(&scanner);
         return ERROR;
     }
-    return SUCCESS;
-}
 
-/**
- * free grid
- * @param grid the grid to free
- * @param n rows
- * @param m columns
- */
-void freeGrid(double **grid, size_t n)
-{
-    for (size_t i = 0; i < n; i++)
+    // build sources, free grid in case of error
+    *sources = NULL;
+    if (buildSources(sources, numOfSources, &scanner) == ERROR)
     {
-        free(grid[i]);
+        freeGrid(*grid);
+        *grid = NULL;
+        fprintf(stderr, FORMAT_ERROR);
+        closeScanner(&scanner);
+        return ERROR;
     }
-    free(grid);
-}
 
-/**
- * update sources and numOfSources
- * @param sources make sure to send NULL
- * @param numOfSources num of sources
- * @param file the file of the input
- * @return 1 of there was an error, 0 if succeeded.
- */
-int buildSources(source_point **sources, size_t *numOfSources, FILE *file)
-{
-    *numOfSources = 0;
-    int row = 0, col = 0;
-    double heat = 0;
-    // while you can still read points
-    while (fscanf(file, "%d, %d, %lf", &row, &col, &heat) == 3)
+    // get termination iterNum isCyclic and the edges
+    if (getFinalParameters(&termination, &iterNum, &isCyclic, &fileThreads, &edges, &edgeValue,
+                           &scanner) == ERROR)
     {
-        sources[0] = (source_point *) realloc(sources[0],
-                                              sizeof(source_point) * ((*numOfSources) + 1));
-        if (!(*sources))
-        {
-            free(sources);
-            return ERROR;
-        }
-        sources[0][*numOfSources].x = row;
-        sources[0][*numOfSources].y = col;
-        sources[0][*numOfSources].value = heat;
-        (*numOfSources)++;
+        free(*sources);
+        freeGrid(*grid);
+        *grid = NULL;
+        fprintf(stderr, FORMAT_ERROR);
+        closeScanner(&scanner);
+        return ERROR;
     }
 
-    return SUCCESS;
-}
-
-/**
- * get row and col from user
- * @param row update the row
- * @param col update the col
- * @return 1 if there was an error, 0 if succeed.
- */
-int getRowAndCol(size_t *row, size_t *col, FILE *file)
-{
-    int errorFlag = 0;
-    char str[LINE_LEN] = "";
-    // try to get first number
-    errorFlag = fscanf(file, "%lu, %lu", row, col);
-    if (!errorFlag)
+    //put sources on board
+    if (putSources(*grid, *sources, *numOfSources) == ERROR)
     {
+        free(*sources);
+        freeGrid(*grid);
+        *grid = NULL;
+        fprintf(stderr, OUT_OF_RANGE);
+        closeScanner(&scanner);
         return ERROR;
     }
-    // expected ---- after the the size of the board
-    fscanf(file, "%s", str);
-    if (strcmp(str, COMMAND_SEPERATOR) != 0)
+
+    // index the source cells once so the calculator skips them without searching
+    if (pinSources(*grid, *sources, *numOfSources) == ERROR ||
+        setEdges(*grid, edges, edgeValue) == ERROR)
     {
+        free(*sources);
+        freeGrid(*grid);
+        *grid = NULL;
+        fprintf(stderr, MEM_ERR);
+        closeScanner(&scanner);
         return ERROR;
     }
+    closeScanner(&scanner);
+
+    run->terminate = termination;
+    run->n_iter = iterNum;
+    run->is_cyclic = isCyclic;
+    run->order = options->order;
+    run->checkEvery = options->checkEvery;
+    run->solver = options->solver;
+    run->threads = fileThreads > 0 ? fileThreads : 1;
+    run->sweeps = 0;
+    run->callSweeps = 0;
+    run->delta = -1;
+    memset(&run->relaxation, 0, sizeof(Relaxation));
+    run->edges = (*grid)->edges;
+    run->edgeValue = (*grid)->edgeValue;
     return SUCCESS;
 }
 
 /**
- * put sources on the grid
- * @param grid the grid
- * @param sources sources to insert to the grid
- * @param numOfPoints number of sources
- * @return 1 if points out of range, 0 if succeeded.
+ * parse the command line: the input file (or -r and a checkpoint, or -b, the inputs and the
+ * output directory), then optional flags
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @param options put the options here
+ * @return 0 if succeeded, 1 otherwise
  */
-int putSources(double **grid, size_t m, size_t n, source_point *sources, size_t numOfPoints)
+int parseArguments(int argc, char *argv[], RunOptions *options)
 {
-    for (size_t i = 0; i < numOfPoints; i++)
+    int first = 2;
+    options->inputPath = argv[1];
+    options->resumePath = NULL;
+    options->batchPath = NULL;
+    options->outputPath = NULL;
+    if (strcmp(argv[1], BATCH_FLAG) == 0)
     {
-        if ((size_t)sources[i].x >= m || (size_t)sources[i].x < 0 || (size_t)sources[i].y >= n ||
-            (size_t)sources[i].y < 0)
+        if (argc < 4)
         {
             return ERROR;
         }
-        grid[sources[i].x][sources[i].y] = sources[i].value;
+        options->inputPath = NULL;
+        options->batchPath = argv[2];
+        options->outputPath = argv[3];
+        first = 4;
     }
-    return SUCCESS;
-}
-
-/**
- * build grid with zeros
- * @param row number of rows of new grid
- * @param col number of cols of new grid
- * @return new grid
- */
-double **buildGrid(size_t row, size_t col)
-{
-    double **newGrid = malloc(sizeof(int **) * row);
-    if (!newGrid)
+    else if (strcmp(argv[1], RESUME_FLAG) == 0)
     {
-        return NULL;
+        if (argc < 3)
+        {
+            return ERROR;
+        }
+        options->inputPath = NULL;
+        options->resumePath = argv[2];
+        first = 3;
     }
-    for (size_t i = 0; i < row; i++)
+    options->checkpointPath = NULL;
+    options->checkpointEvery = CHECKPOINT_INTERVAL;
+    options->threads = 0;
+    options->processes = 0;
+    options->order = ORDER_RASTER;
+    options->checkEvery = 1;
+    options->tileDepth = 1;
+    options->solver = SOLVER_RELAX;
+    options->activeThreshold = -1;
+    options->format = OUTPUT_TEXT;
+    options->pipeline = 0;
+    options->diskPath = NULL;
+    options->tracePath = NULL;
+    options->traceInterval = 1;
+    options->precision = PRECISION_DOUBLE;
+    options->servePath = NULL;
+    for (int i = first; i < argc; i++)
     {
-        newGrid[i] = malloc(sizeof(int *) * col);
-        // in case of an allocation error free all memory
-        if (!newGrid[i])
+        if (strcmp(argv[i], THREADS_FLAG) == 0 && i + 1 < argc)
         {
-            for (size_t j = 0; j < i; j++)
+            if (parsePositive(argv[++i], &options->threads) == ERROR)
             {
-                free(newGrid[i]);
+                return ERROR;
             }
-            free(newGrid);
-            return NULL;
         }
-    }
-    initGridValues(newGrid, row, col);
-    return newGrid;
-}
-
-/**
- * init all of the entries to zero
- * @param grid the grid
- * @param row number of rows
- * @param col number of cols
- */
-void initGridValues(double **grid, size_t row, size_t col)
-{
-    for (size_t i = 0; i < row; i++)
-    {
-        for (size_t j = 0; j < col; j++)
+        else if (strcmp(argv[i], PROCESSES_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->processes) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], CHECK_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->checkEvery) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], TILE_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->tileDepth) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], ORDER_FLAG) == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], RASTER_ORDER) == 0)
+            {
+                options->order = ORDER_RASTER;
+            }
+            else if (strcmp(argv[i], RED_BLACK_ORDER) == 0)
+            {
+                options->order = ORDER_RED_BLACK;
+            }
+            else if (strcmp(argv[i], JACOBI_ORDER) == 0)
+            {
+                options->order = ORDER_JACOBI;
+            }
+            else
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], SOLVER_FLAG) == 0 && i + 1 < argc)
         {
-            grid[i][j] = 0;
+            i++;
+            if (strcmp(argv[i], RELAX_SOLVER) == 0)
+            {
+                options->solver = SOLVER_RELAX;
+            }
+            else if (strcmp(argv[i], VCYCLE_SOLVER) == 0)
+            {
+                options->solver = SOLVER_MULTIGRID;
+            }
+            else if (strcmp(argv[i], SOR_SOLVER) == 0)
+            {
+                options->solver = SOLVER_SOR;
+            }
+            else
+            {
+                return ERROR;
+            }
         }
+        else if (strcmp(argv[i], PRECISION_FLAG) == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], DOUBLE_PRECISION) == 0)
+            {
+                options->precision = PRECISION_DOUBLE;
+            }
+            else if (strcmp(argv[i], FLOAT_PRECISION) == 0)
+            {
+                options->precision = PRECISION_FLOAT;
+            }
+            else if (strcmp(argv[i], MIXED_PRECISION) == 0)
+            {
+                options->precision = PRECISION_MIXED;
+            }
+            else
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], ACTIVE_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parseThreshold(argv[++i], &options->activeThreshold) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], CHECKPOINT_FLAG) == 0 && i + 1 < argc)
+        {
+            options->checkpointPath = argv[++i];
+        }
+        else if (strcmp(argv[i], SERVE_FLAG) == 0 && i + 1 < argc)
+        {
+            options->servePath = argv[++i];
+        }
+        else if (strcmp(argv[i], DISK_FLAG) == 0 && i + 1 < argc)
+        {
+            options->diskPath = argv[++i];
+        }
+        else if (strcmp(argv[i], TRACE_FLAG) == 0 && i + 1 < argc)
+        {
+            options->tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], TRACE_INTERVAL_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->traceInterval) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], INTERVAL_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->checkpointEvery) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], PIPELINE_FLAG) == 0 && i + 1 < argc)
+        {
+            if (parsePositive(argv[++i], &options->pipeline) == ERROR)
+            {
+                return ERROR;
+            }
+        }
+        else if (strcmp(argv[i], FORMAT_FLAG) == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], TEXT_FORMAT) == 0)
+            {
+                options->format = OUTPUT_TEXT;
+            }
+            else if (strcmp(argv[i], BINARY_FORMAT) == 0)
+            {
+                options->format = OUTPUT_BINARY;
+            }
+            else if (strcmp(argv[i], BINARY32_FORMAT) == 0)
+            {
+                options->format = OUTPUT_BINARY32;
+            }
+            else
+            {
+                return ERROR;
+            }
+        }
+        else
+        {
+            return ERROR;
+        }
+    }
+    if (options->batchPath && (options->processes > 0 || options->pipeline > 0 ||
+                               options->checkpointPath || options->diskPath ||
+                               options->tracePath || options->servePath))
+    {
+        return ERROR;
+    }
+    if (options->servePath)
+    {
+        options->checkpointPath = NULL;
+        options->pipeline = 0;
+    }
+    // the copies of the writer thread would keep in memory the grid the disk is there to hold
+    if (options->pipeline > 0 && options->diskPath)
+    {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @param arg a command line argument
+ * @param value put the value here
+ * @return 0 if arg is a positive integer, 1 otherwise
+ */
+int parsePositive(const char *arg, unsigned int *value)
+{
+    char *end = NULL;
+    long parsed = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || parsed <= 0 || parsed > (long) UINT_MAX)
+    {
+        return ERROR;
+    }
+    *value = (unsigned int) parsed;
+    return SUCCESS;
+}
+
+/**
+ * @param arg a command line argument
+ * @param value put the value here
+ * @return 0 if arg is a number at least 0, 1 otherwise
+ */
+int parseThreshold(const char *arg, double *value)
+{
+    char *end = NULL;
+    double parsed = strtod(arg, &end);
+    if (end == arg || *end != '\0' || !(parsed >= 0))
+    {
+        return ERROR;
+    }
+    *value = parsed;
+    return SUCCESS;
+}
+
+/**
+ * print results, then the omega of a SOR run and about how many sweeps it saved on stderr
+ * @param calc the calculator
+ * @param writer the writer of the printed grids
+ * @param pipeline number of grid copies for a writer thread, 0 to write on this thread
+ * @param checkpointer the checkpointer of the run, NULL for none
+ * @param grid of heat values
+ * @param run the mode of the run and the sweeps it starts after
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int printResults(Calculator *calc, GridWriter *writer, unsigned int pipeline,
+                 Checkpointer *checkpointer, HeatGrid *grid, const CheckpointState *run)
+{
+    AsyncWriter *async = NULL;
+    if (pipeline > 0)
+    {
+        async = createAsyncWriter(writer, grid->rows, grid->cols, pipeline);
+        if (!async)
+        {
+            return ERROR;
+        }
+    }
+    uint64_t sweeps = run->sweeps;
+    // a resumed run first finishes the call the checkpoint was taken in
+    double value = calculateCall(calc, checkpointer, grid, run, &sweeps, run->callSweeps,
+                                 run->delta);
+    while (value > run->terminate)
+    {
+        printGrid(writer, async, grid, value, sweeps);
+        value = calculateCall(calc, checkpointer, grid, run, &sweeps, 0, value);
+    }
+    // a NaN difference is printed like any other, only -1 is an error
+    if (value != -1)
+    {
+        printGrid(writer, async, grid, value, sweeps);
+    }
+    // waits for the queued grids
+    freeAsyncWriter(async);
+    Relaxation relaxation;
+    if (value != -1 && calculatorRelaxation(calc, &relaxation))
+    {
+        fprintf(stderr, SOR_REPORT, relaxation.omega, relaxation.gaussSeidel - (double) sweeps);
+    }
+    return value == -1 ? ERROR : SUCCESS;
+}
+
+/**
+ * one calculateGrid call of the run
+ * @param calc the calculator
+ * @param checkpointer the checkpointer of the run, NULL for none
+ * @param grid of heat values
+ * @param run the mode of the run
+ * @param sweeps sweeps done since the start of the run, updated
+ * @param callSweeps sweeps of this n_iter call that were already done
+ * @param delta the last difference measured, -1 if none was
+ * @return the difference of the last iteration, -1 if memory allocation went wrong
+ */
+double calculateCall(Calculator *calc, Checkpointer *checkpointer, HeatGrid *grid,
+                     const CheckpointState *run, uint64_t *sweeps, unsigned int callSweeps,
+                     double delta)
+{
+    if (checkpointer)
+    {
+        beginCheckpointCall(checkpointer, *sweeps, callSweeps, delta);
+    }
+    unsigned int n_iter = run->n_iter > 0 ? run->n_iter - callSweeps : 0;
+    double value = calculateGrid(calc, heat_eqn, grid, run->terminate, n_iter, run->is_cyclic);
+    *sweeps += calculatorSweeps(calc);
+    return value;
+}
+
+/**
+ * print one grid, through the writer thread when there is one
+ * @param writer the writer of the printed grids
+ * @param async the writer thread, NULL to write on this thread
+ * @param grid of heat values
+ * @param value heat value
+ * @param sweeps number of sweeps done so far
+ */
+void printGrid(GridWriter *writer, AsyncWriter *async, const HeatGrid *grid, double value,
+               uint64_t sweeps)
+{
+    if (async)
+    {
+        submitGrid(async, grid, value, sweeps);
+    }
+    else
+    {
+        writeGrid(writer, grid, value, sweeps);
+    }
+}
+
+/**
+ * get final section of parameters
+ * @param termination put the termination value here
+ * @param iterNum  put the iterNum here
+ * @param isCyclic  put the isCyclic here
+ * @param threads put the optional number of threads here, 0 when the file has none
+ * @param edges put the optional edges here, "neumann" or "dirichlet" and a value, zero
+ *              Dirichlet edges when the file has none. anything else after the flags is ignored
+ * @param edgeValue put the value of Dirichlet edges here
+ * @param scanner the input
+ * @return 0 if succeeded, 1 otherwise
+ */
+int getFinalParameters(double *termination, unsigned int *iterNum, int *isCyclic,
+                       unsigned int *threads, EdgeKind *edges, double *edgeValue,
+                       Scanner *scanner)
+{
+    char line[LINE_LEN];
+    // the failed source read took the first '-' of the separator
+    int errFlag = scanWord(scanner, line, LINE_LEN);
+    if (errFlag != 1 || strcmp(line, COMMAND_SEPERATOR + 1) != 0)
+    {
+        return ERROR;
+    }
+    if (scanDouble(scanner, termination) != 1)
+    {
+        return ERROR;
+    }
+    int signedIter = 0;
+    if (scanInt(scanner, &signedIter) != 1)
+    {
+        return ERROR;
+    }
+    if (signedIter < 0)
+    {
+        *iterNum = 0;
+    }
+    else
+    {
+        *iterNum =(unsigned int) signedIter;
+    }
+    if (scanInt(scanner, isCyclic) != 1)
+    {
+        return ERROR;
+    }
+    // optional number of threads after the cyclic flag
+    int signedThreads = 0;
+    *threads = 0;
+    if (scanInt(scanner, &signedThreads) == 1 && signedThreads > 0)
+    {
+        *threads = (unsigned int) signedThreads;
+    }
+    // optional edges of a grid that isn't cyclic
+    *edges = EDGE_DIRICHLET;
+    *edgeValue = 0;
+    if (scanWord(scanner, line, LINE_LEN) != 1)
+    {
+        return SUCCESS;
+    }
+    if (strcmp(line, NEUMANN_EDGES) == 0)
+    {
+        *edges = EDGE_NEUMANN;
+        return SUCCESS;
+    }
+    // any other word is trailing content, which the files had before the edges were read
+    if (strcmp(line, DIRICHLET_EDGES) == 0 && scanDouble(scanner, edgeValue) != 1)
+    {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * update sources and numOfSources
+ * @param sources make sure to send NULL
+ * @param numOfSources num of sources
+ * @param scanner the input
+ * @return 1 of there was an error, 0 if succeeded.
+ */
+int buildSources(source_point **sources, size_t *numOfSources, Scanner *scanner)
+{
+    *numOfSources = 0;
+    size_t capacity = 0;
+    source_point source;
+    // while you can still read points
+    while (scanSource(scanner, &source) == 3)
+    {
+        if (*numOfSources == capacity)
+        {
+            // grow geometrically, so the sources are copied O(1) times each on average
+            capacity = capacity ? 2 * capacity : FIRST_SOURCES;
+            source_point *grown = realloc(*sources, sizeof(source_point) * capacity);
+            if (!grown)
+            {
+                free(*sources);
+                *sources = NULL;
+                return ERROR;
+            }
+            *sources = grown;
+        }
+        (*sources)[(*numOfSources)++] = source;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * read one source, like fscanf("%d, %d, %lf")
+ * @param scanner the input
+ * @param source put the source here
+ * @return number of fields read, EOF at the end of the input
+ */
+int scanSource(Scanner *scanner, source_point *source)
+{
+    int result = scanInt(scanner, &source->x);
+    if (result != 1)
+    {
+        return result;
+    }
+    if (scanLiteral(scanner, NUM_SEPERATOR[0]) != 1)
+    {
+        return 1;
+    }
+    skipSpaces(scanner);
+    if (scanInt(scanner, &source->y) != 1)
+    {
+        return 1;
+    }
+    if (scanLiteral(scanner, NUM_SEPERATOR[0]) != 1)
+    {
+        return 2;
+    }
+    skipSpaces(scanner);
+    if (scanDouble(scanner, &source->value) != 1)
+    {
+        return 2;
+    }
+    return 3;
+}
+
+/**
+ * get row and col from user
+ * @param row update the row
+ * @param col update the col
+ * @param scanner the input
+ * @return 1 if there was an error, 0 if succeed.
+ */
+int getRowAndCol(size_t *row, size_t *col, Scanner *scanner)
+{
+    char str[LINE_LEN] = "";
+    // try to get first number, as fscanf("%lu, %lu") only no number at all is an error
+    unsigned long value = 0;
+    int errorFlag = scanUnsignedLong(scanner, &value);
+    if (!errorFlag)
+    {
+        return ERROR;
+    }
+    if (errorFlag == 1)
+    {
+        *row = value;
+        if (scanLiteral(scanner, NUM_SEPERATOR[0]) == 1)
+        {
+            skipSpaces(scanner);
+            if (scanUnsignedLong(scanner, &value) == 1)
+            {
+                *col = value;
+            }
+        }
+    }
+    // expected ---- after the the size of the board
+    scanWord(scanner, str, LINE_LEN);
+    if (strcmp(str, COMMAND_SEPERATOR) != 0)
+    {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * put sources on the grid
+ * @param grid the grid
+ * @param sources sources to insert to the grid
+ * @param numOfPoints number of sources
+ * @return 1 if points out of range, 0 if succeeded.
+ */
+int putSources(HeatGrid *grid, source_point *sources, size_t numOfPoints)
+{
+    for (size_t i = 0; i < numOfPoints; i++)
+    {
+        if ((size_t)sources[i].x >= grid->rows || (size_t)sources[i].x < 0 ||
+            (size_t)sources[i].y >= grid->cols || (size_t)sources[i].y < 0)
+        {
+            return ERROR;
+        }
+        GRID_AT(grid, sources[i].x, sources[i].y) = sources[i].value;
+    }
+    return SUCCESS;
+}
+
+/**
+ * solve every input of a batch and write the outputs
+ * @param options the command line options, with a batch
+ * @return 0 if every input was solved, 1 otherwise, after printing the errors
+ */
+int runBatch(const RunOptions *options)
+{
+    Batch batch;
+    batch.inputs = listInputs(options->batchPath, &batch.numOfInputs);
+    if (!batch.inputs)
+    {
+        fprintf(stderr, BATCH_READ_ERR);
+        return ERROR;
+    }
+    // the inputs of a list may be in different directories
+    const char *shared = NULL;
+    if (findSharedName(batch.inputs, batch.numOfInputs, &shared) == ERROR || shared)
+    {
+        if (shared)
+        {
+            fprintf(stderr, BATCH_NAME_ERR, shared);
+        }
+        else
+        {
+            fprintf(stderr, MEM_ERR);
+        }
+        freeInputs(batch.inputs, batch.numOfInputs);
+        return ERROR;
+    }
+    batch.options = options;
+    batch.next = 0;
+    batch.failed = 0;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int workers = options->threads;
+    if (workers == 0)
+    {
+        workers = processors > 0 ? (unsigned int) processors : 1;
+    }
+    if (workers > batch.numOfInputs)
+    {
+        workers = batch.numOfInputs > 0 ? (unsigned int) batch.numOfInputs : 1;
+    }
+    ThreadPool *pool = createPool(workers);
+    if (!pool || pthread_mutex_init(&batch.lock, NULL) != 0)
+    {
+        freePool(pool);
+        freeInputs(batch.inputs, batch.numOfInputs);
+        fprintf(stderr, MEM_ERR);
+        return ERROR;
+    }
+    CalcOptions calcOptions = runCalcOptions(options, 1);
+    reportIgnored(&calcOptions);
+    runPool(pool, batchTask, &batch);
+    freePool(pool);
+    pthread_mutex_destroy(&batch.lock);
+    freeInputs(batch.inputs, batch.numOfInputs);
+    return batch.failed ? ERROR : SUCCESS;
+}
+
+/**
+ * list the inputs of a batch: the files of a directory, sorted by name, or the lines of a list
+ * @param path the directory or the list
+ * @param numOfInputs put the number of inputs here
+ * @return the paths of the inputs, NULL if the inputs could not be read
+ */
+char **listInputs(const char *path, size_t *numOfInputs)
+{
+    struct stat status;
+    if (stat(path, &status) != 0)
+    {
+        return NULL;
+    }
+    int directory = S_ISDIR(status.st_mode);
+    DIR *entries = directory ? opendir(path) : NULL;
+    FILE *list = directory ? NULL : fopen(path, "r");
+    if (!entries && !list)
+    {
+        return NULL;
+    }
+    size_t size = FIRST_INPUTS, count = 0;
+    char **inputs = malloc(sizeof(char *) * size);
+    char line[PATH_MAX];
+    int failed = inputs == NULL;
+    while (!failed)
+    {
+        char *input = NULL;
+        if (directory)
+        {
+            struct dirent *entry = readdir(entries);
+            if (!entry)
+            {
+                break;
+            }
+            // hidden files, . and .. are not inputs
+            if (entry->d_name[0] == '.')
+            {
+                continue;
+            }
+            input = malloc(strlen(path) + strlen(entry->d_name) + 2);
+            if (input)
+            {
+                sprintf(input, "%s/%s", path, entry->d_name);
+            }
+        }
+        else
+        {
+            if (!fgets(line, sizeof(line), list))
+            {
+                break;
+            }
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0')
+            {
+                continue;
+            }
+            input = malloc(strlen(line) + 1);
+            if (input)
+            {
+                strcpy(input, line);
+            }
+        }
+        if (!input)
+        {
+            failed = 1;
+            break;
+        }
+        if (directory && (stat(input, &status) != 0 || !S_ISREG(status.st_mode)))
+        {
+            free(input);
+            continue;
+        }
+        if (count == size)
+        {
+            char **larger = realloc(inputs, sizeof(char *) * size * 2);
+            if (!larger)
+            {
+                free(input);
+                failed = 1;
+                break;
+            }
+            inputs = larger;
+            size *= 2;
+        }
+        inputs[count++] = input;
+    }
+    if (directory)
+    {
+        closedir(entries);
+    }
+    else
+    {
+        failed |= ferror(list);
+        fclose(list);
+    }
+    if (failed)
+    {
+        freeInputs(inputs, count);
+        return NULL;
+    }
+    if (directory)
+    {
+        qsort(inputs, count, sizeof(char *), compareInputs);
+    }
+    *numOfInputs = count;
+    return inputs;
+}
+
+/**
+ * compare two inputs for qsort
+ * @param a first input
+ * @param b second input
+ * @return negative, zero or positive like strcmp
+ */
+int compareInputs(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/**
+ * @param input path of an input
+ * @return the name of the input, the part of the path after the last slash, its output is
+ *         named after it
+ */
+const char *inputName(const char *input)
+{
+    const char *slash = strrchr(input, '/');
+    return slash ? slash + 1 : input;
+}
+
+/**
+ * find two inputs of a batch with the same name, whose outputs would be the same file
+ * @param inputs the paths of the inputs
+ * @param numOfInputs number of inputs
+ * @param name put the name here, NULL when every input has a name of its own
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int findSharedName(char *const *inputs, size_t numOfInputs, const char **name)
+{
+    *name = NULL;
+    const char **names = malloc(sizeof(char *) * (numOfInputs ? numOfInputs : 1));
+    if (!names)
+    {
+        return ERROR;
+    }
+    for (size_t i = 0; i < numOfInputs; i++)
+    {
+        names[i] = inputName(inputs[i]);
+    }
+    qsort(names, numOfInputs, sizeof(char *), compareInputs);
+    for (size_t i = 1; i < numOfInputs && !*name; i++)
+    {
+        if (strcmp(names[i - 1], names[i]) == 0)
+        {
+            *name = names[i];
+        }
+    }
+    free(names);
+    return SUCCESS;
+}
+
+/**
+ * @param inputs array of paths
+ * @param numOfInputs number of paths
+ */
+void freeInputs(char **inputs, size_t numOfInputs)
+{
+    if (!inputs)
+    {
+        return;
+    }
+    for (size_t i = 0; i < numOfInputs; i++)
+    {
+        free(inputs[i]);
+    }
+    free(inputs);
+}
+
+/**
+ * body of a batch worker: take the next input until none is left, with one calculator and one
+ * grid reused for all of them
+ * @param arg the Batch
+ * @param index index of the worker
+ * @param count number of workers
+ */
+void batchTask(void *arg, unsigned int index, unsigned int count)
+{
+    Batch *batch = arg;
+    CalcOptions calcOptions = runCalcOptions(batch->options, 1);
+    Calculator *calc = createCalculator(&calcOptions);
+    HeatGrid *grid = NULL;
+    while (1)
+    {
+        pthread_mutex_lock(&batch->lock);
+        size_t next = batch->next < batch->numOfInputs ? batch->next++ : batch->numOfInputs;
+        pthread_mutex_unlock(&batch->lock);
+        if (next == batch->numOfInputs)
+        {
+            break;
+        }
+        const char *input = batch->inputs[next];
+        if (!calc || solveScenario(batch->options, calc, &grid, input) == ERROR)
+        {
+            fprintf(stderr, SCENARIO_ERR, input);
+            pthread_mutex_lock(&batch->lock);
+            batch->failed = 1;
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+    freeGrid(grid);
+    freeCalculator(calc);
+    (void) index;
+    (void) count;
+}
+
+/**
+ * solve one input of a batch into its output file
+ * @param options the command line options
+ * @param calc the calculator of the worker
+ * @param grid the grid of the worker, reused for the input when it has room for it, may be NULL
+ * @param input path of the input
+ * @return 0 if succeeded, 1 otherwise
+ */
+int solveScenario(const RunOptions *options, Calculator *calc, HeatGrid **grid,
+                  const char *input)
+{
+    RunOptions scenario = *options;
+    scenario.inputPath = input;
+    source_point *sources = NULL;
+    size_t numOfSources = 0;
+    CheckpointState run;
+    if (readInput(&scenario, grid, &sources, &numOfSources, &run) == ERROR)
+    {
+        return ERROR;
+    }
+    const char *name = inputName(input);
+    char *output = malloc(strlen(options->outputPath) + strlen(name) + sizeof(OUTPUT_SUFFIX) + 1);
+    if (!output)
+    {
+        free(sources);
+        fprintf(stderr, MEM_ERR);
+        return ERROR;
+    }
+    sprintf(output, "%s/%s%s", options->outputPath, name, OUTPUT_SUFFIX);
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    free(output);
+    if (fd < 0)
+    {
+        free(sources);
+        fprintf(stderr, FILE_OPENING_ERR);
+        return ERROR;
+    }
+    int result = SUCCESS;
+    GridWriter *writer = createWriter(fd, WRITER_CAPACITY, options->format);
+    if (!writer || printResults(calc, writer, 0, NULL, *grid, &run) == ERROR)
+    {
+        fprintf(stderr, MEM_ERR);
+        result = ERROR;
+    }
+    else if (flushWriter(writer) == ERROR)
+    {
+        fprintf(stderr, WRITE_ERR);
+        result = ERROR;
+    }
+    freeWriter(writer);
+    if (close(fd) != 0)
+    {
+        result = ERROR;
+    }
+    free(sources);
+    return result;
+}
+
+/**
+ * @param options the command line options
+ * @param threads number of threads of the calculator
+ * @return the calculator options of the run
+ */
+CalcOptions runCalcOptions(const RunOptions *options, unsigned int threads)
+{
+    CalcOptions calcOptions = DEFAULT_CALC_OPTIONS;
+    calcOptions.threads = threads;
+    calcOptions.order = options->order;
+    calcOptions.checkEvery = options->checkEvery;
+    calcOptions.tileDepth = options->tileDepth;
+    calcOptions.solver = options->solver;
+    calcOptions.activeThreshold = options->activeThreshold;
+    calcOptions.precision = options->precision;
+    return calcOptions;
+}
+
+/**
+ * tell on stderr about the options of the calculator heat_eqn can't be solved with, the run
+ * goes on without them
+ * @param calcOptions the calculator options of the run
+ */
+void reportIgnored(const CalcOptions *calcOptions)
+{
+    int linear = findLinearStencil(heat_eqn) != NULL;
+    if (calcOptions->solver != SOLVER_RELAX && !linear)
+    {
+        fprintf(stderr, SOLVER_IGNORED);
+    }
+    if (calcOptions->precision != PRECISION_DOUBLE &&
+        (!linear || calcOptions->threads > 1 || calcOptions->processes > 1))
+    {
+        fprintf(stderr, PRECISION_IGNORED);
+    }
+}
+
+/**
+ * solve the grid, then keep it and its sources and serve edits of the sources, one command per
+ * line, from stdin or from the clients of a UNIX socket one after the other:
+ * "add x, y, value", "update x, y, value" and "remove x, y" change the sources and solve the
+ * grid again from the solution it had, "print" writes the grid in the output format, "quit"
+ * stops the daemon. a solve replies "ok" with its difference and number of sweeps, a command
+ * that can't be carried out "error" and the reason. a socket client that sends nothing, or reads
+ * nothing, for CLIENT_TIMEOUT seconds is let go for the next one.
+ * @param options the command line options, with a servePath
+ * @param calc the calculator
+ * @param grid of heat values, with the sources on it
+ * @param sources the sources, updated by the commands
+ * @param numOfSources number of sources, updated by the commands
+ * @param run the mode of the run
+ * @return 0 if the daemon quit or its input ended, 1 otherwise, after printing the error
+ */
+int runDaemon(const RunOptions *options, Calculator *calc, HeatGrid *grid,
+              source_point **sources, size_t *numOfSources, const CheckpointState *run)
+{
+    Daemon daemon = {options, calc, grid, run, *sources, *numOfSources, -1, 0, 0};
+    // a resumed run first finishes the call the checkpoint was taken in
+    int error = solveDaemon(&daemon, run->callSweeps, run->delta);
+    if (error)
+    {
+        fprintf(stderr, MEM_ERR);
+    }
+    else if (strcmp(options->servePath, SERVE_STDIN) == 0)
+    {
+        // the reply to the input, the grid is ready for the commands
+        dprintf(STDOUT_FILENO, SOLVED_REPLY, daemon.value, daemon.sweeps);
+        error = serveCommands(&daemon, stdin, STDOUT_FILENO);
+        if (error)
+        {
+            fprintf(stderr, MEM_ERR);
+        }
+    }
+    else
+    {
+        error = serveSocket(&daemon, options->servePath);
+    }
+    *sources = daemon.sources;
+    *numOfSources = daemon.numOfSources;
+    return error ? ERROR : SUCCESS;
+}
+
+/**
+ * run calculateGrid calls the way printResults does, from the grid as it is, until the
+ * difference is below terminate
+ * @param daemon the daemon, value and sweeps get the solve
+ * @param callSweeps sweeps of the first n_iter call that were already done
+ * @param delta the last difference measured, -1 if none was
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int solveDaemon(Daemon *daemon, unsigned int callSweeps, double delta)
+{
+    uint64_t sweeps = 0;
+    double value = calculateCall(daemon->calc, NULL, daemon->grid, daemon->run, &sweeps,
+                                 callSweeps, delta);
+    while (value > daemon->run->terminate)
+    {
+        value = calculateCall(daemon->calc, NULL, daemon->grid, daemon->run, &sweeps, 0, value);
+    }
+    daemon->value = value;
+    daemon->sweeps = sweeps;
+    return value == -1 ? ERROR : SUCCESS;
+}
+
+/**
+ * serve the clients of a UNIX socket until one of them sends quit
+ * @param daemon the daemon
+ * @param path path of the socket, a socket already there is replaced
+ * @return 0 if succeeded, 1 otherwise, after printing the error
+ */
+int serveSocket(Daemon *daemon, const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, SOCKET_ERR);
+        return ERROR;
+    }
+    strcpy(address.sun_path, path);
+    // a socket left by a daemon before, never any other file
+    struct stat status;
+    if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+    {
+        unlink(path);
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || bind(server, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(server, DAEMON_BACKLOG) != 0)
+    {
+        if (server >= 0)
+        {
+            close(server);
+        }
+        fprintf(stderr, SOCKET_ERR);
+        return ERROR;
+    }
+    // a client that goes away fails the writes to it instead of killing the daemon
+    signal(SIGPIPE, SIG_IGN);
+    int error = SUCCESS;
+    while (!daemon->quit && !error)
+    {
+        int client = accept(server, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+            {
+                fprintf(stderr, SOCKET_ERR);
+                error = ERROR;
+            }
+            continue;
+        }
+        // a client that keeps quiet, or stops reading its replies, goes away instead of keeping
+        // the others waiting
+        struct timeval timeout = {CLIENT_TIMEOUT, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        FILE *input = fdopen(client, "r");
+        if (!input)
+        {
+            close(client);
+            fprintf(stderr, MEM_ERR);
+            error = ERROR;
+            continue;
+        }
+        if (serveCommands(daemon, input, client) == ERROR)
+        {
+            fprintf(stderr, MEM_ERR);
+            error = ERROR;
+        }
+        // closes the client too
+        fclose(input);
+    }
+    close(server);
+    unlink(path);
+    return error;
+}
+
+/**
+ * serve the commands of one input until it ends or quit
+ * @param daemon the daemon
+ * @param input the commands
+ * @param out file descriptor the replies are written to, it stays open
+ * @return 0 if succeeded, 1 if memory allocation went wrong
+ */
+int serveCommands(Daemon *daemon, FILE *input, int out)
+{
+    GridWriter *writer = createWriter(out, WRITER_CAPACITY, daemon->options->format);
+    if (!writer)
+    {
+        return ERROR;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    int error = SUCCESS;
+    while (!daemon->quit && !error && getline(&line, &size, input) >= 0)
+    {
+        error = runCommand(daemon, line, out, writer);
+    }
+    free(line);
+    freeWriter(writer);
+    return error;
+}
+
+/**
+ * carry out one command line
+ * @param daemon the daemon
+ * @param line the command
+ * @param out file descriptor the reply is written to
+ * @param writer the writer of the printed grid, on out
+ * @return 0 if succeeded, 1 if a solve went wrong
+ */
+int runCommand(Daemon *daemon, const char *line, int out, GridWriter *writer)
+{
+    char command[COMMAND_LEN];
+    int length = -1;
+    if (sscanf(line, "%15s%n", command, &length) != 1)
+    {
+        // an empty line
+        return SUCCESS;
+    }
+    const char *arguments = line + length;
+    source_point source = {0, 0, 0};
+    int end = -1;
+    int edit = strcmp(command, ADD_COMMAND) == 0 || strcmp(command, UPDATE_COMMAND) == 0;
+    if (edit)
+    {
+        sscanf(arguments, "%d ,%d ,%lf %n", &source.x, &source.y, &source.value, &end);
+    }
+    else if (strcmp(command, REMOVE_COMMAND) == 0)
+    {
+        edit = 1;
+        sscanf(arguments, "%d ,%d %n", &source.x, &source.y, &end);
+    }
+    else if (strcmp(command, PRINT_COMMAND) == 0 || strcmp(command, QUIT_COMMAND) == 0)
+    {
+        sscanf(arguments, " %n", &end);
+    }
+    if (end < 0 || arguments[end] != '\0')
+    {
+        dprintf(out, BAD_COMMAND_REPLY);
+        return SUCCESS;
+    }
+    if (strcmp(command, QUIT_COMMAND) == 0)
+    {
+        daemon->quit = 1;
+        return SUCCESS;
+    }
+    if (!edit)
+    {
+        writeGrid(writer, daemon->grid, daemon->value, daemon->sweeps);
+        return SUCCESS;
+    }
+    const char *reply = editSources(daemon, command, source);
+    if (reply)
+    {
+        dprintf(out, "%s", reply);
+        return SUCCESS;
+    }
+    // the grid keeps the old solution, the sweeps only carry it to the new sources
+    if (solveDaemon(daemon, 0, -1) == ERROR)
+    {
+        dprintf(out, MEM_REPLY);
+        return ERROR;
+    }
+    dprintf(out, SOLVED_REPLY, daemon->value, daemon->sweeps);
+    return SUCCESS;
+}
+
+/**
+ * add, update or remove a source and pin the sources of the grid again. the edited sources are
+ * built apart and only take the place of the old ones once they are pinned, so a failed edit
+ * leaves the sources and the pinned cells as they were.
+ * @param daemon the daemon
+ * @param command ADD_COMMAND, UPDATE_COMMAND or REMOVE_COMMAND
+ * @param source the source, the value is ignored for a removal
+ * @return NULL if the sources changed, or else the error reply
+ */
+const char *editSources(Daemon *daemon, const char *command, source_point source)
+{
+    HeatGrid *grid = daemon->grid;
+    if (source.x < 0 || (size_t) source.x >= grid->rows || source.y < 0 ||
+        (size_t) source.y >= grid->cols)
+    {
+        return OUT_OF_RANGE_REPLY;
+    }
+    source_point *edited = malloc(sizeof(source_point) * (daemon->numOfSources + 1));
+    if (!edited)
+    {
+        return MEM_REPLY;
+    }
+    // the input may name a cell twice, every source of the cell goes together
+    size_t count = 0, found = 0;
+    for (size_t i = 0; i < daemon->numOfSources; i++)
+    {
+        source_point at = daemon->sources[i];
+        if (at.x == source.x && at.y == source.y)
+        {
+            found++;
+            if (strcmp(command, REMOVE_COMMAND) == 0)
+            {
+                continue;
+            }
+            if (strcmp(command, UPDATE_COMMAND) == 0)
+            {
+                at.value = source.value;
+            }
+        }
+        edited[count++] = at;
+    }
+    const char *reply = NULL;
+    if (strcmp(command, ADD_COMMAND) == 0 && found > 0)
+    {
+        reply = SOURCE_EXISTS_REPLY;
+    }
+    else if (strcmp(command, ADD_COMMAND) != 0 && found == 0)
+    {
+        reply = NO_SOURCE_REPLY;
+    }
+    if (!reply && strcmp(command, ADD_COMMAND) == 0)
+    {
+        edited[count++] = source;
+    }
+    // an update keeps the pinned cells, a removed source leaves its value as the first guess
+    if (!reply && strcmp(command, UPDATE_COMMAND) != 0 &&
+        pinSources(grid, edited, count) == ERROR)
+    {
+        reply = MEM_REPLY;
+    }
+    if (reply)
+    {
+        free(edited);
+        return reply;
+    }
+    free(daemon->sources);
+    daemon->sources = edited;
+    daemon->numOfSources = count;
+    if (strcmp(command, REMOVE_COMMAND) != 0)
+    {
+        GRID_AT(grid, source.x, source.y) = source.value;
     }
+    return NULL;
 }
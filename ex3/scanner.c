@@ -0,0 +1,613 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scanner.h"
+
+#define ERROR 1
+#define SUCCESS 0
+// first size of the buffer of a file that can't be mapped, it doubles when full
+#define READ_CHUNK (1 << 16)
+// longest number that is converted from a copy on the stack, longer ones are copied to the heap
+#define NUMBER_LEN 128
+// mantissas up to 2^53 and powers of ten up to 1e22 are exact doubles
+#define EXACT_MANTISSA (1ULL << 53)
+#define EXACT_POWER 22
+// digits of a mantissa that fit a uint64_t, and a bound on the exponent past any double
+#define MAX_DIGITS 19
+#define MAX_EXPONENT 100000
+
+static const double POWERS_OF_TEN[EXACT_POWER + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// ____________ functions _______________
+int readWhole(int fd, Scanner *scanner);
+
+int peek(const Scanner *scanner);
+
+int scanSign(Scanner *scanner);
+
+int scanMagnitude(Scanner *scanner, unsigned long *magnitude, int *overflow);
+
+size_t decimalSpan(const Scanner *scanner, size_t from);
+
+int specialSpan(Scanner *scanner, int lead);
+
+int matchWord(Scanner *scanner, const char *word);
+
+int convertDecimal(const char *text, size_t length, double *value);
+
+double convertCopy(const char *text, size_t length, size_t *consumed);
+
+
+/**
+ * open a file for scanning
+ * @param path path of the file
+ * @param scanner the scanner to open
+ * @return 0 if succeeded, 1 if the file could not be opened or memory allocation went wrong
+ */
+int openScanner(const char *path, Scanner *scanner)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return ERROR;
+    }
+    scanner->text = NULL;
+    scanner->size = 0;
+    scanner->pos = 0;
+    scanner->mapped = 0;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *map = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            posix_madvise(map, (size_t) info.st_size, POSIX_MADV_SEQUENTIAL);
+            scanner->text = map;
+            scanner->size = (size_t) info.st_size;
+            scanner->mapped = 1;
+            close(fd);
+            return SUCCESS;
+        }
+    }
+    // pipes, devices and files that can't be mapped are read into memory
+    int result = readWhole(fd, scanner);
+    close(fd);
+    return result;
+}
+
+/**
+ * free the text of a scanner
+ * @param scanner the scanner
+ */
+void closeScanner(Scanner *scanner)
+{
+    if (scanner->mapped)
+    {
+        munmap((void *) scanner->text, scanner->size);
+    }
+    else
+    {
+        free((void *) scanner->text);
+    }
+    scanner->text = NULL;
+    scanner->size = 0;
+    scanner->pos = 0;
+    scanner->mapped = 0;
+}
+
+/**
+ * skip white space, like a space in a scanf format
+ * @param scanner the scanner
+ */
+void skipSpaces(Scanner *scanner)
+{
+    while (scanner->pos < scanner->size && isspace((unsigned char) scanner->text[scanner->pos]))
+    {
+        scanner->pos++;
+    }
+}
+
+/**
+ * match one character, like a literal character in a scanf format
+ * @param scanner the scanner
+ * @param expected the character
+ * @return 1 if it was the next character (and was consumed), 0 if not, EOF at the end
+ */
+int scanLiteral(Scanner *scanner, char expected)
+{
+    int next = peek(scanner);
+    if (next == EOF)
+    {
+        return EOF;
+    }
+    if (next != (unsigned char) expected)
+    {
+        return 0;
+    }
+    scanner->pos++;
+    return 1;
+}
+
+/**
+ * like scanf("%d"), a failed conversion consumes a sign before the non digit
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanInt(Scanner *scanner, int *value)
+{
+    skipSpaces(scanner);
+    if (peek(scanner) == EOF)
+    {
+        return EOF;
+    }
+    int negative = scanSign(scanner);
+    unsigned long magnitude = 0;
+    int overflow = 0;
+    if (!scanMagnitude(scanner, &magnitude, &overflow))
+    {
+        return 0;
+    }
+    // scanf converts with strtol and stores the long in the int
+    long converted;
+    if (negative)
+    {
+        int tooSmall = overflow || magnitude > (unsigned long) LONG_MAX + 1;
+        converted = tooSmall ? LONG_MIN : (long) (0 - magnitude);
+    }
+    else
+    {
+        converted = overflow || magnitude > LONG_MAX ? LONG_MAX : (long) magnitude;
+    }
+    *value = (int) converted;
+    return 1;
+}
+
+/**
+ * like scanf("%lu"), a leading minus negates the value as strtoul does
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanUnsignedLong(Scanner *scanner, unsigned long *value)
+{
+    skipSpaces(scanner);
+    if (peek(scanner) == EOF)
+    {
+        return EOF;
+    }
+    int negative = scanSign(scanner);
+    unsigned long magnitude = 0;
+    int overflow = 0;
+    if (!scanMagnitude(scanner, &magnitude, &overflow))
+    {
+        return 0;
+    }
+    if (overflow)
+    {
+        *value = ULONG_MAX;
+    }
+    else
+    {
+        *value = negative ? 0 - magnitude : magnitude;
+    }
+    return 1;
+}
+
+/**
+ * like scanf("%lf"), a failed conversion consumes the characters that looked like a number
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanDouble(Scanner *scanner, double *value)
+{
+    skipSpaces(scanner);
+    if (peek(scanner) == EOF)
+    {
+        return EOF;
+    }
+    size_t start = scanner->pos, from = start;
+    if (scanner->text[from] == '+' || scanner->text[from] == '-')
+    {
+        from++;
+    }
+    scanner->pos = from;
+    int lead = tolower(peek(scanner));
+    int hex = lead == '0' && from + 1 < scanner->size &&
+              tolower((unsigned char) scanner->text[from + 1]) == 'x';
+    if (lead == 'i' || lead == 'n' || hex)
+    {
+        if (!specialSpan(scanner, lead))
+        {
+            return 0;
+        }
+        // infinities, nans and hexadecimal numbers are left to strtod
+        size_t consumed = 0;
+        double converted = convertCopy(scanner->text + start, scanner->pos - start, &consumed);
+        if (consumed == 0)
+        {
+            return 0;
+        }
+        *value = converted;
+        return 1;
+    }
+    size_t end = decimalSpan(scanner, from);
+    scanner->pos = end;
+    // scanf converts the longest prefix of what it read, and fails only if that is empty
+    return convertDecimal(scanner->text + start, end - start, value);
+}
+
+/**
+ * like scanf("%s") with a buffer of size bytes, a longer word is cut
+ * @param scanner the scanner
+ * @param out put the word here, with a terminating '\0'
+ * @param size size of out, at least 1
+ * @return 1 if a word was read, EOF at the end
+ */
+int scanWord(Scanner *scanner, char *out, size_t size)
+{
+    skipSpaces(scanner);
+    if (peek(scanner) == EOF)
+    {
+        return EOF;
+    }
+    size_t length = 0;
+    while (scanner->pos < scanner->size && !isspace((unsigned char) scanner->text[scanner->pos]))
+    {
+        if (length + 1 < size)
+        {
+            out[length++] = scanner->text[scanner->pos];
+        }
+        scanner->pos++;
+    }
+    out[length] = '\0';
+    return 1;
+}
+
+/**
+ * read the rest of a file into memory
+ * @param fd the file
+ * @param scanner put the text here
+ * @return 0 if succeeded, 1 if memory allocation went wrong. a read error ends the text like
+ *         the end of the file, as it does for fscanf
+ */
+int readWhole(int fd, Scanner *scanner)
+{
+    size_t capacity = READ_CHUNK, size = 0;
+    char *text = malloc(capacity);
+    if (!text)
+    {
+        return ERROR;
+    }
+    while (1)
+    {
+        if (size == capacity)
+        {
+            char *grown = capacity <= SIZE_MAX / 2 ? realloc(text, capacity * 2) : NULL;
+            if (!grown)
+            {
+                free(text);
+                return ERROR;
+            }
+            text = grown;
+            capacity *= 2;
+        }
+        ssize_t count = read(fd, text + size, capacity - size);
+        if (count > 0)
+        {
+            size += (size_t) count;
+        }
+        else if (count == 0 || errno != EINTR)
+        {
+            break;
+        }
+    }
+    scanner->text = text;
+    scanner->size = size;
+    return SUCCESS;
+}
+
+/**
+ * @param scanner the scanner
+ * @return the next character as an unsigned char, EOF at the end
+ */
+int peek(const Scanner *scanner)
+{
+    return scanner->pos < scanner->size ? (unsigned char) scanner->text[scanner->pos] : EOF;
+}
+
+/**
+ * consume an optional sign
+ * @param scanner the scanner
+ * @return 1 if it was a minus, 0 otherwise
+ */
+int scanSign(Scanner *scanner)
+{
+    int next = peek(scanner);
+    if (next == '+' || next == '-')
+    {
+        scanner->pos++;
+    }
+    return next == '-';
+}
+
+/**
+ * consume decimal digits
+ * @param scanner the scanner
+ * @param magnitude put their value here
+ * @param overflow set to 1 if the value doesn't fit an unsigned long
+ * @return 1 if there was at least one digit, 0 otherwise
+ */
+int scanMagnitude(Scanner *scanner, unsigned long *magnitude, int *overflow)
+{
+    size_t start = scanner->pos;
+    while (scanner->pos < scanner->size && isdigit((unsigned char) scanner->text[scanner->pos]))
+    {
+        unsigned long digit = (unsigned long) (scanner->text[scanner->pos] - '0');
+        if (*magnitude > (ULONG_MAX - digit) / 10)
+        {
+            *overflow = 1;
+        }
+        else
+        {
+            *magnitude = *magnitude * 10 + digit;
+        }
+        scanner->pos++;
+    }
+    return scanner->pos > start;
+}
+
+/**
+ * the characters scanf reads for a decimal "%lf": digits with at most one point, then, after a
+ * digit, an exponent mark with an optional sign and digits
+ * @param scanner the scanner
+ * @param from position after the sign
+ * @return position after the characters
+ */
+size_t decimalSpan(const Scanner *scanner, size_t from)
+{
+    const char *text = scanner->text;
+    int gotDigit = 0, gotDot = 0, gotExponent = 0;
+    size_t pos = from;
+    while (pos < scanner->size)
+    {
+        char c = text[pos];
+        if (isdigit((unsigned char) c))
+        {
+            gotDigit = 1;
+        }
+        else if (c == '.' && !gotDot && !gotExponent)
+        {
+            gotDot = 1;
+        }
+        else if ((c == 'e' || c == 'E') && gotDigit && !gotExponent)
+        {
+            gotExponent = 1;
+            if (pos + 1 < scanner->size && (text[pos + 1] == '+' || text[pos + 1] == '-'))
+            {
+                pos++;
+            }
+        }
+        else
+        {
+            break;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * consume what scanf reads for an infinity, a nan or a hexadecimal "%lf"
+ * @param scanner the scanner, at the first character after the sign
+ * @param lead that character in lower case, 'i', 'n' or '0' of "0x"
+ * @return 1 if the characters can be a number, 0 if scanf fails on them
+ */
+int specialSpan(Scanner *scanner, int lead)
+{
+    if (lead == 'n')
+    {
+        return matchWord(scanner, "nan");
+    }
+    if (lead == 'i')
+    {
+        if (!matchWord(scanner, "inf"))
+        {
+            return 0;
+        }
+        // "inf" is a number, once "infi" is read it has to be "infinity"
+        return tolower(peek(scanner)) != 'i' || matchWord(scanner, "inity");
+    }
+    const char *text = scanner->text;
+    int gotDigit = 0, gotDot = 0, gotExponent = 0;
+    size_t pos = scanner->pos + 2;
+    while (pos < scanner->size)
+    {
+        char c = text[pos];
+        if (isxdigit((unsigned char) c) && !gotExponent)
+        {
+            gotDigit = 1;
+        }
+        else if (isdigit((unsigned char) c))
+        {
+            gotDigit = 1;
+        }
+        else if (c == '.' && !gotDot && !gotExponent)
+        {
+            gotDot = 1;
+        }
+        else if ((c == 'p' || c == 'P') && gotDigit && !gotExponent)
+        {
+            gotExponent = 1;
+            if (pos + 1 < scanner->size && (text[pos + 1] == '+' || text[pos + 1] == '-'))
+            {
+                pos++;
+            }
+        }
+        else
+        {
+            break;
+        }
+        pos++;
+    }
+    scanner->pos = pos;
+    return 1;
+}
+
+/**
+ * match a word case insensitively, like scanf matches "nan" and "inf": a wrong character is
+ * consumed too
+ * @param scanner the scanner
+ * @param word the word in lower case
+ * @return 1 if it matched, 0 otherwise
+ */
+int matchWord(Scanner *scanner, const char *word)
+{
+    for (; *word; word++)
+    {
+        int next = peek(scanner);
+        if (next == EOF)
+        {
+            return 0;
+        }
+        scanner->pos++;
+        if (tolower(next) != *word)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * convert the longest prefix of a decimal number that strtod accepts. up to 19 digits with a
+ * small exponent are converted exactly here (a mantissa up to 2^53 times or over a power of
+ * ten up to 1e22 is one correctly rounded operation), anything else goes through strtod.
+ * @param text the characters of decimalSpan, with the sign
+ * @param length number of characters
+ * @param value put the value here
+ * @return 1 if a prefix was converted, 0 if it has no digits
+ */
+int convertDecimal(const char *text, size_t length, double *value)
+{
+    size_t pos = 0;
+    int negative = 0;
+    if (pos < length && (text[pos] == '+' || text[pos] == '-'))
+    {
+        negative = text[pos] == '-';
+        pos++;
+    }
+    uint64_t mantissa = 0;
+    int significant = 0, scale = 0, dot = 0, anyDigit = 0, fast = 1;
+    for (; pos < length; pos++)
+    {
+        char c = text[pos];
+        if (c == '.')
+        {
+            dot = 1;
+            continue;
+        }
+        if (!isdigit((unsigned char) c))
+        {
+            break;
+        }
+        anyDigit = 1;
+        if (significant == 0 && c == '0')
+        {
+            scale -= dot;
+        }
+        else if (significant < MAX_DIGITS)
+        {
+            mantissa = mantissa * 10 + (uint64_t) (c - '0');
+            significant++;
+            scale -= dot;
+        }
+        else
+        {
+            fast = 0;
+        }
+    }
+    if (!anyDigit)
+    {
+        return 0;
+    }
+    // an exponent counts only with digits after it, "1e+" converts as 1
+    if (pos < length)
+    {
+        size_t start = pos + 1;
+        int exponentNegative = start < length && text[start] == '-';
+        if (start < length && (text[start] == '+' || text[start] == '-'))
+        {
+            start++;
+        }
+        int exponent = 0;
+        for (size_t k = start; k < length; k++)
+        {
+            exponent = exponent < MAX_EXPONENT ? exponent * 10 + (text[k] - '0') : exponent;
+        }
+        scale += exponentNegative ? -exponent : exponent;
+    }
+    if (fast && mantissa <= EXACT_MANTISSA && scale >= -EXACT_POWER && scale <= EXACT_POWER)
+    {
+        double converted = (double) mantissa;
+        if (scale < 0)
+        {
+            converted /= POWERS_OF_TEN[-scale];
+        }
+        else
+        {
+            converted *= POWERS_OF_TEN[scale];
+        }
+        *value = negative ? -converted : converted;
+        return 1;
+    }
+    size_t consumed = 0;
+    *value = convertCopy(text, length, &consumed);
+    return 1;
+}
+
+/**
+ * strtod on a '\0' terminated copy of the characters
+ * @param text the characters
+ * @param length number of characters
+ * @param consumed put the number of characters strtod converted here
+ * @return the value strtod returned
+ */
+double convertCopy(const char *text, size_t length, size_t *consumed)
+{
+    char local[NUMBER_LEN];
+    char *copy = length < NUMBER_LEN ? local : malloc(length + 1);
+    if (!copy)
+    {
+        // only the first NUMBER_LEN - 1 characters then, enough for any real number
+        copy = local;
+        length = NUMBER_LEN - 1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    char *end = copy;
+    double value = strtod(copy, &end);
+    *consumed = (size_t) (end - copy);
+    if (copy != local)
+    {
+        free(copy);
+    }
+    return value;
+}
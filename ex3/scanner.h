@@ -0,0 +1,85 @@
+/**
+ * @author Idan Yamin
+ * @brief reads a whole input file (mapped when it is a regular file) and scans it the way the
+ * fscanf conversions ex3 used do: the same numbers are accepted, a failed conversion consumes
+ * the same characters, and the results are the same 1 / 0 / EOF counts.
+ */
+
+#ifndef EX3_SCANNER_H
+#define EX3_SCANNER_H
+
+#include <stddef.h>
+
+/**
+ * the text of the input and the position of the next character
+ */
+typedef struct Scanner
+{
+    const char *text;
+    size_t size;
+    size_t pos;
+    int mapped;
+} Scanner;
+
+/**
+ * open a file for scanning
+ * @param path path of the file
+ * @param scanner the scanner to open
+ * @return 0 if succeeded, 1 if the file could not be opened or memory allocation went wrong
+ */
+int openScanner(const char *path, Scanner *scanner);
+
+/**
+ * free the text of a scanner
+ * @param scanner the scanner
+ */
+void closeScanner(Scanner *scanner);
+
+/**
+ * skip white space, like a space in a scanf format
+ * @param scanner the scanner
+ */
+void skipSpaces(Scanner *scanner);
+
+/**
+ * match one character, like a literal character in a scanf format
+ * @param scanner the scanner
+ * @param expected the character
+ * @return 1 if it was the next character (and was consumed), 0 if not, EOF at the end
+ */
+int scanLiteral(Scanner *scanner, char expected);
+
+/**
+ * like scanf("%d"), a failed conversion consumes a sign before the non digit
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanInt(Scanner *scanner, int *value);
+
+/**
+ * like scanf("%lu"), a leading minus negates the value as strtoul does
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanUnsignedLong(Scanner *scanner, unsigned long *value);
+
+/**
+ * like scanf("%lf"), a failed conversion consumes the characters that looked like a number
+ * @param scanner the scanner
+ * @param value put the value here
+ * @return 1 if converted, 0 if the input doesn't start with a number, EOF at the end
+ */
+int scanDouble(Scanner *scanner, double *value);
+
+/**
+ * like scanf("%s") with a buffer of size bytes, a longer word is cut
+ * @param scanner the scanner
+ * @param out put the word here, with a terminating '\0'
+ * @param size size of out, at least 1
+ * @return 1 if a word was read, EOF at the end
+ */
+int scanWord(Scanner *scanner, char *out, size_t size);
+
+#endif //EX3_SCANNER_H
@@ -0,0 +1,263 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+#define ERROR 1
+#define SUCCESS 0
+
+/**
+ * @param type a value type
+ * @return size of one value in bytes
+ */
+size_t snapshotValueSize(SnapshotType type)
+{
+    return type == SNAPSHOT_FLOAT32 ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
+/**
+ * @param header a header
+ * @return size of the values of the snapshot with the padding, 0 if it doesn't fit a size_t
+ */
+size_t snapshotPayloadSize(const SnapshotHeader *header)
+{
+    size_t valueSize = snapshotValueSize(header->type);
+    if (header->cols != 0 && header->rows > SIZE_MAX / valueSize / header->cols)
+    {
+        return 0;
+    }
+    size_t size = (size_t) (header->rows * header->cols) * valueSize;
+    if (size > SIZE_MAX - SNAPSHOT_ALIGNMENT)
+    {
+        return 0;
+    }
+    return (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+/**
+ * @param header the header
+ * @param out SNAPSHOT_HEADER_SIZE bytes to write it to
+ */
+void encodeSnapshotHeader(const SnapshotHeader *header, unsigned char *out)
+{
+    uint64_t deltaBits;
+    memcpy(&deltaBits, &header->delta, sizeof(deltaBits));
+    memset(out, 0, SNAPSHOT_HEADER_SIZE);
+    memcpy(out, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    putLittle32(out + 8, SNAPSHOT_VERSION);
+    putLittle32(out + 12, (uint32_t) header->type);
+    putLittle64(out + 16, header->rows);
+    putLittle64(out + 24, header->cols);
+    putLittle64(out + 32, header->sweeps);
+    putLittle64(out + 40, deltaBits);
+}
+
+/**
+ * @param in SNAPSHOT_HEADER_SIZE bytes of a header
+ * @param header put the fields here
+ * @return 0 if succeeded, 1 if the bytes aren't a header of a known version and type
+ */
+int decodeSnapshotHeader(const unsigned char *in, SnapshotHeader *header)
+{
+    if (memcmp(in, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0 ||
+        getLittle32(in + 8) != SNAPSHOT_VERSION)
+    {
+        return ERROR;
+    }
+    uint32_t type = getLittle32(in + 12);
+    if (type != SNAPSHOT_FLOAT64 && type != SNAPSHOT_FLOAT32)
+    {
+        return ERROR;
+    }
+    header->type = (SnapshotType) type;
+    header->rows = getLittle64(in + 16);
+    header->cols = getLittle64(in + 24);
+    header->sweeps = getLittle64(in + 32);
+    uint64_t deltaBits = getLittle64(in + 40);
+    memcpy(&header->delta, &deltaBits, sizeof(deltaBits));
+    return SUCCESS;
+}
+
+/**
+ * @param value a value
+ * @param type how to store it
+ * @param out snapshotValueSize(type) bytes to write it to, little-endian
+ */
+void encodeSnapshotValue(double value, SnapshotType type, unsigned char *out)
+{
+    if (type == SNAPSHOT_FLOAT32)
+    {
+        float narrow = (float) value;
+        uint32_t bits;
+        memcpy(&bits, &narrow, sizeof(bits));
+        putLittle32(out, bits);
+    }
+    else
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        putLittle64(out, bits);
+    }
+}
+
+/**
+ * @param snapshot a snapshot
+ * @param i row
+ * @param j column
+ * @return the value at (i, j)
+ */
+double snapshotValue(const Snapshot *snapshot, size_t i, size_t j)
+{
+    size_t index = i * (size_t) snapshot->header.cols + j;
+    if (snapshot->header.type == SNAPSHOT_FLOAT32)
+    {
+        uint32_t bits = getLittle32(snapshot->values + index * sizeof(uint32_t));
+        float narrow;
+        memcpy(&narrow, &bits, sizeof(narrow));
+        return narrow;
+    }
+    uint64_t bits = getLittle64(snapshot->values + index * sizeof(uint64_t));
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * map a snapshot file into memory
+ * @param path path of the file
+ * @param file the file to open
+ * @return 0 if succeeded, 1 if the file could not be opened or mapped
+ */
+int openSnapshots(const char *path, SnapshotFile *file)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return ERROR;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return ERROR;
+    }
+    file->map = NULL;
+    file->size = (size_t) info.st_size;
+    file->offset = 0;
+    // an empty file has no snapshots and can't be mapped
+    if (file->size > 0)
+    {
+        void *map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return ERROR;
+        }
+        file->map = map;
+    }
+    close(fd);
+    return SUCCESS;
+}
+
+/**
+ * read the next snapshot of a mapped file
+ * @param file the file
+ * @param snapshot put the snapshot here
+ * @return SNAPSHOT_READ, SNAPSHOT_END after the last one, SNAPSHOT_BAD if the rest of the file
+ *         is not a whole snapshot
+ */
+int nextSnapshot(SnapshotFile *file, Snapshot *snapshot)
+{
+    size_t left = file->size - file->offset;
+    if (left == 0)
+    {
+        return SNAPSHOT_END;
+    }
+    if (left < SNAPSHOT_HEADER_SIZE ||
+        decodeSnapshotHeader(file->map + file->offset, &snapshot->header) == ERROR)
+    {
+        return SNAPSHOT_BAD;
+    }
+    size_t payload = snapshotPayloadSize(&snapshot->header);
+    int empty = snapshot->header.rows == 0 || snapshot->header.cols == 0;
+    if ((payload == 0 && !empty) || payload > left - SNAPSHOT_HEADER_SIZE)
+    {
+        return SNAPSHOT_BAD;
+    }
+    snapshot->values = file->map + file->offset + SNAPSHOT_HEADER_SIZE;
+    file->offset += SNAPSHOT_HEADER_SIZE + payload;
+    return SNAPSHOT_READ;
+}
+
+/**
+ * unmap a snapshot file, the snapshots read from it can't be used after that
+ * @param file the file
+ */
+void closeSnapshots(SnapshotFile *file)
+{
+    if (file->map)
+    {
+        munmap((void *) file->map, file->size);
+    }
+    file->map = NULL;
+    file->size = 0;
+    file->offset = 0;
+}
+
+/**
+ * @param out 4 bytes to write to
+ * @param value value to write little-endian
+ */
+void putLittle32(unsigned char *out, uint32_t value)
+{
+    for (int k = 0; k < 4; k++)
+    {
+        out[k] = (unsigned char) (value >> (8 * k));
+    }
+}
+
+/**
+ * @param out 8 bytes to write to
+ * @param value value to write little-endian
+ */
+void putLittle64(unsigned char *out, uint64_t value)
+{
+    for (int k = 0; k < 8; k++)
+    {
+        out[k] = (unsigned char) (value >> (8 * k));
+    }
+}
+
+/**
+ * @param in 4 bytes of a little-endian value
+ * @return the value
+ */
+uint32_t getLittle32(const unsigned char *in)
+{
+    uint32_t value = 0;
+    for (int k = 3; k >= 0; k--)
+    {
+        value = value << 8 | in[k];
+    }
+    return value;
+}
+
+/**
+ * @param in 8 bytes of a little-endian value
+ * @return the value
+ */
+uint64_t getLittle64(const unsigned char *in)
+{
+    uint64_t value = 0;
+    for (int k = 7; k >= 0; k--)
+    {
+        value = value << 8 | in[k];
+    }
+    return value;
+}
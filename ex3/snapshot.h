@@ -0,0 +1,161 @@
+/**
+ * @author Idan Yamin
+ * @brief binary snapshots of the grid, an alternative to the text output.
+ * a snapshot file is a sequence of snapshots, one for every printed grid. a snapshot is a
+ * SNAPSHOT_HEADER_SIZE bytes header followed by rows * cols values in row-major order,
+ * little-endian float64 or float32, zero padded to a multiple of SNAPSHOT_ALIGNMENT bytes, so
+ * the values of every snapshot of a mapped file are aligned.
+ * header layout, all fields little-endian:
+ * bytes 0-7 SNAPSHOT_MAGIC, 8-11 version, 12-15 value type, 16-23 rows, 24-31 cols,
+ * 32-39 sweeps done since the start of the run, 40-47 the heat difference (float64),
+ * 48-63 zero.
+ */
+
+#ifndef EX3_SNAPSHOT_H
+#define EX3_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// first bytes of every snapshot, with the terminating '\0'
+#define SNAPSHOT_MAGIC "EX3SNAP"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 64
+#define SNAPSHOT_ALIGNMENT 64
+
+// results of nextSnapshot
+#define SNAPSHOT_READ 0
+#define SNAPSHOT_BAD 1
+#define SNAPSHOT_END 2
+
+/**
+ * type of the stored values
+ */
+typedef enum SnapshotType
+{
+    SNAPSHOT_FLOAT64 = 0,
+    SNAPSHOT_FLOAT32 = 1
+} SnapshotType;
+
+/**
+ * the fields of a snapshot header
+ */
+typedef struct SnapshotHeader
+{
+    SnapshotType type;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t sweeps;
+    double delta;
+} SnapshotHeader;
+
+/**
+ * one snapshot of a mapped file, values points into the mapping. on a little-endian machine it
+ * can be used directly as a const double * or const float * array, snapshotValue reads it on
+ * any machine.
+ */
+typedef struct Snapshot
+{
+    SnapshotHeader header;
+    const unsigned char *values;
+} Snapshot;
+
+/**
+ * a snapshot file mapped into memory, read with nextSnapshot
+ */
+typedef struct SnapshotFile
+{
+    const unsigned char *map;
+    size_t size;
+    size_t offset;
+} SnapshotFile;
+
+/**
+ * @param type a value type
+ * @return size of one value in bytes
+ */
+size_t snapshotValueSize(SnapshotType type);
+
+/**
+ * @param header a header
+ * @return size of the values of the snapshot with the padding, 0 if it doesn't fit a size_t
+ */
+size_t snapshotPayloadSize(const SnapshotHeader *header);
+
+/**
+ * @param header the header
+ * @param out SNAPSHOT_HEADER_SIZE bytes to write it to
+ */
+void encodeSnapshotHeader(const SnapshotHeader *header, unsigned char *out);
+
+/**
+ * @param in SNAPSHOT_HEADER_SIZE bytes of a header
+ * @param header put the fields here
+ * @return 0 if succeeded, 1 if the bytes aren't a header of a known version and type
+ */
+int decodeSnapshotHeader(const unsigned char *in, SnapshotHeader *header);
+
+/**
+ * @param value a value
+ * @param type how to store it
+ * @param out snapshotValueSize(type) bytes to write it to, little-endian
+ */
+void encodeSnapshotValue(double value, SnapshotType type, unsigned char *out);
+
+/**
+ * @param snapshot a snapshot
+ * @param i row
+ * @param j column
+ * @return the value at (i, j)
+ */
+double snapshotValue(const Snapshot *snapshot, size_t i, size_t j);
+
+/**
+ * @param out 4 bytes to write to
+ * @param value value to write little-endian
+ */
+void putLittle32(unsigned char *out, uint32_t value);
+
+/**
+ * @param out 8 bytes to write to
+ * @param value value to write little-endian
+ */
+void putLittle64(unsigned char *out, uint64_t value);
+
+/**
+ * @param in 4 bytes of a little-endian value
+ * @return the value
+ */
+uint32_t getLittle32(const unsigned char *in);
+
+/**
+ * @param in 8 bytes of a little-endian value
+ * @return the value
+ */
+uint64_t getLittle64(const unsigned char *in);
+
+/**
+ * map a snapshot file into memory
+ * @param path path of the file
+ * @param file the file to open
+ * @return 0 if succeeded, 1 if the file could not be opened or mapped
+ */
+int openSnapshots(const char *path, SnapshotFile *file);
+
+/**
+ * read the next snapshot of a mapped file
+ * @param file the file
+ * @param snapshot put the snapshot here
+ * @return SNAPSHOT_READ, SNAPSHOT_END after the last one, SNAPSHOT_BAD if the rest of the file
+ *         is not a whole snapshot
+ */
+int nextSnapshot(SnapshotFile *file, Snapshot *snapshot);
+
+/**
+ * unmap a snapshot file, the snapshots read from it can't be used after that
+ * @param file the file
+ */
+void closeSnapshots(SnapshotFile *file);
+
+#endif //EX3_SNAPSHOT_H
@@ -0,0 +1,123 @@
+/**
+ * @author Idan Yamin
+ * @brief reader and converter of the binary snapshots of ex3: prints a snapshot file as the text
+ * ex3 prints, or with -i one line about every snapshot.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "grid_writer.h"
+#include "heat_grid.h"
+#include "snapshot.h"
+
+#define ERROR 1
+#define SUCCESS 0
+
+const char INFO_FLAG[] = "-i";
+const char USAGE_ERR[] = "Usage: snapshot_tool <snapshot file> [-i]\n";
+const char FILE_OPENING_ERR[] = "File opening error\n";
+const char SNAPSHOT_ERR[] = "Bad snapshot\n";
+const char MEM_ERR[] = "Memory allocation error\n";
+const char WRITE_ERR[] = "Output writing error\n";
+const char INFO_LINE[] = "%zu: %" PRIu64 " x %" PRIu64 " %s, %" PRIu64 " sweeps, delta %lf\n";
+
+
+// ____________ functions _______________
+int printText(SnapshotFile *file);
+
+int printInfo(SnapshotFile *file);
+
+
+int main(int argc, char *argv[])
+{
+    int info = argc == 3 && strcmp(argv[2], INFO_FLAG) == 0;
+    if (argc != 2 && !info)
+    {
+        fprintf(stderr, USAGE_ERR);
+        return ERROR;
+    }
+    SnapshotFile file;
+    if (openSnapshots(argv[1], &file) == ERROR)
+    {
+        fprintf(stderr, FILE_OPENING_ERR);
+        return ERROR;
+    }
+    int error = info ? printInfo(&file) : printText(&file);
+    closeSnapshots(&file);
+    return error;
+}
+
+/**
+ * print every snapshot of the file the way ex3 prints the grid as text
+ * @param file the mapped file
+ * @return 0 if succeeded, 1 otherwise
+ */
+int printText(SnapshotFile *file)
+{
+    GridWriter *writer = createWriter(STDOUT_FILENO, WRITER_CAPACITY, OUTPUT_TEXT);
+    if (!writer)
+    {
+        fprintf(stderr, MEM_ERR);
+        return ERROR;
+    }
+    Snapshot snapshot;
+    int result;
+    while ((result = nextSnapshot(file, &snapshot)) == SNAPSHOT_READ)
+    {
+        HeatGrid *grid = buildGrid(snapshot.header.rows, snapshot.header.cols);
+        if (!grid)
+        {
+            freeWriter(writer);
+            fprintf(stderr, MEM_ERR);
+            return ERROR;
+        }
+        for (size_t i = 0; i < grid->rows; i++)
+        {
+            for (size_t j = 0; j < grid->cols; j++)
+            {
+                GRID_AT(grid, i, j) = snapshotValue(&snapshot, i, j);
+            }
+        }
+        writeGrid(writer, grid, snapshot.header.delta, snapshot.header.sweeps);
+        freeGrid(grid);
+    }
+    int writeFailed = flushWriter(writer);
+    freeWriter(writer);
+    if (result == SNAPSHOT_BAD)
+    {
+        fprintf(stderr, SNAPSHOT_ERR);
+        return ERROR;
+    }
+    if (writeFailed)
+    {
+        fprintf(stderr, WRITE_ERR);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * print one line about every snapshot of the file
+ * @param file the mapped file
+ * @return 0 if succeeded, 1 otherwise
+ */
+int printInfo(SnapshotFile *file)
+{
+    Snapshot snapshot;
+    int result;
+    size_t index = 0;
+    while ((result = nextSnapshot(file, &snapshot)) == SNAPSHOT_READ)
+    {
+        const char *type = snapshot.header.type == SNAPSHOT_FLOAT32 ? "float32" : "float64";
+        printf(INFO_LINE, index++, snapshot.header.rows, snapshot.header.cols, type,
+               snapshot.header.sweeps, snapshot.header.delta);
+    }
+    if (result == SNAPSHOT_BAD)
+    {
+        fprintf(stderr, SNAPSHOT_ERR);
+        return ERROR;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,564 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <pthread.h>
+#include "stencil.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STENCIL_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*sums_func)(double *, const double *, const double *, size_t);
+
+typedef void (*colour_func)(double *, const double *, const double *, size_t, size_t, int,
+                            const StencilWeights *);
+
+typedef void (*jacobi_func)(double *, const double *, const double *, const double *, size_t,
+                            size_t, const StencilWeights *);
+
+typedef void (*float_sums_func)(float *, const float *, const float *, size_t);
+
+typedef void (*float_colour_func)(float *, const float *, const float *, size_t, size_t, int,
+                                  const StencilWeights *);
+
+typedef void (*float_jacobi_func)(float *, const float *, const float *, const float *, size_t,
+                                  size_t, const StencilWeights *);
+
+/**
+ * one implementation of every stencil function
+ */
+typedef struct StencilImpl
+{
+    const char *name;
+    sums_func sums;
+    colour_func colour;
+    jacobi_func jacobi;
+    float_sums_func floatSums;
+    float_colour_func floatColour;
+    float_jacobi_func floatJacobi;
+} StencilImpl;
+
+/**
+ * plain C version of verticalSums
+ */
+static void verticalSumsScalar(double *sums, const double *bottom, const double *top, size_t count)
+{
+    for (size_t k = 0; k < count; k++)
+    {
+        sums[k] = top[k] + bottom[k];
+    }
+}
+
+/**
+ * plain C version of stencilColourUpdate
+ */
+static void stencilColourScalar(double *row, const double *bottom, const double *top,
+                                size_t from, size_t to, int parity,
+                                const StencilWeights *weights)
+{
+    size_t j = from + ((from & 1) != (size_t) parity);
+    for (; j < to; j += 2)
+    {
+        double updated = weights->neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j]));
+        row[j] = weights->center != 0 ? updated + weights->center * row[j] : updated;
+    }
+}
+
+/**
+ * plain C version of stencilJacobiUpdate
+ */
+static void stencilJacobiScalar(double *out, const double *row, const double *bottom,
+                                const double *top, size_t from, size_t to,
+                                const StencilWeights *weights)
+{
+    for (size_t j = from; j < to; j++)
+    {
+        double updated = weights->neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j]));
+        out[j] = weights->center != 0 ? updated + weights->center * row[j] : updated;
+    }
+}
+
+/**
+ * plain C version of verticalSumsFloat
+ */
+static void verticalSumsFloatScalar(float *sums, const float *bottom, const float *top,
+                                    size_t count)
+{
+    for (size_t k = 0; k < count; k++)
+    {
+        sums[k] = top[k] + bottom[k];
+    }
+}
+
+/**
+ * plain C version of stencilColourUpdateFloat
+ */
+static void stencilColourFloatScalar(float *row, const float *bottom, const float *top,
+                                     size_t from, size_t to, int parity,
+                                     const StencilWeights *weights)
+{
+    float neighbour = (float) weights->neighbour, center = (float) weights->center;
+    size_t j = from + ((from & 1) != (size_t) parity);
+    for (; j < to; j += 2)
+    {
+        float updated = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j]));
+        row[j] = center != 0 ? updated + center * row[j] : updated;
+    }
+}
+
+/**
+ * plain C version of stencilJacobiUpdateFloat
+ */
+static void stencilJacobiFloatScalar(float *out, const float *row, const float *bottom,
+                                     const float *top, size_t from, size_t to,
+                                     const StencilWeights *weights)
+{
+    float neighbour = (float) weights->neighbour, center = (float) weights->center;
+    for (size_t j = from; j < to; j++)
+    {
+        float updated = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j]));
+        out[j] = center != 0 ? updated + center * row[j] : updated;
+    }
+}
+
+#ifdef STENCIL_X86
+
+/**
+ * SSE2 version of verticalSums, two cells per instruction
+ */
+__attribute__((target("sse2")))
+static void verticalSumsSse2(double *sums, const double *bottom, const double *top, size_t count)
+{
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2)
+    {
+        _mm_storeu_pd(sums + k, _mm_add_pd(_mm_loadu_pd(top + k), _mm_loadu_pd(bottom + k)));
+    }
+    verticalSumsScalar(sums + k, bottom + k, top + k, count - k);
+}
+
+/**
+ * SSE2 version of stencilColourUpdate, computes both lanes and keeps the one of the right colour
+ */
+__attribute__((target("sse2")))
+static void stencilColourSse2(double *row, const double *bottom, const double *top,
+                              size_t from, size_t to, int parity, const StencilWeights *weights)
+{
+    // lane k holds column j + k, and j keeps the parity of from
+    int firstLane = (from & 1) != (size_t) parity;
+    __m128d keep = _mm_castsi128_pd(_mm_set_epi64x(firstLane ? -1 : 0, firstLane ? 0 : -1));
+    __m128d neighbour = _mm_set1_pd(weights->neighbour), center = _mm_set1_pd(weights->center);
+    int weighted = weights->center != 0;
+    size_t j = from;
+    for (; j + 2 <= to; j += 2)
+    {
+        __m128d sides = _mm_add_pd(_mm_loadu_pd(row + j - 1), _mm_loadu_pd(row + j + 1));
+        __m128d vertical = _mm_add_pd(_mm_loadu_pd(top + j), _mm_loadu_pd(bottom + j));
+        __m128d updated = _mm_mul_pd(neighbour, _mm_add_pd(sides, vertical));
+        __m128d old = _mm_loadu_pd(row + j);
+        if (weighted)
+        {
+            updated = _mm_add_pd(updated, _mm_mul_pd(center, old));
+        }
+        _mm_storeu_pd(row + j, _mm_or_pd(_mm_and_pd(keep, updated), _mm_andnot_pd(keep, old)));
+    }
+    stencilColourScalar(row, bottom, top, j, to, parity, weights);
+}
+
+/**
+ * SSE2 version of stencilJacobiUpdate, two cells per instruction
+ */
+__attribute__((target("sse2")))
+static void stencilJacobiSse2(double *out, const double *row, const double *bottom,
+                              const double *top, size_t from, size_t to,
+                              const StencilWeights *weights)
+{
+    __m128d neighbour = _mm_set1_pd(weights->neighbour), center = _mm_set1_pd(weights->center);
+    int weighted = weights->center != 0;
+    size_t j = from;
+    for (; j + 2 <= to; j += 2)
+    {
+        __m128d sides = _mm_add_pd(_mm_loadu_pd(row + j - 1), _mm_loadu_pd(row + j + 1));
+        __m128d vertical = _mm_add_pd(_mm_loadu_pd(top + j), _mm_loadu_pd(bottom + j));
+        __m128d updated = _mm_mul_pd(neighbour, _mm_add_pd(sides, vertical));
+        if (weighted)
+        {
+            updated = _mm_add_pd(updated, _mm_mul_pd(center, _mm_loadu_pd(row + j)));
+        }
+        _mm_storeu_pd(out + j, updated);
+    }
+    stencilJacobiScalar(out, row, bottom, top, j, to, weights);
+}
+
+/**
+ * AVX2 version of verticalSums, four cells per instruction
+ */
+__attribute__((target("avx2")))
+static void verticalSumsAvx2(double *sums, const double *bottom, const double *top, size_t count)
+{
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4)
+    {
+        __m256d sum = _mm256_add_pd(_mm256_loadu_pd(top + k), _mm256_loadu_pd(bottom + k));
+        _mm256_storeu_pd(sums + k, sum);
+    }
+    verticalSumsScalar(sums + k, bottom + k, top + k, count - k);
+}
+
+/**
+ * AVX2 version of stencilColourUpdate, computes all four lanes and keeps the ones of the right
+ * colour
+ */
+__attribute__((target("avx2")))
+static void stencilColourAvx2(double *row, const double *bottom, const double *top,
+                              size_t from, size_t to, int parity, const StencilWeights *weights)
+{
+    // lane k holds column j + k, and j keeps the parity of from
+    long long even = (from & 1) == (size_t) parity ? -1 : 0;
+    __m256d keep = _mm256_castsi256_pd(_mm256_set_epi64x(~even, even, ~even, even));
+    __m256d neighbour = _mm256_set1_pd(weights->neighbour);
+    __m256d center = _mm256_set1_pd(weights->center);
+    int weighted = weights->center != 0;
+    size_t j = from;
+    for (; j + 4 <= to; j += 4)
+    {
+        __m256d sides = _mm256_add_pd(_mm256_loadu_pd(row + j - 1),
+                                      _mm256_loadu_pd(row + j + 1));
+        __m256d vertical = _mm256_add_pd(_mm256_loadu_pd(top + j), _mm256_loadu_pd(bottom + j));
+        __m256d updated = _mm256_mul_pd(neighbour, _mm256_add_pd(sides, vertical));
+        __m256d old = _mm256_loadu_pd(row + j);
+        if (weighted)
+        {
+            updated = _mm256_add_pd(updated, _mm256_mul_pd(center, old));
+        }
+        _mm256_storeu_pd(row + j, _mm256_blendv_pd(old, updated, keep));
+    }
+    stencilColourScalar(row, bottom, top, j, to, parity, weights);
+}
+
+/**
+ * AVX2 version of stencilJacobiUpdate, four cells per instruction
+ */
+__attribute__((target("avx2")))
+static void stencilJacobiAvx2(double *out, const double *row, const double *bottom,
+                              const double *top, size_t from, size_t to,
+                              const StencilWeights *weights)
+{
+    __m256d neighbour = _mm256_set1_pd(weights->neighbour);
+    __m256d center = _mm256_set1_pd(weights->center);
+    int weighted = weights->center != 0;
+    size_t j = from;
+    for (; j + 4 <= to; j += 4)
+    {
+        __m256d sides = _mm256_add_pd(_mm256_loadu_pd(row + j - 1),
+                                      _mm256_loadu_pd(row + j + 1));
+        __m256d vertical = _mm256_add_pd(_mm256_loadu_pd(top + j), _mm256_loadu_pd(bottom + j));
+        __m256d updated = _mm256_mul_pd(neighbour, _mm256_add_pd(sides, vertical));
+        if (weighted)
+        {
+            updated = _mm256_add_pd(updated, _mm256_mul_pd(center, _mm256_loadu_pd(row + j)));
+        }
+        _mm256_storeu_pd(out + j, updated);
+    }
+    stencilJacobiScalar(out, row, bottom, top, j, to, weights);
+}
+
+/**
+ * SSE2 version of verticalSumsFloat, four cells per instruction
+ */
+__attribute__((target("sse2")))
+static void verticalSumsFloatSse2(float *sums, const float *bottom, const float *top,
+                                  size_t count)
+{
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4)
+    {
+        _mm_storeu_ps(sums + k, _mm_add_ps(_mm_loadu_ps(top + k), _mm_loadu_ps(bottom + k)));
+    }
+    verticalSumsFloatScalar(sums + k, bottom + k, top + k, count - k);
+}
+
+/**
+ * SSE2 version of stencilColourUpdateFloat, computes all four lanes and keeps the ones of the
+ * right colour
+ */
+__attribute__((target("sse2")))
+static void stencilColourFloatSse2(float *row, const float *bottom, const float *top,
+                                   size_t from, size_t to, int parity,
+                                   const StencilWeights *weights)
+{
+    // lane k holds column j + k, and j keeps the parity of from
+    int even = (from & 1) == (size_t) parity ? -1 : 0;
+    __m128 keep = _mm_castsi128_ps(_mm_set_epi32(~even, even, ~even, even));
+    __m128 neighbour = _mm_set1_ps((float) weights->neighbour);
+    __m128 center = _mm_set1_ps((float) weights->center);
+    int weighted = (float) weights->center != 0;
+    size_t j = from;
+    for (; j + 4 <= to; j += 4)
+    {
+        __m128 sides = _mm_add_ps(_mm_loadu_ps(row + j - 1), _mm_loadu_ps(row + j + 1));
+        __m128 vertical = _mm_add_ps(_mm_loadu_ps(top + j), _mm_loadu_ps(bottom + j));
+        __m128 updated = _mm_mul_ps(neighbour, _mm_add_ps(sides, vertical));
+        __m128 old = _mm_loadu_ps(row + j);
+        if (weighted)
+        {
+            updated = _mm_add_ps(updated, _mm_mul_ps(center, old));
+        }
+        _mm_storeu_ps(row + j, _mm_or_ps(_mm_and_ps(keep, updated), _mm_andnot_ps(keep, old)));
+    }
+    stencilColourFloatScalar(row, bottom, top, j, to, parity, weights);
+}
+
+/**
+ * SSE2 version of stencilJacobiUpdateFloat, four cells per instruction
+ */
+__attribute__((target("sse2")))
+static void stencilJacobiFloatSse2(float *out, const float *row, const float *bottom,
+                                   const float *top, size_t from, size_t to,
+                                   const StencilWeights *weights)
+{
+    __m128 neighbour = _mm_set1_ps((float) weights->neighbour);
+    __m128 center = _mm_set1_ps((float) weights->center);
+    int weighted = (float) weights->center != 0;
+    size_t j = from;
+    for (; j + 4 <= to; j += 4)
+    {
+        __m128 sides = _mm_add_ps(_mm_loadu_ps(row + j - 1), _mm_loadu_ps(row + j + 1));
+        __m128 vertical = _mm_add_ps(_mm_loadu_ps(top + j), _mm_loadu_ps(bottom + j));
+        __m128 updated = _mm_mul_ps(neighbour, _mm_add_ps(sides, vertical));
+        if (weighted)
+        {
+            updated = _mm_add_ps(updated, _mm_mul_ps(center, _mm_loadu_ps(row + j)));
+        }
+        _mm_storeu_ps(out + j, updated);
+    }
+    stencilJacobiFloatScalar(out, row, bottom, top, j, to, weights);
+}
+
+/**
+ * AVX2 version of verticalSumsFloat, eight cells per instruction
+ */
+__attribute__((target("avx2")))
+static void verticalSumsFloatAvx2(float *sums, const float *bottom, const float *top,
+                                  size_t count)
+{
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8)
+    {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(top + k), _mm256_loadu_ps(bottom + k));
+        _mm256_storeu_ps(sums + k, sum);
+    }
+    verticalSumsFloatScalar(sums + k, bottom + k, top + k, count - k);
+}
+
+/**
+ * AVX2 version of stencilColourUpdateFloat, computes all eight lanes and keeps the ones of the
+ * right colour
+ */
+__attribute__((target("avx2")))
+static void stencilColourFloatAvx2(float *row, const float *bottom, const float *top,
+                                   size_t from, size_t to, int parity,
+                                   const StencilWeights *weights)
+{
+    // lane k holds column j + k, and j keeps the parity of from
+    int even = (from & 1) == (size_t) parity ? -1 : 0;
+    __m256 keep = _mm256_castsi256_ps(_mm256_set_epi32(~even, even, ~even, even,
+                                                       ~even, even, ~even, even));
+    __m256 neighbour = _mm256_set1_ps((float) weights->neighbour);
+    __m256 center = _mm256_set1_ps((float) weights->center);
+    int weighted = (float) weights->center != 0;
+    size_t j = from;
+    for (; j + 8 <= to; j += 8)
+    {
+        __m256 sides = _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+        __m256 vertical = _mm256_add_ps(_mm256_loadu_ps(top + j), _mm256_loadu_ps(bottom + j));
+        __m256 updated = _mm256_mul_ps(neighbour, _mm256_add_ps(sides, vertical));
+        __m256 old = _mm256_loadu_ps(row + j);
+        if (weighted)
+        {
+            updated = _mm256_add_ps(updated, _mm256_mul_ps(center, old));
+        }
+        _mm256_storeu_ps(row + j, _mm256_blendv_ps(old, updated, keep));
+    }
+    stencilColourFloatScalar(row, bottom, top, j, to, parity, weights);
+}
+
+/**
+ * AVX2 version of stencilJacobiUpdateFloat, eight cells per instruction
+ */
+__attribute__((target("avx2")))
+static void stencilJacobiFloatAvx2(float *out, const float *row, const float *bottom,
+                                   const float *top, size_t from, size_t to,
+                                   const StencilWeights *weights)
+{
+    __m256 neighbour = _mm256_set1_ps((float) weights->neighbour);
+    __m256 center = _mm256_set1_ps((float) weights->center);
+    int weighted = (float) weights->center != 0;
+    size_t j = from;
+    for (; j + 8 <= to; j += 8)
+    {
+        __m256 sides = _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+        __m256 vertical = _mm256_add_ps(_mm256_loadu_ps(top + j), _mm256_loadu_ps(bottom + j));
+        __m256 updated = _mm256_mul_ps(neighbour, _mm256_add_ps(sides, vertical));
+        if (weighted)
+        {
+            updated = _mm256_add_ps(updated, _mm256_mul_ps(center, _mm256_loadu_ps(row + j)));
+        }
+        _mm256_storeu_ps(out + j, updated);
+    }
+    stencilJacobiFloatScalar(out, row, bottom, top, j, to, weights);
+}
+
+static const StencilImpl AVX2_IMPL = {"avx2", verticalSumsAvx2, stencilColourAvx2,
+                                      stencilJacobiAvx2, verticalSumsFloatAvx2,
+                                      stencilColourFloatAvx2, stencilJacobiFloatAvx2};
+static const StencilImpl SSE2_IMPL = {"sse2", verticalSumsSse2, stencilColourSse2,
+                                      stencilJacobiSse2, verticalSumsFloatSse2,
+                                      stencilColourFloatSse2, stencilJacobiFloatSse2};
+
+#endif
+
+static const StencilImpl SCALAR_IMPL = {"scalar", verticalSumsScalar, stencilColourScalar,
+                                        stencilJacobiScalar, verticalSumsFloatScalar,
+                                        stencilColourFloatScalar, stencilJacobiFloatScalar};
+
+static const StencilImpl *impl = NULL;
+static pthread_once_t selectOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * pick the implementation for this cpu
+ */
+static void pickImplementation(void)
+{
+#ifdef STENCIL_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        impl = &AVX2_IMPL;
+        return;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        impl = &SSE2_IMPL;
+        return;
+    }
+#endif
+    impl = &SCALAR_IMPL;
+}
+
+/**
+ * pick the implementation once, safe to call from several threads
+ */
+static void selectImplementation(void)
+{
+    pthread_once(&selectOnce, pickImplementation);
+}
+
+/**
+ * sums[k] = top[k] + bottom[k] for every k in 0..count-1, the vertical half of the stencil sum
+ * (left + right) + (top + bottom)
+ * @param sums gets the sums
+ * @param bottom the row below, from the first column summed
+ * @param top the row above, from the first column summed
+ * @param count number of columns
+ */
+void verticalSums(double *sums, const double *bottom, const double *top, size_t count)
+{
+    selectImplementation();
+    impl->sums(sums, bottom, top, count);
+}
+
+/**
+ * stencil update of the cells j in from..to-1 with j % 2 == parity,
+ * row[j] = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j])) + center * row[j].
+ * the other cells are only read, so the order of the updates doesn't matter.
+ * @param row the row being updated
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param parity 0 or 1
+ * @param weights weights of the stencil
+ */
+void stencilColourUpdate(double *row, const double *bottom, const double *top, size_t from,
+                         size_t to, int parity, const StencilWeights *weights)
+{
+    selectImplementation();
+    impl->colour(row, bottom, top, from, to, parity, weights);
+}
+
+/**
+ * stencil update of the cells from..to-1 into a separate row,
+ * out[j] = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j])) + center * row[j].
+ * @param out the row the new values are written to
+ * @param row the old values of the row
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param weights weights of the stencil
+ */
+void stencilJacobiUpdate(double *out, const double *row, const double *bottom, const double *top,
+                         size_t from, size_t to, const StencilWeights *weights)
+{
+    selectImplementation();
+    impl->jacobi(out, row, bottom, top, from, to, weights);
+}
+
+/**
+ * verticalSums of float rows
+ * @param sums gets the sums
+ * @param bottom the row below, from the first column summed
+ * @param top the row above, from the first column summed
+ * @param count number of columns
+ */
+void verticalSumsFloat(float *sums, const float *bottom, const float *top, size_t count)
+{
+    selectImplementation();
+    impl->floatSums(sums, bottom, top, count);
+}
+
+/**
+ * stencilColourUpdate of float rows, with the weights rounded to float
+ * @param row the row being updated
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param parity 0 or 1
+ * @param weights weights of the stencil
+ */
+void stencilColourUpdateFloat(float *row, const float *bottom, const float *top, size_t from,
+                              size_t to, int parity, const StencilWeights *weights)
+{
+    selectImplementation();
+    impl->floatColour(row, bottom, top, from, to, parity, weights);
+}
+
+/**
+ * stencilJacobiUpdate of float rows, with the weights rounded to float
+ * @param out the row the new values are written to
+ * @param row the old values of the row
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param weights weights of the stencil
+ */
+void stencilJacobiUpdateFloat(float *out, const float *row, const float *bottom,
+                              const float *top, size_t from, size_t to,
+                              const StencilWeights *weights)
+{
+    selectImplementation();
+    impl->floatJacobi(out, row, bottom, top, from, to, weights);
+}
+
+/**
+ * @return name of the instruction set the functions run with
+ */
+const char *stencilInstructionSet(void)
+{
+    selectImplementation();
+    return impl->name;
+}
@@ -0,0 +1,110 @@
+/**
+ * @author Idan Yamin
+ * @brief vectorized building blocks of the linear 5-point stencil sweeps.
+ * every function uses the widest instruction set the cpu supports (AVX2, SSE2 or plain C).
+ * the float versions work on twice the cells per instruction.
+ */
+
+#ifndef EX3_STENCIL_H
+#define EX3_STENCIL_H
+
+#include <stddef.h>
+
+// weight of every neighbour in the built-in heat equation
+#define HEAT_WEIGHT 0.25
+
+// most columns of one verticalSums call of a raster sweep, the sums are kept on the stack
+#define VERTICAL_CHUNK 256
+
+/**
+ * weights of a linear 5-point stencil,
+ * new = center * value + neighbour * ((left + right) + (top + bottom)).
+ * a zero center skips the center term, so averaging stencils round exactly like heat_eqn.
+ */
+typedef struct StencilWeights
+{
+    double center;
+    double neighbour;
+} StencilWeights;
+
+/**
+ * sums[k] = top[k] + bottom[k] for every k in 0..count-1, the vertical half of the stencil sum
+ * (left + right) + (top + bottom)
+ * @param sums gets the sums
+ * @param bottom the row below, from the first column summed
+ * @param top the row above, from the first column summed
+ * @param count number of columns
+ */
+void verticalSums(double *sums, const double *bottom, const double *top, size_t count);
+
+/**
+ * stencil update of the cells j in from..to-1 with j % 2 == parity,
+ * row[j] = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j])) + center * row[j].
+ * the other cells are only read, so the order of the updates doesn't matter.
+ * @param row the row being updated
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param parity 0 or 1
+ * @param weights weights of the stencil
+ */
+void stencilColourUpdate(double *row, const double *bottom, const double *top, size_t from,
+                         size_t to, int parity, const StencilWeights *weights);
+
+/**
+ * stencil update of the cells from..to-1 into a separate row,
+ * out[j] = neighbour * ((row[j - 1] + row[j + 1]) + (top[j] + bottom[j])) + center * row[j].
+ * @param out the row the new values are written to
+ * @param row the old values of the row
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param weights weights of the stencil
+ */
+void stencilJacobiUpdate(double *out, const double *row, const double *bottom, const double *top,
+                         size_t from, size_t to, const StencilWeights *weights);
+
+/**
+ * verticalSums of float rows
+ * @param sums gets the sums
+ * @param bottom the row below, from the first column summed
+ * @param top the row above, from the first column summed
+ * @param count number of columns
+ */
+void verticalSumsFloat(float *sums, const float *bottom, const float *top, size_t count);
+
+/**
+ * stencilColourUpdate of float rows, with the weights rounded to float
+ * @param row the row being updated
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param parity 0 or 1
+ * @param weights weights of the stencil
+ */
+void stencilColourUpdateFloat(float *row, const float *bottom, const float *top, size_t from,
+                              size_t to, int parity, const StencilWeights *weights);
+
+/**
+ * stencilJacobiUpdate of float rows, with the weights rounded to float
+ * @param out the row the new values are written to
+ * @param row the old values of the row
+ * @param bottom the row below it
+ * @param top the row above it
+ * @param from first column, at least 1
+ * @param to one past the last column
+ * @param weights weights of the stencil
+ */
+void stencilJacobiUpdateFloat(float *out, const float *row, const float *bottom,
+                              const float *top, size_t from, size_t to,
+                              const StencilWeights *weights);
+
+/**
+ * @return name of the instruction set the functions run with
+ */
+const char *stencilInstructionSet(void);
+
+#endif //EX3_STENCIL_H
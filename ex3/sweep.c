@@ -0,0 +1,488 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include "sweep.h"
+#include "stencil.h"
+
+/**
+ * how the segments of a row are updated
+ */
+typedef enum SegmentPath
+{
+    PATH_GENERIC,
+    PATH_STENCIL,
+    PATH_VECTOR
+} SegmentPath;
+
+typedef void (*segment_func)(const RowView *, size_t, size_t);
+
+/**
+ * defines NAME(row, from, to), the update of the free interior cells from..to-1 of a row (of the
+ * row parity) by the stencil of the row view, with the function call inlined. the edge columns
+ * are updateEdgeCell's, so every cell has both of its neighbours in the row.
+ * WEIGHTED 0 drops the center term, the way the vectorized kernels do for a zero center.
+ */
+#define DEFINE_STENCIL_SEGMENT(NAME, WEIGHTED)                                                  \
+static void NAME(const RowView *row, const size_t from, const size_t to)                       \
+{                                                                                               \
+    const double *values = row->values, *bottom = row->bottom, *top = row->top;                \
+    const double center = row->stencil->weights.center;                                         \
+    const double neighbour = row->stencil->weights.neighbour;                                   \
+    size_t j = from, step = 1;                                                                  \
+    if (row->parity != ALL_COLOURS)                                                             \
+    {                                                                                           \
+        j += (from & 1) != (size_t) row->parity;                                                \
+        step = 2;                                                                               \
+    }                                                                                           \
+    for (; j < to; j += step)                                                                   \
+    {                                                                                           \
+        double vertical = (top ? top[j] : 0) + (bottom ? bottom[j] : 0);                        \
+        double updated = neighbour * ((values[j - 1] + values[j + 1]) + vertical);              \
+        row->out[j] = WEIGHTED ? updated + center * values[j] : updated;                        \
+    }                                                                                           \
+}
+
+DEFINE_STENCIL_SEGMENT(averageSegment, 0)
+
+DEFINE_STENCIL_SEGMENT(weightedSegment, 1)
+
+// STENCIL_SEGMENTS[weighted]
+static const segment_func STENCIL_SEGMENTS[2] = {averageSegment, weightedSegment};
+
+
+// ____________ functions _______________
+void updateRow(diff_func function, const RowView *row, int is_cyclic);
+
+void updateRowColumns(diff_func function, const RowView *row, size_t from, size_t to,
+                      int is_cyclic);
+
+void updateRowRange(diff_func function, const RowView *row, size_t from, size_t to,
+                    SegmentPath path);
+
+void updateEdgeCell(diff_func function, const RowView *row, size_t j, int is_cyclic);
+
+void updateSegment(diff_func function, const RowView *row, size_t from, size_t to);
+
+void updateHeatSegment(const RowView *row, size_t from, size_t to);
+
+void updateFastSegment(const RowView *row, size_t from, size_t to);
+
+double ghostCell(const RowView *row, size_t edge, size_t opposite, int is_cyclic);
+
+double getBottom(const RowView *row, size_t col);
+
+double getTop(const RowView *row, size_t col);
+
+
+/**
+ * update rows lo..hi-1 of the grid in raster order, every row sees the already updated row
+ * before it inside the band and the old row after it.
+ * with a colour only the cells (i, j) with (i + j) % 2 == colour are updated, they only read
+ * cells of the other colour.
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with: the registered stencil of the function
+ *                (see findStencil), an over-relaxed copy of it, or NULL to call the function
+ * @param grid grid of values
+ * @param lo first row of the band
+ * @param hi one past the last row of the band
+ * @param bandBottom the row before row lo, NULL for a zero edge
+ * @param bandTop the row after row hi - 1, NULL for a zero edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, rowSums[i] gets the heat of row i right after it was updated
+ */
+void updateBand(const diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                const size_t lo, const size_t hi, const double *bandBottom,
+                const double *bandTop, const int is_cyclic, const int colour, double *rowSums)
+{
+    for (size_t i = lo; i < hi; i++)
+    {
+        RowView row;
+        row.out = GRID_ROW(grid, i);
+        row.values = row.out;
+        row.bottom = i > lo ? GRID_ROW(grid, i - 1) : bandBottom;
+        row.top = i + 1 < hi ? GRID_ROW(grid, i + 1) : bandTop;
+        row.cols = grid->cols;
+        row.pinned = pinnedRowCols(grid, i);
+        row.numPinned = pinnedInRow(grid, i);
+        row.parity = colour == ALL_COLOURS ? ALL_COLOURS : (int) ((i + (size_t) colour) % 2);
+        row.stencil = stencil;
+        row.edges = grid->edges;
+        row.edgeValue = grid->edgeValue;
+        updateRow(function, &row, is_cyclic);
+        // the row is final for this pass and still in cache
+        if (rowSums)
+        {
+            rowSums[i] = rowHeat(row.out, row.cols);
+        }
+    }
+}
+
+/**
+ * update the cells of columns from..to-1 of row i in place, each cell the same way updateBand
+ * updates it, so updating all the spans of a row one after the other updates the whole row.
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param i the row
+ * @param from first column
+ * @param to one past the last column
+ * @param bottom the row before row i, NULL for a zero edge
+ * @param top the row after row i, NULL for a zero edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ */
+void updateRowSpan(const diff_func function, const LinearStencil *stencil, HeatGrid *grid,
+                   const size_t i, const size_t from, const size_t to, const double *bottom,
+                   const double *top, const int is_cyclic, const int colour)
+{
+    RowView row;
+    row.out = GRID_ROW(grid, i);
+    row.values = row.out;
+    row.bottom = bottom;
+    row.top = top;
+    row.cols = grid->cols;
+    row.pinned = pinnedRowCols(grid, i);
+    row.numPinned = pinnedInRow(grid, i);
+    row.parity = colour == ALL_COLOURS ? ALL_COLOURS : (int) ((i + (size_t) colour) % 2);
+    row.stencil = stencil;
+    row.edges = grid->edges;
+    row.edgeValue = grid->edgeValue;
+    updateRowColumns(function, &row, from, to, is_cyclic);
+}
+
+/**
+ * Jacobi update of rows lo..hi-1: every free cell is computed from the values in grid->data
+ * and written to grid->spare, so the rows can be updated in any order.
+ * @param function the update function
+ * @param grid grid of values, must have a spare buffer (see prepareSpare)
+ * @param lo first row
+ * @param hi one past the last row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void updateBandJacobi(const diff_func function, HeatGrid *grid, const size_t lo, const size_t hi,
+                      const int is_cyclic, double *rowSums)
+{
+    updateBandInto(function, grid, grid->data, grid->spare, lo, hi, is_cyclic, rowSums);
+}
+
+/**
+ * Jacobi update of rows lo..hi-1 from one buffer of the grid to the other, the pinned cells
+ * of the target must already hold their values.
+ * @param function the update function
+ * @param grid grid of values
+ * @param from buffer of the old values, grid->data or grid->spare
+ * @param to buffer the new values are written to, the other one
+ * @param lo first row
+ * @param hi one past the last row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void updateBandInto(const diff_func function, const HeatGrid *grid, const double *from,
+                    double *to, const size_t lo, const size_t hi, const int is_cyclic,
+                    double *rowSums)
+{
+    size_t stride = grid->stride;
+    const LinearStencil *stencil = findStencil(function);
+    for (size_t i = lo; i < hi; i++)
+    {
+        RowView row;
+        row.out = to + i * stride;
+        row.values = from + i * stride;
+        row.bottom = bottomRow(grid, from, i, is_cyclic);
+        row.top = topRow(grid, from, i, is_cyclic);
+        row.cols = grid->cols;
+        row.pinned = pinnedRowCols(grid, i);
+        row.numPinned = pinnedInRow(grid, i);
+        row.parity = ALL_COLOURS;
+        row.stencil = stencil;
+        row.edges = grid->edges;
+        row.edgeValue = grid->edgeValue;
+        updateRow(function, &row, is_cyclic);
+        if (rowSums)
+        {
+            rowSums[i] = rowHeat(row.out, row.cols);
+        }
+    }
+}
+
+/**
+ * @param row a row
+ * @param cols number of values in the row
+ * @return the sum of the values of the row
+ */
+double rowHeat(const double *row, const size_t cols)
+{
+    double sum = 0;
+    for (size_t j = 0; j < cols; j++)
+    {
+        sum += row[j];
+    }
+    return sum;
+}
+
+/**
+ * the rows are summed one by one and then added up in order, so any split of the rows into
+ * bands reduces to the same value
+ * @param grid of heat
+ * @param lo first row
+ * @param hi one past the last row
+ * @return the sum of the values of rows lo..hi-1
+ */
+double sumRows(const HeatGrid *grid, const size_t lo, const size_t hi)
+{
+    double sum = 0;
+    for (size_t i = lo; i < hi; i++)
+    {
+        sum += rowHeat(GRID_ROW(grid, i), grid->cols);
+    }
+    return sum;
+}
+
+/**
+ * update one row. a function without a registered stencil is called for every cell.
+ * the edge columns read the cells past them once per row (see ghostCell), the interior cells of
+ * a stencil take the vectorized path when both neighbour rows exist (in raster order only
+ * without a center term, which the vectorized recurrence can't keep), or else go through the
+ * inlined scalar stencil segments.
+ * @param function the update function
+ * @param row the row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateRow(const diff_func function, const RowView *row, const int is_cyclic)
+{
+    updateRowColumns(function, row, 0, row->cols, is_cyclic);
+}
+
+/**
+ * update columns from..to-1 of a row, every cell takes the path it takes in updateRow
+ * @param function the update function
+ * @param row the row
+ * @param from first column
+ * @param to one past the last column
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateRowColumns(const diff_func function, const RowView *row, const size_t from,
+                      const size_t to, const int is_cyclic)
+{
+    if (from >= to)
+    {
+        return;
+    }
+    size_t last = row->cols - 1;
+    size_t lo = from > 0 ? from : 1, hi = to <= last ? to : last;
+    // in raster order the first column goes first and the last one last, as inside the row
+    if (from == 0)
+    {
+        updateEdgeCell(function, row, 0, is_cyclic);
+    }
+    if (lo < hi && !row->stencil)
+    {
+        updateRowRange(function, row, lo, hi, PATH_GENERIC);
+    }
+    else if (lo < hi)
+    {
+        int inPlaceRaster = row->out == row->values && row->parity == ALL_COLOURS;
+        int vectorized = !inPlaceRaster || row->stencil->weights.center == 0;
+        SegmentPath path = vectorized && row->bottom && row->top ? PATH_VECTOR : PATH_STENCIL;
+        updateRowRange(function, row, lo, hi, path);
+    }
+    if (to == row->cols && last > 0)
+    {
+        updateEdgeCell(function, row, last, is_cyclic);
+    }
+}
+
+/**
+ * update the free interior cells of columns from..to-1 of a row, the pinned cells split it into
+ * segments
+ * @param function the update function
+ * @param row the row
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ * @param path how to update the segments
+ */
+void updateRowRange(const diff_func function, const RowView *row, size_t from, const size_t to,
+                    const SegmentPath path)
+{
+    size_t k = 0;
+    while (k < row->numPinned && row->pinned[k] < from)
+    {
+        k++;
+    }
+    while (from < to)
+    {
+        size_t end = (k < row->numPinned && row->pinned[k] < to) ? row->pinned[k] : to;
+        if (path == PATH_VECTOR)
+        {
+            updateFastSegment(row, from, end);
+        }
+        else if (path == PATH_STENCIL)
+        {
+            STENCIL_SEGMENTS[row->stencil->weights.center != 0](row, from, end);
+        }
+        else
+        {
+            updateSegment(function, row, from, end);
+        }
+        from = end + 1;
+        k++;
+    }
+}
+
+/**
+ * update the first or the last column of a row, unless it is pinned or of the other parity
+ * @param function the update function
+ * @param row the row
+ * @param j the column, 0 or cols - 1
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ */
+void updateEdgeCell(const diff_func function, const RowView *row, const size_t j,
+                    const int is_cyclic)
+{
+    size_t last = row->cols - 1;
+    int pinned = row->numPinned > 0 && row->pinned[j == 0 ? 0 : row->numPinned - 1] == j;
+    if (pinned || (row->parity != ALL_COLOURS && (j & 1) != (size_t) row->parity))
+    {
+        return;
+    }
+    const double *values = row->values;
+    double left = j > 0 ? values[j - 1] : ghostCell(row, 0, last, is_cyclic);
+    double right = j < last ? values[j + 1] : ghostCell(row, last, 0, is_cyclic);
+    double bottom = getBottom(row, j), top = getTop(row, j);
+    if (!row->stencil)
+    {
+        row->out[j] = function(values[j], right, top, left, bottom);
+        return;
+    }
+    double center = row->stencil->weights.center;
+    double updated = row->stencil->weights.neighbour * ((left + right) + (top + bottom));
+    row->out[j] = center != 0 ? updated + center * values[j] : updated;
+}
+
+/**
+ * stencil update of the interior cells from..to-1 of a row, with the vectorized kernel of the
+ * kind of update the row view describes
+ * @param row the row, both neighbour rows must exist
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ */
+void updateFastSegment(const RowView *row, const size_t from, const size_t to)
+{
+    if (row->out != row->values)
+    {
+        stencilJacobiUpdate(row->out, row->values, row->bottom, row->top, from, to,
+                            &row->stencil->weights);
+    }
+    else if (row->parity != ALL_COLOURS)
+    {
+        stencilColourUpdate(row->out, row->bottom, row->top, from, to, row->parity,
+                            &row->stencil->weights);
+    }
+    else
+    {
+        updateHeatSegment(row, from, to);
+    }
+}
+
+/**
+ * update of the interior cells from..to-1 of a row by a stencil without a center term,
+ * in raster order.
+ * the top + bottom sums are vectorized a chunk at a time, then every cell adds them to the
+ * new left and the old right neighbour, (left + right) + (top + bottom) like the other kernels,
+ * since the left neighbour was just written.
+ * @param row the row, both neighbour rows must exist
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ */
+void updateHeatSegment(const RowView *row, const size_t from, const size_t to)
+{
+    double *values = row->out, weight = row->stencil->weights.neighbour;
+    double vertical[VERTICAL_CHUNK];
+    for (size_t j = from; j < to; j += VERTICAL_CHUNK)
+    {
+        size_t count = to - j < VERTICAL_CHUNK ? to - j : VERTICAL_CHUNK;
+        verticalSums(vertical, row->bottom + j, row->top + j, count);
+        for (size_t k = 0; k < count; k++)
+        {
+            values[j + k] = weight * ((values[j + k - 1] + values[j + k + 1]) + vertical[k]);
+        }
+    }
+}
+
+/**
+ * update the free interior cells from..to-1 of a row (of the row parity) through the given
+ * function
+ * @param function the given function
+ * @param row the row
+ * @param from first column, at least 1
+ * @param to one past the last column, at most cols - 1
+ */
+void updateSegment(const diff_func function, const RowView *row, const size_t from,
+                   const size_t to)
+{
+    const double *values = row->values;
+    size_t j = from, step = 1;
+    if (row->parity != ALL_COLOURS)
+    {
+        j += (from & 1) != (size_t) row->parity;
+        step = 2;
+    }
+    for (; j < to; j += step)
+    {
+        double bottom = getBottom(row, j);
+        double top = getTop(row, j);
+        row->out[j] = function(values[j], values[j + 1], top, values[j - 1], bottom);
+    }
+}
+
+/**
+ * the cell past an edge column of a row
+ * @param row the row
+ * @param edge the edge column, 0 or cols - 1
+ * @param opposite the column at the other edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @return the value of the opposite column of a cyclic row, of the edge column itself past a
+ *         Neumann edge, the value of a Dirichlet edge
+ */
+double ghostCell(const RowView *row, const size_t edge, const size_t opposite,
+                 const int is_cyclic)
+{
+    if (is_cyclic)
+    {
+        return row->values[opposite];
+    }
+    return row->edges == EDGE_NEUMANN ? row->values[edge] : row->edgeValue;
+}
+
+/**
+ *
+ * @param row the row
+ * @param col int rhe grid
+ * @return the bottom value to the given coordinates
+ */
+double getBottom(const RowView *row, const size_t col)
+{
+    if (!row->bottom)
+    {
+        return 0;
+    }
+    return row->bottom[col];
+}
+
+/**
+ *
+ * @param row the row
+ * @param col int rhe grid
+ * @return the top value to the given coordinates
+ */
+double getTop(const RowView *row, const size_t col)
+{
+    if (!row->top)
+    {
+        return 0;
+    }
+    return row->top[col];
+}
@@ -0,0 +1,122 @@
+/**
+ * @author Idan Yamin
+ * @brief one relaxation sweep over rows of a HeatGrid.
+ */
+
+#ifndef EX3_SWEEP_H
+#define EX3_SWEEP_H
+
+#include "calculator.h"
+#include "heat_grid.h"
+#include "kernels.h"
+
+// colour of updateBand that updates every cell
+#define ALL_COLOURS (-1)
+
+/**
+ * a row being updated together with its neighbour rows.
+ * bottom is the row before it and top the row after it (as getBottom and getTop name them),
+ * NULL for a zero edge. the new values go to out, which is values itself for an in place update.
+ * parity is ALL_COLOURS, or 0 / 1 to update only the columns of that parity.
+ * stencil is the stencil the row is updated with (see updateBand), NULL to call the function.
+ * edges and edgeValue are those of the grid, the cells past the first and last columns of a row
+ * that isn't cyclic.
+ */
+typedef struct RowView
+{
+    double *out;
+    const double *values;
+    const double *bottom;
+    const double *top;
+    size_t cols;
+    const size_t *pinned;
+    size_t numPinned;
+    int parity;
+    const LinearStencil *stencil;
+    EdgeKind edges;
+    double edgeValue;
+} RowView;
+
+/**
+ * update rows lo..hi-1 of the grid in raster order, every row sees the already updated row
+ * before it inside the band and the old row after it.
+ * with a colour only the cells (i, j) with (i + j) % 2 == colour are updated, they only read
+ * cells of the other colour.
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with: the registered stencil of the function
+ *                (see findStencil), an over-relaxed copy of it, or NULL to call the function
+ * @param grid grid of values
+ * @param lo first row of the band
+ * @param hi one past the last row of the band
+ * @param bandBottom the row before row lo (see bottomRow), NULL for a zero edge
+ * @param bandTop the row after row hi - 1 (see topRow), NULL for a zero edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ * @param rowSums if not NULL, rowSums[i] gets the heat of row i right after it was updated
+ */
+void updateBand(diff_func function, const LinearStencil *stencil, HeatGrid *grid, size_t lo,
+                size_t hi, const double *bandBottom, const double *bandTop, int is_cyclic,
+                int colour, double *rowSums);
+
+/**
+ * update the cells of columns from..to-1 of row i in place, each cell the same way updateBand
+ * updates it, so updating all the spans of a row one after the other updates the whole row.
+ * @param function the update function
+ * @param stencil the stencil the cells are updated with (see updateBand)
+ * @param grid grid of values
+ * @param i the row
+ * @param from first column
+ * @param to one past the last column
+ * @param bottom the row before row i, NULL for a zero edge
+ * @param top the row after row i, NULL for a zero edge
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param colour ALL_COLOURS, or 0 / 1 for one colour of a red-black sweep
+ */
+void updateRowSpan(diff_func function, const LinearStencil *stencil, HeatGrid *grid, size_t i,
+                   size_t from, size_t to, const double *bottom, const double *top,
+                   int is_cyclic, int colour);
+
+/**
+ * Jacobi update of rows lo..hi-1: every free cell is computed from the values in grid->data
+ * and written to grid->spare, so the rows can be updated in any order.
+ * @param function the update function
+ * @param grid grid of values, must have a spare buffer (see prepareSpare)
+ * @param lo first row
+ * @param hi one past the last row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void updateBandJacobi(diff_func function, HeatGrid *grid, size_t lo, size_t hi, int is_cyclic,
+                      double *rowSums);
+
+/**
+ * Jacobi update of rows lo..hi-1 from one buffer of the grid to the other, the pinned cells
+ * of the target must already hold their values.
+ * @param function the update function
+ * @param grid grid of values
+ * @param from buffer of the old values, grid->data or grid->spare
+ * @param to buffer the new values are written to, the other one
+ * @param lo first row
+ * @param hi one past the last row
+ * @param is_cyclic 1 for cyclic, 0 for not cyclic.
+ * @param rowSums if not NULL, rowSums[i] gets the heat of the new row i right after it was written
+ */
+void updateBandInto(diff_func function, const HeatGrid *grid, const double *from, double *to,
+                    size_t lo, size_t hi, int is_cyclic, double *rowSums);
+
+/**
+ * @param row a row
+ * @param cols number of values in the row
+ * @return the sum of the values of the row
+ */
+double rowHeat(const double *row, size_t cols);
+
+/**
+ * @param grid of heat
+ * @param lo first row
+ * @param hi one past the last row
+ * @return the sum of the values of rows lo..hi-1
+ */
+double sumRows(const HeatGrid *grid, size_t lo, size_t hi);
+
+#endif //EX3_SWEEP_H
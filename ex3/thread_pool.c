@@ -0,0 +1,206 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "thread_pool.h"
+
+/**
+ * the pool, every new task bumps generation and wakes the workers,
+ * pending counts the workers that didn't finish the current task yet
+ */
+struct ThreadPool
+{
+    pthread_t *threads;
+    unsigned int count;
+    pthread_mutex_t lock;
+    pthread_cond_t startCond;
+    pthread_cond_t doneCond;
+    pthread_barrier_t sync;
+    unsigned long generation;
+    unsigned int pending;
+    pool_task task;
+    void *arg;
+    int stop;
+};
+
+/**
+ * argument of every worker thread
+ */
+typedef struct Worker
+{
+    ThreadPool *pool;
+    unsigned int index;
+} Worker;
+
+/**
+ * body of the worker threads, runs tasks until the pool stops
+ * @param arg the Worker
+ * @return NULL
+ */
+static void *workerLoop(void *arg)
+{
+    Worker *worker = arg;
+    ThreadPool *pool = worker->pool;
+    unsigned int index = worker->index;
+    unsigned long seen = 0;
+    free(worker);
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->startCond, &pool->lock);
+        }
+        if (pool->stop)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->task(pool->arg, index, pool->count);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->doneCond);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/**
+ * stop the started workers, then free the pool
+ * @param pool the pool
+ * @param started number of worker threads that were started
+ */
+static void stopWorkers(ThreadPool *pool, unsigned int started)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->startCond);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned int i = 0; i < started; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->startCond);
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_barrier_destroy(&pool->sync);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * start a pool, the calling thread counts as one of the threads
+ * @param threads number of threads, at least 1
+ * @return new pool, NULL if the threads could not be created
+ */
+ThreadPool *createPool(unsigned int threads)
+{
+    if (threads == 0)
+    {
+        return NULL;
+    }
+    ThreadPool *pool = malloc(sizeof(ThreadPool));
+    if (!pool)
+    {
+        return NULL;
+    }
+    pool->threads = malloc(sizeof(pthread_t) * threads);
+    if (!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+    pool->count = threads;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->task = NULL;
+    pool->arg = NULL;
+    pool->stop = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->startCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+    pthread_barrier_init(&pool->sync, NULL, threads);
+
+    for (unsigned int i = 1; i < threads; i++)
+    {
+        Worker *worker = malloc(sizeof(Worker));
+        if (worker)
+        {
+            worker->pool = pool;
+            worker->index = i;
+        }
+        if (!worker || pthread_create(&pool->threads[i - 1], NULL, workerLoop, worker) != 0)
+        {
+            free(worker);
+            // poolSync counts every thread, so a pool with missing threads can't run
+            stopWorkers(pool, i - 1);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+/**
+ * @param pool the pool
+ * @return number of threads of the pool
+ */
+unsigned int poolSize(const ThreadPool *pool)
+{
+    return pool->count;
+}
+
+/**
+ * run the task on every thread of the pool and wait for all of them to finish
+ * @param pool the pool
+ * @param task the task
+ * @param arg argument given to the task
+ */
+void runPool(ThreadPool *pool, pool_task task, void *arg)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->pending = pool->count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->startCond);
+    pthread_mutex_unlock(&pool->lock);
+
+    task(arg, 0, pool->count);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * wait until every thread of the pool reaches this point, call only from inside a task
+ * @param pool the pool
+ */
+void poolSync(ThreadPool *pool)
+{
+    pthread_barrier_wait(&pool->sync);
+}
+
+/**
+ * stop the threads and free the pool
+ * @param pool the pool, may be NULL
+ */
+void freePool(ThreadPool *pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+    stopWorkers(pool, pool->count - 1);
+}
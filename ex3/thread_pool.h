@@ -0,0 +1,52 @@
+/**
+ * @author Idan Yamin
+ * @brief persistent pool of threads that all run the same task together.
+ */
+
+#ifndef EX3_THREAD_POOL_H
+#define EX3_THREAD_POOL_H
+
+/**
+ * task run by every thread of the pool
+ * @param arg shared argument
+ * @param index index of the thread, 0 is the calling thread
+ * @param count number of threads
+ */
+typedef void (*pool_task)(void *arg, unsigned int index, unsigned int count);
+
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * start a pool, the calling thread counts as one of the threads
+ * @param threads number of threads, at least 1
+ * @return new pool, NULL if the threads could not be created
+ */
+ThreadPool *createPool(unsigned int threads);
+
+/**
+ * @param pool the pool
+ * @return number of threads of the pool
+ */
+unsigned int poolSize(const ThreadPool *pool);
+
+/**
+ * run the task on every thread of the pool and wait for all of them to finish
+ * @param pool the pool
+ * @param task the task
+ * @param arg argument given to the task
+ */
+void runPool(ThreadPool *pool, pool_task task, void *arg);
+
+/**
+ * wait until every thread of the pool reaches this point, call only from inside a task
+ * @param pool the pool
+ */
+void poolSync(ThreadPool *pool);
+
+/**
+ * stop the threads and free the pool
+ * @param pool the pool, may be NULL
+ */
+void freePool(ThreadPool *pool);
+
+#endif //EX3_THREAD_POOL_H
@@ -0,0 +1,244 @@
+/**
+ * @author Idan Yamin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "trace.h"
+
+#define ERROR 1
+#define SUCCESS 0
+#define NANOSECONDS 1e9
+
+const char CSV_HEADER[] = "call,first_sweep,sweeps,sweep_seconds,min_sweep_seconds,"
+                          "max_sweep_seconds,reduction_seconds,other_seconds,cells_per_sec,"
+                          "diff\n";
+const char CSV_LINE[] = "%u,%u,%u,%.9f,%.9f,%.9f,%.9f,%.9f,%.6e,%.17g\n";
+const char JSON_LINE[] = "%s{\"call\": %u, \"first_sweep\": %u, \"sweeps\": %u, "
+                         "\"sweep_seconds\": %.9f, \"min_sweep_seconds\": %.9f, "
+                         "\"max_sweep_seconds\": %.9f, \"reduction_seconds\": %.9f, "
+                         "\"other_seconds\": %.9f, \"cells_per_sec\": %.6e, \"diff\": %.17g}";
+
+/**
+ * the trace and its open interval, which started after sweep first of call calls - 1. sweeps is
+ * the sweeps of the call so far, seconds the time of every phase in the interval, minSweep and
+ * maxSweep the fastest and slowest sweep of it. a tile of several sweeps counts as that many
+ * sweeps of the same time.
+ */
+struct Trace
+{
+    FILE *file;
+    TraceFormat format;
+    unsigned int interval;
+    unsigned int lines;
+    unsigned int calls;
+    size_t cells;
+    double mark;
+    unsigned int first;
+    unsigned int sweeps;
+    double seconds[TRACE_OTHER + 1];
+    double sweepStart;
+    double minSweep;
+    double maxSweep;
+    double diff;
+};
+
+
+// ____________ functions _______________
+double traceClock(void);
+
+void startInterval(Trace *trace);
+
+void writeInterval(Trace *trace);
+
+
+/**
+ * create the trace file
+ * @param path path of the file
+ * @param format layout of the file
+ * @param interval number of sweeps of an interval, at least 1
+ * @return new trace, NULL if the file could not be created or memory allocation went wrong
+ */
+Trace *createTrace(const char *path, TraceFormat format, unsigned int interval)
+{
+    Trace *trace = malloc(sizeof(Trace));
+    if (!trace)
+    {
+        return NULL;
+    }
+    trace->file = fopen(path, "w");
+    if (!trace->file)
+    {
+        free(trace);
+        return NULL;
+    }
+    trace->format = format;
+    trace->interval = interval ? interval : 1;
+    trace->lines = 0;
+    trace->calls = 0;
+    trace->cells = 0;
+    fputs(format == TRACE_JSON ? "[" : CSV_HEADER, trace->file);
+    return trace;
+}
+
+/**
+ * start a calculateGrid call, the clock of the first mark starts here
+ * @param trace the trace, may be NULL
+ * @param cells number of cells a sweep of the call updates
+ */
+void traceCall(Trace *trace, size_t cells)
+{
+    if (!trace)
+    {
+        return;
+    }
+    trace->calls++;
+    trace->cells = cells;
+    trace->sweeps = 0;
+    startInterval(trace);
+    trace->mark = traceClock();
+}
+
+/**
+ * the wall time since the last mark was spent on phase
+ * @param trace the trace, may be NULL
+ * @param phase what the time was spent on
+ */
+void traceMark(Trace *trace, TracePhase phase)
+{
+    if (!trace)
+    {
+        return;
+    }
+    double time = traceClock();
+    trace->seconds[phase] += time - trace->mark;
+    trace->mark = time;
+}
+
+/**
+ * the sweeps of the call got to sweeps, the time since the last mark is TRACE_OTHER. the
+ * interval is written when it has interval sweeps.
+ * @param trace the trace, may be NULL
+ * @param sweeps number of sweeps done in the call
+ * @param diff the last difference measured in the call, -1 if none was
+ */
+void traceSweeps(Trace *trace, unsigned int sweeps, double diff)
+{
+    if (!trace)
+    {
+        return;
+    }
+    traceMark(trace, TRACE_OTHER);
+    if (sweeps > trace->sweeps)
+    {
+        double each = (trace->seconds[TRACE_SWEEP] - trace->sweepStart) /
+                      (sweeps - trace->sweeps);
+        trace->minSweep = trace->minSweep < 0 || each < trace->minSweep ? each : trace->minSweep;
+        trace->maxSweep = each > trace->maxSweep ? each : trace->maxSweep;
+        trace->sweepStart = trace->seconds[TRACE_SWEEP];
+    }
+    trace->sweeps = sweeps;
+    trace->diff = diff;
+    if (trace->sweeps - trace->first >= trace->interval)
+    {
+        writeInterval(trace);
+        startInterval(trace);
+    }
+}
+
+/**
+ * end a calculateGrid call, the interval it left open is written
+ * @param trace the trace, may be NULL
+ */
+void traceEnd(Trace *trace)
+{
+    if (!trace)
+    {
+        return;
+    }
+    traceMark(trace, TRACE_OTHER);
+    if (trace->sweeps > trace->first)
+    {
+        writeInterval(trace);
+    }
+    startInterval(trace);
+}
+
+/**
+ * close the trace file and free the trace
+ * @param trace the trace, may be NULL
+ * @return 0 if succeeded, 1 if writing the file went wrong
+ */
+int freeTrace(Trace *trace)
+{
+    if (!trace)
+    {
+        return SUCCESS;
+    }
+    if (trace->format == TRACE_JSON)
+    {
+        fputs(trace->lines ? "\n]\n" : "]\n", trace->file);
+    }
+    int failed = ferror(trace->file);
+    failed |= fclose(trace->file) != 0;
+    free(trace);
+    return failed ? ERROR : SUCCESS;
+}
+
+/**
+ * @return seconds of a monotonic clock
+ */
+double traceClock(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / NANOSECONDS;
+}
+
+/**
+ * start a new interval after the sweeps done so far
+ * @param trace the trace
+ */
+void startInterval(Trace *trace)
+{
+    trace->first = trace->sweeps;
+    for (int phase = TRACE_SWEEP; phase <= TRACE_OTHER; phase++)
+    {
+        trace->seconds[phase] = 0;
+    }
+    trace->sweepStart = 0;
+    trace->minSweep = -1;
+    trace->maxSweep = 0;
+    trace->diff = -1;
+}
+
+/**
+ * write the open interval
+ * @param trace the trace
+ */
+void writeInterval(Trace *trace)
+{
+    unsigned int sweeps = trace->sweeps - trace->first;
+    double sweepSeconds = trace->seconds[TRACE_SWEEP];
+    double cellsPerSecond = 0;
+    if (sweepSeconds > 0)
+    {
+        cellsPerSecond = (double) trace->cells * sweeps / sweepSeconds;
+    }
+    double minSweep = trace->minSweep < 0 ? 0 : trace->minSweep;
+    if (trace->format == TRACE_JSON)
+    {
+        fprintf(trace->file, JSON_LINE, trace->lines ? ",\n" : "\n", trace->calls - 1,
+                trace->first, sweeps, sweepSeconds, minSweep, trace->maxSweep,
+                trace->seconds[TRACE_REDUCTION], trace->seconds[TRACE_OTHER], cellsPerSecond,
+                trace->diff);
+    }
+    else
+    {
+        fprintf(trace->file, CSV_LINE, trace->calls - 1, trace->first, sweeps, sweepSeconds,
+                minSweep, trace->maxSweep, trace->seconds[TRACE_REDUCTION],
+                trace->seconds[TRACE_OTHER], cellsPerSecond, trace->diff);
+    }
+    trace->lines++;
+}
@@ -0,0 +1,85 @@
+/**
+ * @author Idan Yamin
+ * @brief trace of the sweeps of a calculator: for every interval of sweeps, the wall time spent
+ * sweeping, summing the heat and between the sweeps, the cells updated per second and the last
+ * difference, written as CSV or JSON. every function does nothing for a NULL trace, so a
+ * calculator without one pays a NULL test per sweep and reads no clock.
+ */
+
+#ifndef EX3_TRACE_H
+#define EX3_TRACE_H
+
+#include <stddef.h>
+
+/**
+ * what the wall time since the last mark of a trace was spent on
+ * TRACE_SWEEP: updating cells, the heat of the rows summed inside the sweep included
+ * TRACE_REDUCTION: summing the heat of the grid and taking the difference
+ * TRACE_OTHER: anything else between two sweeps, like the sweep hook
+ */
+typedef enum TracePhase
+{
+    TRACE_SWEEP,
+    TRACE_REDUCTION,
+    TRACE_OTHER
+} TracePhase;
+
+/**
+ * layout of the trace file
+ * TRACE_CSV: a header line, then one line per interval
+ * TRACE_JSON: an array with one object per interval
+ */
+typedef enum TraceFormat
+{
+    TRACE_CSV,
+    TRACE_JSON
+} TraceFormat;
+
+typedef struct Trace Trace;
+
+/**
+ * create the trace file
+ * @param path path of the file
+ * @param format layout of the file
+ * @param interval number of sweeps of an interval, at least 1
+ * @return new trace, NULL if the file could not be created or memory allocation went wrong
+ */
+Trace *createTrace(const char *path, TraceFormat format, unsigned int interval);
+
+/**
+ * start a calculateGrid call, the clock of the first mark starts here
+ * @param trace the trace, may be NULL
+ * @param cells number of cells a sweep of the call updates
+ */
+void traceCall(Trace *trace, size_t cells);
+
+/**
+ * the wall time since the last mark was spent on phase
+ * @param trace the trace, may be NULL
+ * @param phase what the time was spent on
+ */
+void traceMark(Trace *trace, TracePhase phase);
+
+/**
+ * the sweeps of the call got to sweeps, the time since the last mark is TRACE_OTHER. the
+ * interval is written when it has interval sweeps.
+ * @param trace the trace, may be NULL
+ * @param sweeps number of sweeps done in the call
+ * @param diff the last difference measured in the call, -1 if none was
+ */
+void traceSweeps(Trace *trace, unsigned int sweeps, double diff);
+
+/**
+ * end a calculateGrid call, the interval it left open is written
+ * @param trace the trace, may be NULL
+ */
+void traceEnd(Trace *trace);
+
+/**
+ * close the trace file and free the trace
+ * @param trace the trace, may be NULL
+ * @return 0 if succeeded, 1 if writing the file went wrong
+ */
+int freeTrace(Trace *trace);
+
+#endif //EX3_TRACE_H